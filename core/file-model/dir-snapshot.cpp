@@ -0,0 +1,255 @@
+#include "dir-snapshot.h"
+
+#include "log/log.h"
+#include "file-records.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QCryptographicHash>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DIR_SNAPSHOT_MAGIC                  "GFDSNAP"           // with its '\0', 8 bytes
+#define DIR_SNAPSHOT_VERSION                1                   // bump on any change of the layout below
+#define DIR_SNAPSHOT_BYTE_ORDER             0x01020304u         // read back in another order on a foreign host
+
+namespace graceful
+{
+// the file is: SnapshotHeader, the uri padded to 8 bytes, SnapshotEntry[count], names
+struct SnapshotHeader
+{
+    char                                magic[8];
+    quint32                             version;
+    quint32                             byteOrder;
+    quint64                             dev;
+    quint64                             ino;
+    qint64                              mtimeSec;
+    qint64                              mtimeNsec;
+    quint32                             count;
+    quint32                             entrySize;
+    quint32                             uriSize;
+    quint32                             namesSize;
+    quint32                             entriesOffset;
+    quint32                             namesOffset;
+};
+
+struct SnapshotEntry
+{
+    quint64                             size;
+    quint64                             mtime;
+    quint32                             nameOffset;             // into the names
+    quint32                             mode;
+    quint16                             nameLength;
+    quint8                              type;                   // GFileType
+    quint8                              reserved[5];
+};
+
+static_assert(sizeof(SnapshotHeader) == 72, "the snapshot header is part of the file format");
+static_assert(sizeof(SnapshotEntry) == 32, "the snapshot entry is part of the file format");
+
+static inline quint32 align8(quint32 n)
+{
+    return (n + 7) & ~7u;
+}
+
+class SnapshotWriter : public QRunnable
+{
+public:
+    SnapshotWriter(const QString& path, const QByteArray& data) : mPath(path), mData(data)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        QDir().mkpath(QFileInfo(mPath).absolutePath());
+
+        // readers never see a partial file, a failed write leaves the old one
+        QSaveFile file(mPath);
+        if (!file.open(QIODevice::WriteOnly)) {
+            log_debug("open snapshot '%s' error", mPath.toUtf8().constData());
+            return;
+        }
+
+        if (file.write(mData) != mData.size() || !file.commit()) {
+            log_debug("write snapshot '%s' error", mPath.toUtf8().constData());
+        }
+    }
+
+private:
+    QString                             mPath;
+    QByteArray                          mData;
+};
+}
+
+
+bool graceful::DirSnapshot::Stamp::operator==(const Stamp& other) const
+{
+    return dev == other.dev && ino == other.ino && mtimeSec == other.mtimeSec && mtimeNsec == other.mtimeNsec;
+}
+
+graceful::DirSnapshot::Stamp graceful::DirSnapshot::stampOf(const QString& path)
+{
+    Stamp stamp;
+
+    struct stat st;
+    if (0 != ::stat(QFile::encodeName(path).constData(), &st) || !S_ISDIR(st.st_mode)) {
+        return stamp;
+    }
+
+    stamp.dev = quint64(st.st_dev);
+    stamp.ino = quint64(st.st_ino);
+    stamp.mtimeSec = qint64(st.st_mtim.tv_sec);
+    stamp.mtimeNsec = qint64(st.st_mtim.tv_nsec);
+
+    return stamp;
+}
+
+bool graceful::DirSnapshot::load(const QString& uri, const Stamp& stamp, FileRecords* records, QVector<int>& ids)
+{
+    gf_return_val_if_fail(records && stamp.isValid(), false);
+
+    int fd = ::open(QFile::encodeName(snapshotPath(uri)).constData(), O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (0 != ::fstat(fd, &st) || st.st_size < qint64(sizeof(SnapshotHeader)) || st.st_size > INT_MAX) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t len = size_t(st.st_size);
+    void* map = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    gf_return_val_if_fail(MAP_FAILED != map, false);
+
+    const char* base = static_cast<const char*>(map);
+    const SnapshotHeader* header = static_cast<const SnapshotHeader*>(map);
+    QByteArray encodedUri = uri.toUtf8();
+
+    // everything read below is checked to lie inside the file first
+    bool valid = 0 == memcmp(header->magic, DIR_SNAPSHOT_MAGIC, sizeof(header->magic))
+            && DIR_SNAPSHOT_VERSION == header->version
+            && DIR_SNAPSHOT_BYTE_ORDER == header->byteOrder
+            && sizeof(SnapshotEntry) == header->entrySize
+            && stamp.dev == header->dev && stamp.ino == header->ino
+            && stamp.mtimeSec == header->mtimeSec && stamp.mtimeNsec == header->mtimeNsec
+            && quint32(encodedUri.size()) == header->uriSize
+            && header->entriesOffset == align8(quint32(sizeof(SnapshotHeader)) + header->uriSize)
+            && quint64(header->entriesOffset) + quint64(header->count) * sizeof(SnapshotEntry) == header->namesOffset
+            && quint64(header->namesOffset) + header->namesSize == len
+            && 0 == memcmp(base + sizeof(SnapshotHeader), encodedUri.constData(), size_t(encodedUri.size()));
+
+    if (valid) {
+        const SnapshotEntry* entries = reinterpret_cast<const SnapshotEntry*>(base + header->entriesOffset);
+        const char* names = base + header->namesOffset;
+
+        ids.reserve(ids.size() + int(header->count));
+        for (quint32 i = 0; i < header->count; ++i) {
+            const SnapshotEntry& e = entries[i];
+            if (quint64(e.nameOffset) + e.nameLength > header->namesSize) {
+                continue;
+            }
+
+            int id = records->addChild(names + e.nameOffset, e.nameLength, GFileType(e.type), e.size, e.mtime, e.mode);
+            if (id >= 0) {
+                ids << id;
+            }
+        }
+    }
+
+    ::munmap(map, len);
+
+    return valid;
+}
+
+void graceful::DirSnapshot::saveAsync(const QString& uri, const Stamp& stamp, const FileRecords* records)
+{
+    gf_return_if_fail(records && stamp.isValid());
+
+    QByteArray encodedUri = uri.toUtf8();
+
+    // the entries and names are built here, the writer only does I/O
+    QVector<SnapshotEntry> entries;
+    entries.reserve(records->count());
+    QByteArray names;
+
+    for (int id = 0; id < records->idCount(); ++id) {
+        int nameLen = 0;
+        const char* name = records->childName(id, &nameLen);
+        if (!name || !records->isLoaded(id)) {
+            continue;
+        }
+
+        SnapshotEntry e;
+        memset(&e, 0, sizeof(e));
+        e.size = records->size(id);
+        e.mtime = records->modifyTime(id);
+        e.nameOffset = quint32(names.size());
+        e.mode = records->mode(id);
+        e.nameLength = quint16(nameLen);
+        e.type = quint8(records->type(id));
+        entries << e;
+
+        names.append(name, nameLen);
+    }
+
+    // rows stored whole don't fit a snapshot, an empty one would hide them
+    // at the next start. The previous snapshot is left as it is
+    if (entries.isEmpty() && records->count() > 0) {
+        log_debug("no row of '%s' fits a snapshot, not written", encodedUri.constData());
+        return;
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DIR_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = DIR_SNAPSHOT_VERSION;
+    header.byteOrder = DIR_SNAPSHOT_BYTE_ORDER;
+    header.dev = stamp.dev;
+    header.ino = stamp.ino;
+    header.mtimeSec = stamp.mtimeSec;
+    header.mtimeNsec = stamp.mtimeNsec;
+    header.count = quint32(entries.size());
+    header.entrySize = sizeof(SnapshotEntry);
+    header.uriSize = quint32(encodedUri.size());
+    header.namesSize = quint32(names.size());
+    header.entriesOffset = align8(quint32(sizeof(SnapshotHeader)) + header.uriSize);
+    header.namesOffset = header.entriesOffset + header.count * quint32(sizeof(SnapshotEntry));
+
+    QByteArray data(int(header.namesOffset + header.namesSize), '\0');
+    char* out = data.data();
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + sizeof(header), encodedUri.constData(), size_t(encodedUri.size()));
+    if (!entries.isEmpty()) {
+        memcpy(out + header.entriesOffset, entries.constData(), size_t(entries.size()) * sizeof(SnapshotEntry));
+    }
+    memcpy(out + header.namesOffset, names.constData(), size_t(names.size()));
+
+    QThreadPool::globalInstance()->start(new SnapshotWriter(snapshotPath(uri), data));
+}
+
+void graceful::DirSnapshot::remove(const QString& uri)
+{
+    QFile::remove(snapshotPath(uri));
+}
+
+QString graceful::DirSnapshot::snapshotPath(const QString& uri)
+{
+    static const QString gDir = QFile::decodeName(g_get_user_cache_dir()) + QStringLiteral("/graceful/snapshots/");
+
+    QByteArray key = QCryptographicHash::hash(uri.toUtf8(), QCryptographicHash::Md5).toHex();
+
+    return gDir + QString::fromLatin1(key) + QStringLiteral(".snap");
+}
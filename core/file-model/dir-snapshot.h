@@ -0,0 +1,74 @@
+#ifndef DIRSNAPSHOT_H
+#define DIRSNAPSHOT_H
+
+#include "globals.h"
+
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+
+namespace graceful
+{
+class FileRecords;
+
+/**
+ * @brief
+ * On-disk copy of the records of a listed local directory, so a directory
+ * shown before is listed at once on the next start. One file per directory
+ * under $XDG_CACHE_HOME/graceful/snapshots, written atomically in the
+ * background and read through mmap() with no parsing: a fixed header, an
+ * array of fixed size entries and the pool of their names.
+ *
+ * A snapshot is only used while the directory has the device, inode and
+ * mtime it was taken with, so its set of names is the current one. Sizes and
+ * times of the entries may still be old, the caller reconciles them with a
+ * fresh listing.
+ */
+class DirSnapshot
+{
+public:
+    /**
+     * @brief
+     * identity and mtime of a directory, what a snapshot is checked against
+     */
+    struct Stamp
+    {
+        quint64                         dev = 0;
+        quint64                         ino = 0;
+        qint64                          mtimeSec = 0;
+        qint64                          mtimeNsec = 0;
+
+        bool isValid() const { return 0 != ino; }
+        bool operator==(const Stamp& other) const;
+    };
+
+    BLOCKING static Stamp stampOf(const QString& path);
+
+    /**
+     * @brief
+     * add the entries of the snapshot of 'uri' to 'records', whose base uri is
+     * 'uri', and append their ids to 'ids'. Return false if there is no
+     * snapshot matching 'stamp'
+     */
+    BLOCKING static bool load(const QString& uri, const Stamp& stamp, FileRecords* records, QVector<int>& ids);
+
+    /**
+     * @brief
+     * serialize the children of the base uri in 'records' and write them in
+     * QThreadPool::globalInstance(). Nothing is written when none of the
+     * records could be kept. 'uri' is in GIO's form, see File::uri()
+     */
+    NO_BLOCKING static void saveAsync(const QString& uri, const Stamp& stamp, const FileRecords* records);
+
+    /**
+     * @brief
+     * drop the snapshot of 'uri'
+     */
+    BLOCKING static void remove(const QString& uri);
+
+private:
+    static QString snapshotPath(const QString& uri);
+};
+}
+
+#endif // DIRSNAPSHOT_H
@@ -4,21 +4,157 @@
 #include <QIcon>
 #include <QIcon>
 #include <QDebug>
+#include <QTimer>
+#include <QThread>
 #include <QMimeData>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QElapsedTimer>
 #include <QtCore/private/qobject_p.h>
 
 #include "log/log.h"
 #include "file/file.h"
+#include "dir-snapshot.h"
+#include "file-records.h"
+#include "file-name-index.h"
+#include "thumbnail-manager.h"
+#include "file/file-operation.h"
+#include "file/file-info-cache.h"
 #include "file/file-enumerator.h"
 
+#include <algorithm>
+#include <functional>
+
+#include <string.h>
+
+#define FILE_MODEL_MONITOR_COALESCE_MS          100             // events in one window become one set of row changes
+#define FILE_MODEL_SNAPSHOT_DELAY_MS            2000            // a directory changing often is written once per delay
+#define FILE_MODEL_RESORT_DELAY_MS              100             // rows added to a sorted model are put in place this late
+#define FILE_MODEL_PARALLEL_SORT_MIN            16384           // fewer rows are sorted in one thread
+#define FILE_MODEL_NAME_KEY_CHUNK               2048            // collation keys built per job
+#define FILE_MODEL_PAGE_SIZE                    2000            // rows streamed before waiting for fetchMore()
+
+// what the records are filled from: type and size, mtime, mode
+#define FILE_MODEL_ATTRIBUTES                   (File::AttributeStandard | File::AttributeTime | File::AttributeOwner)
+
+namespace graceful
+{
+struct SortItem
+{
+    const char*                         key = nullptr;          // collation key of the name
+    quint64                             value = 0;              // of the sort column, 0 when sorting by name
+    int                                 id = -1;
+    bool                                isDir = false;
+};
+
+class SortJob : public QRunnable
+{
+public:
+    SortJob(const std::function<void()>& func, QSemaphore& done) : mFunc(func), mDone(done)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        mFunc();
+        mDone.release();
+    }
+
+private:
+    std::function<void()>               mFunc;
+    QSemaphore&                         mDone;
+};
+
+// in QThreadPool::globalInstance(), or in this thread when the pool has no thread left
+static void runJobs(const QList<std::function<void()>>& jobs)
+{
+    QSemaphore done;
+    for (const auto& func : jobs) {
+        SortJob* job = new SortJob(func, done);
+        if (!QThreadPool::globalInstance()->tryStart(job)) {
+            job->run();
+            delete job;
+        }
+    }
+
+    done.acquire(jobs.size());
+}
+
+// sorted in parts, then neighbour parts are merged pairwise
+template<typename T, typename Less>
+static void parallelSort(T* data, int n, Less less)
+{
+    int parts = qMin(QThread::idealThreadCount(), n / (FILE_MODEL_PARALLEL_SORT_MIN / 2));
+    if (n < FILE_MODEL_PARALLEL_SORT_MIN || parts < 2) {
+        std::sort(data, data + n, less);
+        return;
+    }
+
+    QVector<int> bounds;
+    for (int i = 0; i <= parts; ++i) {
+        bounds << int(qint64(n) * i / parts);
+    }
+
+    QList<std::function<void()>> jobs;
+    for (int i = 0; i < parts; ++i) {
+        T* begin = data + bounds.at(i);
+        T* end = data + bounds.at(i + 1);
+        jobs << [=] () { std::sort(begin, end, less); };
+    }
+    runJobs(jobs);
+
+    for (int width = 1; width < parts; width *= 2) {
+        jobs.clear();
+        for (int i = 0; i + width < parts; i += 2 * width) {
+            T* begin = data + bounds.at(i);
+            T* middle = data + bounds.at(i + width);
+            T* end = data + bounds.at(qMin(i + 2 * width, parts));
+            jobs << [=] () { std::inplace_merge(begin, middle, end, less); };
+        }
+        runJobs(jobs);
+    }
+}
+}
+
+
 graceful::FileModel::FileModel(QObject *parent) : QAbstractItemModel(parent)
 {
+    mRecords = new FileRecords;
+    mNameIndex = new FileNameIndex;
+
+    mMonitorTimer = new QTimer(this);
+    mMonitorTimer->setSingleShot(true);
+    mMonitorTimer->setInterval(FILE_MODEL_MONITOR_COALESCE_MS);
+    connect(mMonitorTimer, &QTimer::timeout, this, &FileModel::applyMonitorEvents);
+
+    mSnapshotTimer = new QTimer(this);
+    mSnapshotTimer->setSingleShot(true);
+    mSnapshotTimer->setInterval(FILE_MODEL_SNAPSHOT_DELAY_MS);
+    connect(mSnapshotTimer, &QTimer::timeout, this, &FileModel::saveSnapshot);
+
+    mSortTimer = new QTimer(this);
+    mSortTimer->setSingleShot(true);
+    mSortTimer->setInterval(FILE_MODEL_RESORT_DELAY_MS);
+    connect(mSortTimer, &QTimer::timeout, this, &FileModel::sortRows);
 
+    connect(ThumbnailManager::getInstance(), &ThumbnailManager::thumbnailFinished, this, &FileModel::onThumbnailFinished);
 }
 
 graceful::FileModel::~FileModel()
 {
+    // the last changes of the directory are not lost, while the events are still pending
+    if (mSnapshotTimer->isActive()) {
+        saveSnapshot();
+    }
+
+    stopMonitor();
+    cancelThumbnails();
 
+    if (mNameIndex)                     delete mNameIndex;
+    if (mRecords)                       delete mRecords;
+    if (mCurrentPath)                   delete mCurrentPath;
 }
 
 void graceful::FileModel::setRootPath(QString rootPath)
@@ -26,41 +162,163 @@ void graceful::FileModel::setRootPath(QString rootPath)
     // file exists?
     gf_return_if_fail(!rootPath.isEmpty());
 
+    if (mSnapshotTimer->isActive()) {
+        saveSnapshot();
+    }
+
     if (mCurrentPath) {
         delete mCurrentPath;
         mCurrentPath = nullptr;
     }
     mCurrentPath = new File(rootPath);
 
-    if (!mItems.isEmpty()) {
+    if (!mRows.isEmpty()) {
         removeAll();
     }
+    mRecords->clear();
+    mRecords->setBaseUri(mCurrentPath->uri());
+    mNameIndex->clear();
+    mUnconfirmed.clear();
+    mSortedRows = 0;
+
+    // events of the old root are stale, created files are picked up by the listing below
+    stopMonitor();
+    startMonitor();
+
+    loadSnapshot();
+    mListing = true;
+
+    // the previous listing must not insert into this one
+    if (mEnumerator) {
+        mEnumerator->disconnect(this);
+        mEnumerator->deleteLater();
+    }
 
     // enumerate
     auto fileEnum = new FileEnumerator(this);
+    mEnumerator = fileEnum;
     fileEnum->setEnumerateDirectory(rootPath);
+    fileEnum->setQueryAttributes(FILE_MODEL_ATTRIBUTES);
     fileEnum->setAutoDelete();
+    if (mStreaming) {
+        // a snapshot already shows every row, the listing only confirms them
+        fileEnum->setPageSize(mRows.isEmpty() ? FILE_MODEL_PAGE_SIZE : 0);
+        fileEnum->connect(fileEnum, &FileEnumerator::childrenInfoUpdate, this, [=] (const QStringList& uris, const QList<FileInfoPtr>& infos) {
+            insertFiles(mRows.size(), uris, infos);
+        });
+        fileEnum->connect(fileEnum, &FileEnumerator::enumerateFinished, this, [=] (bool res) {
+            if (!res) {
+                log_debug("enumerator error!");
+            }
+            listingFinished(res);
+        });
+    } else {
+        fileEnum->connect(fileEnum, &FileEnumerator::enumerateFinished, this, [=] (bool res) {
+            if (res) {
+                insertFiles(mRows.size(), fileEnum->getChildrenUris(), fileEnum->getChildrenInfos());
+            } else {
+                log_debug("enumerator error!");
+            }
+            listingFinished(res);
+        });
+    }
     fileEnum->enumerateAsync();
-    fileEnum->connect(fileEnum, &FileEnumerator::enumerateFinished, this, [=] (bool res) {
-        if (res) {
-            insertFiles(0, fileEnum->getChildrenUris());
-        } else {
-            log_debug("enumerator error!");
+}
+
+void graceful::FileModel::setStreamingMode(bool streaming)
+{
+    mStreaming = streaming;
+}
+
+bool graceful::FileModel::isStreamingMode() const
+{
+    return mStreaming;
+}
+
+graceful::File* graceful::FileModel::file(const QModelIndex& index) const
+{
+    gf_return_val_if_fail(index.isValid() && index.row() < mRows.size(), nullptr);
+
+    return mRecords->file(int(index.internalId()));
+}
+
+graceful::FileOperation* graceful::FileModel::removeFiles(const QModelIndexList& indexes, bool permanently)
+{
+    QStringList uris;
+    for (const auto& index : indexes) {
+        if (index.isValid() && ColumnFileName == index.column() && index.model() == this) {
+            uris << mRecords->uri(int(index.internalId()));
         }
-    });
+    }
+
+    gf_return_val_if_fail(!uris.isEmpty(), nullptr);
+
+    // not a child of the model, a listing of another directory doesn't stop it
+    auto op = new FileOperation(permanently ? FileOperation::Delete : FileOperation::Trash, uris);
+    op->setAutoDelete();
+    op->startAsync();
+
+    return op;
+}
+
+QVector<int> graceful::FileModel::filterRows(const QString& text, FilterMode mode) const
+{
+    QVector<int> rows;
+
+    if (text.isEmpty()) {
+        rows.reserve(mRows.size());
+        for (int row = 0; row < mRows.size(); ++row) {
+            rows << row;
+        }
+        return rows;
+    }
+
+    QVector<int> ids = (FilterFuzzy == mode) ? mNameIndex->findFuzzy(text) : mNameIndex->findSubstring(text);
+    if (ids.isEmpty()) {
+        return rows;
+    }
+
+    // the rank of every matched id, then one pass over the rows puts them in place
+    QVector<int> rank(mRecords->idCount(), -1);
+    for (int i = 0; i < ids.size(); ++i) {
+        if (ids.at(i) < rank.size()) {
+            rank[ids.at(i)] = i;
+        }
+    }
+
+    QVector<int> ranked(ids.size(), -1);
+    for (int row = 0; row < mRows.size(); ++row) {
+        int r = rank.at(mRows.at(row));
+        if (r >= 0) {
+            ranked[r] = row;
+        }
+    }
+
+    rows.reserve(ids.size());
+    for (int row : ranked) {
+        if (row >= 0) {
+            rows << row;
+        }
+    }
+
+    // substring matches come in id order, the view wants them in row order
+    if (FilterSubstring == mode) {
+        std::sort(rows.begin(), rows.end());
+    }
+
+    return rows;
 }
 
 void graceful::FileModel::fetchMore(const QModelIndex &parent)
 {
-    Q_UNUSED(parent)
+    gf_return_if_fail(!parent.isValid() && mEnumerator);
+
+    mEnumerator->fetchMore();
 }
 
 bool graceful::FileModel::canFetchMore(const QModelIndex &parent) const
 {
-    gf_return_val_if_fail(mCurrentPath && mCurrentPath->isValid(), false);
-
-    return true;
-    Q_UNUSED(parent)
+    return !parent.isValid() && mEnumerator && mEnumerator->canFetchMore();
 }
 
 Qt::ItemFlags graceful::FileModel::flags(const QModelIndex &index) const
@@ -127,48 +385,65 @@ Qt::ItemFlags graceful::FileModel::flags(const QModelIndex &index) const
 
 QVariant graceful::FileModel::data(const QModelIndex &index, int role) const
 {
-    gf_return_val_if_fail(index.isValid() && index.row() <= mItems.size() && index.column() < NumOfColumns, QVariant());
+    gf_return_val_if_fail(index.isValid() && index.row() < mRows.size() && index.column() < NumOfColumns, QVariant());
 
-    FileModelItem* item = reinterpret_cast<FileModelItem*>(index.internalPointer());
+    int id = int(index.internalId());
 
+    // everything below was formatted when the record was filled, views ask thousands of times per repaint
     switch(role) {
     case Qt::ToolTipRole:
-        return QVariant("makeTooltip(item)");
+        return mRecords->displayName(id);
     case Qt::DisplayRole:  {
         switch(index.column()) {
         case ColumnFileName:
-            return item->name();
+            return mRecords->displayName(id);
         case ColumnFileType:
-            return item->name();
+            return mRecords->typeText(id);
         case ColumnFileMTime:
-            return (item->uri());
-        case ColumnFileCrTime:
-            return (item->uri());
-        case ColumnFileDTime:
-            return (item->uri());
+            return mRecords->modifyTimeText(id);
         case ColumnFileSize:
-            return (item->uri());
+            return mRecords->sizeText(id);
         case ColumnFileOwner:
-            return (item->uri());
+            return mRecords->ownerText(id);
         case ColumnFileGroup:
-            return (item->uri());
+            return mRecords->groupText(id);
+        case ColumnFileCrTime:
+        case ColumnFileDTime:
+            // not kept by the records
+            break;
         }
         break;
     }
     case Qt::DecorationRole: {
-        return item->icon();
+        if (ColumnFileName == index.column()) {
+            // images show their type until the thumbnail is decoded in the background
+            if (mRecords->isImage(id)) {
+                QString uri = mRecords->uri(id);
+                if (!mThumbnailIds.contains(uri)) {
+                    QIcon thumbnail = ThumbnailManager::getInstance()->thumbnail(uri);
+                    if (!thumbnail.isNull()) {
+                        return thumbnail;
+                    }
+                    mThumbnailIds.insert(uri, id);
+                }
+            }
+            return mRecords->icon(id);
+        }
+        break;
     }
     case Qt::EditRole: {
         if(index.column() == 0) {
-            return (item->name());
+            return (mRecords->displayName(id));
         }
         break;
     }
     case FileUriRole:
     case FileInfoRole:
-        return (item->uri());
+        return mRecords->uri(id);
+    case FileUriIdRole:
+        return mRecords->uriId(id);
     case FileIsDirRole:
-        return (item->uri());
+        return G_FILE_TYPE_DIRECTORY == mRecords->type(id);
     case FileIsCutRole:
         return false;
     }
@@ -178,11 +453,9 @@ QVariant graceful::FileModel::data(const QModelIndex &index, int role) const
 
 QModelIndex graceful::FileModel::index(int row, int column, const QModelIndex &parent) const
 {
-    gf_return_val_if_fail(row >= 0 && row < mItems.size() && column >= 0 && column < NumOfColumns, QModelIndex());
-
-    const FileModelItem* item = mItems.at(row);
+    gf_return_val_if_fail(row >= 0 && row < mRows.size() && column >= 0 && column < NumOfColumns, QModelIndex());
 
-    return createIndex(row, column, (void*)item);
+    return createIndex(row, column, quintptr(mRows.at(row)));
 }
 
 QVariant graceful::FileModel::headerData(int section, Qt::Orientation orientation, int role) const
@@ -235,49 +508,36 @@ QStringList graceful::FileModel::mimeTypes() const
 QMimeData *graceful::FileModel::mimeData(const QModelIndexList &indexes) const
 {
     QMimeData* data = QAbstractItemModel::mimeData(indexes);
-    QByteArray urilist, libfmUrilist;
+    gf_return_val_if_fail(data, nullptr);
+
+    QByteArray urilist;
     urilist.reserve(4096);
-    libfmUrilist.reserve(4096);
 
+    // one entry per row, the other columns of a row are the same file
     for(const auto& index : indexes) {
-        FileModelItem* item = reinterpret_cast<FileModelItem*>(index.internalPointer());
-//        if(item && item->mInfo) {
-//            auto path = item->mInfo->path();
-//            if(path.isValid()) {
-//                // get the list that will be used by internal DND
-//                auto uri = path.uri();
-//                libfmUrilist.append(uri.get());
-//                libfmUrilist.append('\n');
-
-//                if(auto localPath = path.localPath()) {
-//                    QUrl url = QUrl::fromLocalFile(QString::fromUtf8(localPath.get()));
-//                    urilist.append(url.toEncoded());
-//                } else {
-//                    urilist.append(uri.get());
-//                }
-//                urilist.append('\n');
-//            }
-//        }
+        if (index.isValid() && ColumnFileName == index.column()) {
+            urilist.append(mRecords->uri(int(index.internalId())).toUtf8());
+            urilist.append("\r\n");
+        }
     }
     data->setData(QStringLiteral("text/uri-list"), urilist);
 
-    return QAbstractItemModel::mimeData(indexes);
+    return data;
 }
 
 QModelIndex graceful::FileModel::parent(const QModelIndex &index) const
 {
-    gf_return_val_if_fail(index.isValid(), QModelIndex());
+    // a flat list, no row has a parent
+    return QModelIndex();
 
-    const FileModelItem* item = mItems.at(index.row());
-
-    return createIndex(index.row(), index.column(), (void*)&item);
+    Q_UNUSED(index)
 }
 
 int graceful::FileModel::rowCount(const QModelIndex &parent) const
 {
     gf_return_val_if_fail(!parent.isValid(), 0);
 
-    return mItems.size();
+    return mRows.size();
 }
 
 int graceful::FileModel::columnCount(const QModelIndex &parent) const
@@ -289,7 +549,10 @@ int graceful::FileModel::columnCount(const QModelIndex &parent) const
 
 bool graceful::FileModel::removeRows(int row, int count, const QModelIndex& parent)
 {
-    return true;
+    // views call this on the source of every move drag, icons moved around
+    // the view included, so it never touches the files. Rows of files which
+    // are gone are removed by the monitor, see removeFiles() to delete
+    return false;
 
     Q_UNUSED(row)
     Q_UNUSED(count)
@@ -313,7 +576,7 @@ bool graceful::FileModel::setItemData(const QModelIndex &index, const QMap<int,
 
 bool graceful::FileModel::setData(const QModelIndex &index, const QVariant &value, int role)
 {
-    if (index.row() >= 0 && index.row() < mItems.size() && (role == Qt::EditRole || role == Qt::DisplayRole)) {
+    if (index.row() >= 0 && index.row() < mRows.size() && (role == Qt::EditRole || role == Qt::DisplayRole)) {
 //        const QString valueString = value.toString();
 //        if (mItems.at(index.row()) == valueString) {
 //            return true;
@@ -332,13 +595,20 @@ bool graceful::FileModel::setHeaderData(int section, Qt::Orientation orientation
 
 void graceful::FileModel::sort(int column, Qt::SortOrder order)
 {
-    QAbstractItemModel::sort(column, order);
+    gf_return_if_fail(column < NumOfColumns);
+
+    // -1 keeps the rows as they are, new ones are appended
+    mSortColumn = qMax(column, -1);
+    mSortOrder = order;
+    mSortedRows = 0;
+
+    sortRows();
 }
 
 QModelIndex graceful::FileModel::sibling(int row, int column, const QModelIndex &index) const
 {
     if (row == index.row() && column < NumOfColumns) {
-        return createIndex(row, column, index.internalPointer());
+        return createIndex(row, column, index.internalId());
     } else {
         return QAbstractItemModel::sibling(row, column, index);
     }
@@ -356,68 +626,618 @@ Qt::DropActions graceful::FileModel::supportedDropActions() const
 
 bool graceful::FileModel::dropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent)
 {
-    return QAbstractItemModel::dropMimeData(data, action, row, column, parent);
+    if (!canDropMimeData(data, action, row, column, parent)) {
+        return false;
+    }
+
+    QString target = dropTarget(parent);
+    g_autoptr(GFile) targetFile = g_file_new_for_uri(target.toUtf8().constData());
+
+    QStringList sources;
+    for (const auto& line : data->data(QStringLiteral("text/uri-list")).split('\n')) {
+        QByteArray uri = line.trimmed();
+        if (uri.isEmpty() || uri.startsWith('#')) {
+            continue;
+        }
+
+        // already there, as when icons are only moved around the view
+        g_autoptr(GFile) file = g_file_new_for_uri(uri.constData());
+        g_autoptr(GFile) parentFile = g_file_get_parent(file);
+        if (g_file_equal(file, targetFile) || (Qt::MoveAction == action && parentFile && g_file_equal(parentFile, targetFile))) {
+            continue;
+        }
+
+        sources << QString::fromUtf8(uri);
+    }
+
+    // files dropped on the folder they are in
+    if (sources.isEmpty()) {
+        return false;
+    }
+
+    // the monitor of the root brings the new rows
+    auto op = new FileOperation((Qt::MoveAction == action) ? FileOperation::Move : FileOperation::Copy, sources, target);
+    op->setAutoDelete();
+    op->startAsync();
+
+    return true;
+
+    Q_UNUSED(row)
+    Q_UNUSED(column)
 }
 
 bool graceful::FileModel::canDropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent) const
 {
-    return QAbstractItemModel::canDropMimeData(data, action, row, column, parent);
+    gf_return_val_if_fail(data, false);
+
+    // links are not made by a drop, the view asks for every action it may offer
+    if (Qt::CopyAction != action && Qt::MoveAction != action) {
+        return false;
+    }
+
+    return data->hasFormat(QStringLiteral("text/uri-list")) && !dropTarget(parent).isEmpty();
+
+    Q_UNUSED(row)
+    Q_UNUSED(column)
 }
 
-void graceful::FileModel::removeAll()
+QString graceful::FileModel::dropTarget(const QModelIndex& parent) const
 {
-    gf_return_if_fail(!mItems.empty());
-
-    beginRemoveRows(QModelIndex(), 0, mItems.size() - 1);
-    for (auto it : mItems) {
-        delete it;
+    if (!parent.isValid()) {
+        return mCurrentPath ? mCurrentPath->uri() : QString();
     }
-    mItems.clear();
+
+    int id = int(parent.internalId());
+    gf_return_val_if_fail(parent.model() == this && mRecords->isLive(id), QString());
+
+    return (G_FILE_TYPE_DIRECTORY == mRecords->type(id)) ? mRecords->uri(id) : QString();
+}
+
+void graceful::FileModel::removeAll()
+{
+    gf_return_if_fail(!mRows.empty());
+
+    cancelThumbnails();
+
+    beginRemoveRows(QModelIndex(), 0, mRows.size() - 1);
+    mRows.clear();
+    mRowOfId.clear();
+    mRecords->clear();
+    mNameIndex->clear();
+    mDirtyRecords.clear();
+    mUnconfirmed.clear();
+    mSortedRows = 0;
     endRemoveRows();
 }
 
-void graceful::FileModel::insertFiles(int row, const QStringList &files)
+void graceful::FileModel::insertFiles(int row, const QStringList &files, const QList<FileInfoPtr>& infos)
 {
-    int filesNum = files.size();
+    bool hasInfo = (infos.size() == files.size());
+
+    // a file created while the directory is listed is reported by both, add() refuses the second
+    QVector<int> ids;
+    ids.reserve(files.size());
+    for (int i = 0; i < files.size(); ++i) {
+        const GFileInfo* info = (hasInfo && infos.at(i)) ? infos.at(i)->getGFileInfo() : nullptr;
+        int id = mRecords->add(files.at(i), info);
+        if (id >= 0) {
+            ids << id;
+            continue;
+        }
 
-    gf_return_if_fail(filesNum > 0);
+        // shown from the snapshot, the listing brings its current attributes
+        if (!mUnconfirmed.isEmpty() && (id = mRecords->find(files.at(i))) >= 0 && mUnconfirmed.remove(id)) {
+            if (info && mRecords->update(id, info)) {
+                mDirtyRecords << id;
+                scheduleMonitorFlush();
+            }
+        }
+    }
+
+    int filesNum = ids.size();
+    if (filesNum <= 0) {
+        return;
+    }
+
+    row = qBound(0, row, mRows.size());
 
     beginInsertRows(QModelIndex(), row, row + filesNum - 1);
-    for (QString f : files) {
-        log_debug("insert file:%s", f.toUtf8().constData());
-        FileModelItem* item = new FileModelItem(f);
-        mItems.append(item);
+    mRows.insert(row, filesNum, -1);
+    mRowOfId.clear();
+    for (int i = 0; i < filesNum; ++i) {
+        mRows[row + i] = ids.at(i);
+        if (!mRecords->isLoaded(ids.at(i))) {
+            loadRecordAsync(ids.at(i));
+        }
     }
     endInsertRows();
+
+    indexNames(ids);
+
+    // the rows after 'row' are not in order anymore
+    mSortedRows = qMin(mSortedRows, row);
+    scheduleSort();
 }
 
+void graceful::FileModel::indexNames(const QVector<int>& ids)
+{
+    for (int id : ids) {
+        int len = 0;
+        const char* name = mRecords->encodedName(id, &len);
+        mNameIndex->add(id, name, len);
+    }
+}
 
-graceful::FileModelItem::FileModelItem(QString uri)
+void graceful::FileModel::removeRecords(const QSet<int>& ids)
 {
-    mFile = new File(uri);
+    gf_return_if_fail(!ids.isEmpty());
+
+    // from the end, so the rows of the ranges still to remove don't move
+    int last = mRows.size() - 1;
+    while (last >= 0) {
+        if (!ids.contains(mRows.at(last))) {
+            --last;
+            continue;
+        }
+
+        int first = last;
+        while (first > 0 && ids.contains(mRows.at(first - 1))) {
+            --first;
+        }
+
+        beginRemoveRows(QModelIndex(), first, last);
+        for (int i = first; i <= last; ++i) {
+            if (!mThumbnailIds.isEmpty()) {
+                QString uri = mRecords->uri(mRows.at(i));
+                if (mThumbnailIds.remove(uri)) {
+                    ThumbnailManager::getInstance()->cancelThumbnail(uri);
+                }
+            }
+            mNameIndex->remove(mRows.at(i));
+            mRecords->remove(mRows.at(i));
+            mDirtyRecords.remove(mRows.at(i));
+            mUnconfirmed.remove(mRows.at(i));
+        }
+        mRows.remove(first, last - first + 1);
+        mRowOfId.clear();
+        endRemoveRows();
+
+        // removing keeps the order, the sorted rows are fewer
+        if (last < mSortedRows) {
+            mSortedRows -= last - first + 1;
+        } else if (first < mSortedRows) {
+            mSortedRows = first;
+        }
+
+        last = first - 1;
+    }
+}
+
+void graceful::FileModel::cancelThumbnails()
+{
+    for (auto it = mThumbnailIds.constBegin(); it != mThumbnailIds.constEnd(); ++it) {
+        ThumbnailManager::getInstance()->cancelThumbnail(it.key());
+    }
+    mThumbnailIds.clear();
+}
+
+void graceful::FileModel::onThumbnailFinished(const QString& uri, bool successed)
+{
+    auto it = mThumbnailIds.find(uri);
+    if (mThumbnailIds.end() == it) {
+        return;
+    }
+
+    int id = it.value();
+    mThumbnailIds.erase(it);
+
+    // a failed image keeps the icon of its type, it is not asked again
+    int row = successed ? rowOf(id) : -1;
+    if (row >= 0) {
+        Q_EMIT dataChanged(index(row, 0), index(row, 0), {Qt::DecorationRole});
+    }
+}
+
+int graceful::FileModel::rowOf(int id)
+{
+    // rebuilt once after the rows changed, not per lookup
+    if (mRowOfId.isEmpty()) {
+        mRowOfId.fill(-1, mRecords->idCount());
+        for (int row = 0; row < mRows.size(); ++row) {
+            mRowOfId[mRows.at(row)] = row;
+        }
+    }
+
+    return (id >= 0 && id < mRowOfId.size()) ? mRowOfId.at(id) : -1;
 }
 
-graceful::FileModelItem::FileModelItem(FileModelItem &other)
+void graceful::FileModel::loadRecordAsync(int id)
 {
-    mFile = new File(other.mFile->uri());
+    File* f = mRecords->file(id);
+    gf_return_if_fail(f);
+
+    // the connection goes with the File, which the record deletes on removal or reset
+    connect(f, &File::infoLoaded, this, [=] (File::Attributes, bool successed) {
+        if (successed) {
+            mRecords->update(id, f->getGFileStandardInfo());
+        }
+        mDirtyRecords << id;
+        scheduleMonitorFlush();
+    });
+    f->queryInfoAsync(FILE_MODEL_ATTRIBUTES);
 }
 
-QString graceful::FileModelItem::name() const
+void graceful::FileModel::startMonitor()
 {
-    return mFile->fileName();
+    gf_return_if_fail(mCurrentPath && !mMonitor);
+
+    GError* error = nullptr;
+    mMonitor = g_file_monitor_directory(const_cast<GFile*>(mCurrentPath->getGFile()), G_FILE_MONITOR_WATCH_MOVES, nullptr, &error);
+    if (error) {
+        log_debug("monitor '%s' error: %s", mCurrentPath->uri().toUtf8().constData(), error->message);
+        g_error_free(error);
+        return;
+    }
+
+    g_signal_connect(mMonitor, "changed", G_CALLBACK(monitorChangedCB), this);
+}
+
+void graceful::FileModel::stopMonitor()
+{
+    if (mMonitor) {
+        g_signal_handlers_disconnect_by_data(mMonitor, this);
+        g_file_monitor_cancel(mMonitor);
+        g_object_unref(mMonitor);
+        mMonitor = nullptr;
+    }
+
+    mMonitorTimer->stop();
+    mPendingEvents.clear();
+    mDirtyRecords.clear();
+}
+
+void graceful::FileModel::scheduleMonitorFlush()
+{
+    // not restarted by later events, a busy directory still updates every window
+    if (!mMonitorTimer->isActive()) {
+        mMonitorTimer->start();
+    }
 }
 
-QString graceful::FileModelItem::uri() const
+void graceful::FileModel::monitorChangedCB(GFileMonitor*, GFile* file, GFile* otherFile, GFileMonitorEvent event, FileModel* model)
 {
-    return mFile->uri();
+    g_autofree char* uri = file ? g_file_get_uri(file) : nullptr;
+    g_autofree char* otherUri = otherFile ? g_file_get_uri(otherFile) : nullptr;
+
+    gf_return_if_fail(uri);
+
+    switch (event) {
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+        model->mPendingEvents.insert(uri, MonitorCreated);
+        break;
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+        model->mPendingEvents.insert(uri, MonitorDeleted);
+        break;
+    case G_FILE_MONITOR_EVENT_RENAMED:
+        model->mPendingEvents.insert(uri, MonitorDeleted);
+        if (otherUri) {
+            model->mPendingEvents.insert(otherUri, MonitorCreated);
+        }
+        break;
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+        model->mPendingEvents.insert(uri, MonitorChanged);
+        break;
+    default:
+        // G_FILE_MONITOR_EVENT_CHANGED comes before CHANGES_DONE_HINT, one update is enough
+        return;
+    }
+
+    model->scheduleMonitorFlush();
 }
 
-QString graceful::FileModelItem::path() const
+void graceful::FileModel::applyMonitorEvents()
 {
-    return mFile->path();
+    QHash<QString, int> events;
+    events.swap(mPendingEvents);
+
+    QString rootUri = mCurrentPath ? mCurrentPath->uri() : QString();
+
+    QStringList created;
+    QSet<int> removed;
+    for (auto it = events.constBegin(); it != events.constEnd(); ++it) {
+        // the root itself is gone
+        if (it.key() == rootUri) {
+            if (MonitorDeleted == it.value() && !mRows.isEmpty()) {
+                removeAll();
+            }
+            continue;
+        }
+
+        int id = mRecords->find(it.key());
+        if (MonitorDeleted == it.value()) {
+            if (id >= 0) {
+                removed << id;
+            }
+        } else if (id >= 0) {
+            // replaced or modified in place
+            FileInfoCache::getInstance()->invalidate(it.key());
+            mRecords->resetFile(id);
+            loadRecordAsync(id);
+        } else {
+            created << it.key();
+        }
+    }
+
+    if (!removed.isEmpty()) {
+        removeRecords(removed);
+    }
+
+    if (!created.isEmpty()) {
+        insertFiles(mRows.size(), created);
+    }
+
+    if (!removed.isEmpty() || !created.isEmpty()) {
+        scheduleSnapshotSave();
+    }
+
+    if (mDirtyRecords.isEmpty()) {
+        return;
+    }
+
+    // one dataChanged() per contiguous range of updated rows
+    QSet<int> dirty;
+    dirty.swap(mDirtyRecords);
+
+    // what the rows are sorted by may have changed, directories go first whatever the column
+    if (mSortColumn >= 0) {
+        mSortedRows = 0;
+        scheduleSort();
+    }
+
+    int first = -1;
+    for (int row = 0; row <= mRows.size(); ++row) {
+        bool isDirty = (row < mRows.size() && dirty.contains(mRows.at(row)));
+        if (isDirty && first < 0) {
+            first = row;
+        } else if (!isDirty && first >= 0) {
+            Q_EMIT dataChanged(index(first, 0), index(row - 1, NumOfColumns - 1));
+            first = -1;
+        }
+    }
 }
 
-QIcon graceful::FileModelItem::icon() const
+void graceful::FileModel::loadSnapshot()
 {
-    return mFile->icon();
+    gf_return_if_fail(mCurrentPath && mRows.isEmpty());
+
+    const Uri& root = mCurrentPath->getUri();
+    if (!root.isLocal()) {
+        return;
+    }
+
+    QVector<int> ids;
+    if (!DirSnapshot::load(mCurrentPath->uri(), DirSnapshot::stampOf(root.path()), mRecords, ids) || ids.isEmpty()) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), 0, ids.size() - 1);
+    mRows = ids;
+    mRowOfId.clear();
+    endInsertRows();
+
+    mUnconfirmed.reserve(ids.size());
+    for (int id : ids) {
+        mUnconfirmed.insert(id);
+    }
+
+    indexNames(ids);
+
+    if (mSortColumn >= 0) {
+        sortRows();
+    }
+}
+
+void graceful::FileModel::listingFinished(bool successed)
+{
+    mListing = false;
+
+    // the snapshot listed files which are gone, or the directory can't be read anymore
+    if (!mUnconfirmed.isEmpty()) {
+        QSet<int> gone;
+        gone.swap(mUnconfirmed);
+        removeRecords(gone);
+    }
+
+    if (successed) {
+        scheduleSnapshotSave();
+    } else if (mCurrentPath && mCurrentPath->getUri().isLocal()) {
+        DirSnapshot::remove(mCurrentPath->uri());
+    }
+}
+
+void graceful::FileModel::scheduleSnapshotSave()
+{
+    if (!mSnapshotTimer->isActive()) {
+        mSnapshotTimer->start();
+    }
+}
+
+void graceful::FileModel::saveSnapshot()
+{
+    mSnapshotTimer->stop();
+
+    gf_return_if_fail(mCurrentPath && mCurrentPath->getUri().isLocal());
+
+    // the rows must be all the directory has at the time it is stamped, applying the
+    // pending events schedules the save again if they change the rows
+    if (mListing || !mPendingEvents.isEmpty()) {
+        return;
+    }
+
+    DirSnapshot::saveAsync(mCurrentPath->uri(), DirSnapshot::stampOf(mCurrentPath->getUri().path()), mRecords);
+}
+
+void graceful::FileModel::scheduleSort()
+{
+    if (mSortColumn >= 0 && mSortedRows < mRows.size() && !mSortTimer->isActive()) {
+        mSortTimer->start();
+    }
+}
+
+void graceful::FileModel::prepareNameKeys()
+{
+    QVector<int> missing;
+    for (int id : mRows) {
+        if (mRecords->nameKey(id).isEmpty()) {
+            missing << id;
+        }
+    }
+
+    if (missing.isEmpty()) {
+        return;
+    }
+
+    // the records are only read by the jobs, each job writes its own keys
+    QVector<QByteArray> keys(missing.size());
+    QByteArray* out = keys.data();
+    const int* ids = missing.constData();
+    const FileRecords* records = mRecords;
+
+    QList<std::function<void()>> jobs;
+    for (int begin = 0; begin < missing.size(); begin += FILE_MODEL_NAME_KEY_CHUNK) {
+        int end = qMin(begin + FILE_MODEL_NAME_KEY_CHUNK, missing.size());
+        jobs << [=] () {
+            for (int i = begin; i < end; ++i) {
+                QByteArray name = records->displayName(ids[i]).toUtf8();
+                g_autofree char* key = g_utf8_collate_key_for_filename(name.constData(), name.size());
+                out[i] = QByteArray(key);
+            }
+        };
+    }
+    runJobs(jobs);
+
+    for (int i = 0; i < missing.size(); ++i) {
+        mRecords->setNameKey(missing.at(i), keys.at(i));
+    }
+}
+
+void graceful::FileModel::sortRows()
+{
+    mSortTimer->stop();
+
+    if (mSortColumn < 0 || mSortedRows >= mRows.size()) {
+        mSortedRows = mRows.size();
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    prepareNameKeys();
+
+    // content types, owners and groups are compared by the rank of their atom, unknown last
+    QVector<quint64> ranks;
+    if (ColumnFileType == mSortColumn || ColumnFileOwner == mSortColumn || ColumnFileGroup == mSortColumn) {
+        QVector<int> atoms;
+        for (int a = 1; a < mRecords->atomCount(); ++a) {
+            atoms << a;
+        }
+        std::sort(atoms.begin(), atoms.end(), [&] (int a, int b) {
+            return QString::localeAwareCompare(QString::fromUtf8(mRecords->atomString(quint16(a))), QString::fromUtf8(mRecords->atomString(quint16(b)))) < 0;
+        });
+        ranks.fill(quint64(atoms.size() + 1), mRecords->atomCount());
+        for (int i = 0; i < atoms.size(); ++i) {
+            ranks[atoms.at(i)] = quint64(i + 1);
+        }
+    }
+
+    QVector<SortItem> items(mRows.size());
+    for (int row = 0; row < mRows.size(); ++row) {
+        SortItem& item = items[row];
+        item.id = mRows.at(row);
+        item.key = mRecords->nameKey(item.id).constData();
+        item.isDir = (G_FILE_TYPE_DIRECTORY == mRecords->type(item.id));
+
+        switch (mSortColumn) {
+        case ColumnFileType:
+            item.value = ranks.at(mRecords->contentType(item.id));
+            break;
+        case ColumnFileSize:
+            item.value = mRecords->size(item.id);
+            break;
+        case ColumnFileMTime:
+            item.value = mRecords->modifyTime(item.id);
+            break;
+        case ColumnFileOwner:
+            item.value = ranks.at(mRecords->owner(item.id));
+            break;
+        case ColumnFileGroup:
+            item.value = ranks.at(mRecords->group(item.id));
+            break;
+        default:
+            // the records hold no creation or deletion time, these go by name
+            break;
+        }
+    }
+
+    // directories first, then the column, then the name. Other columns keep names ascending
+    bool descending = (Qt::DescendingOrder == mSortOrder);
+    bool byName = (ColumnFileName == mSortColumn);
+    auto less = [=] (const SortItem& a, const SortItem& b) {
+        if (a.isDir != b.isDir) {
+            return a.isDir;
+        }
+        if (a.value != b.value) {
+            return descending ? (a.value > b.value) : (a.value < b.value);
+        }
+        int c = strcmp(a.key, b.key);
+        if (0 != c) {
+            return (descending && byName) ? (c > 0) : (c < 0);
+        }
+        return a.id < b.id;
+    };
+
+    // the rows before mSortedRows are in order already, only the others are sorted and merged in
+    parallelSort(items.data() + mSortedRows, items.size() - mSortedRows, less);
+    if (mSortedRows > 0) {
+        std::inplace_merge(items.begin(), items.begin() + mSortedRows, items.end(), less);
+    }
+
+    mSortedRows = mRows.size();
+
+    bool moved = false;
+    for (int row = 0; row < mRows.size() && !moved; ++row) {
+        moved = (items.at(row).id != mRows.at(row));
+    }
+
+    if (!moved) {
+        return;
+    }
+
+    Q_EMIT layoutAboutToBeChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+
+    for (int row = 0; row < mRows.size(); ++row) {
+        mRows[row] = items.at(row).id;
+    }
+    mRowOfId.clear();
+
+    // selections and the current index follow their rows
+    QModelIndexList from = persistentIndexList();
+    if (!from.isEmpty()) {
+        QModelIndexList to;
+        to.reserve(from.size());
+        for (const auto& index : from) {
+            int id = int(index.internalId());
+            int row = rowOf(id);
+            to << ((row >= 0) ? createIndex(row, index.column(), quintptr(id)) : QModelIndex());
+        }
+        changePersistentIndexList(from, to);
+    }
+
+    Q_EMIT layoutChanged(QList<QPersistentModelIndex>(), QAbstractItemModel::VerticalSortHint);
+
+    log_debug("sort %d rows by column %d: %lld ms", mRows.size(), mSortColumn, timer.elapsed());
 }
@@ -1,34 +1,32 @@
 #ifndef FILEMODEL_H
 #define FILEMODEL_H
 
+#include <QSet>
+#include <QHash>
 #include <QList>
+#include <QVector>
 #include <QString>
+#include <QPointer>
+#include <QSharedPointer>
 #include <QAbstractItemModel>
 
 #include "globals.h"
 
+#include <gio/gio.h>
+
+class QTimer;
 class QAbstractItemModelPrivate;
 
 namespace graceful
 {
 
 class File;
-class GRACEFUL_API FileModelItem
-{
-public:
-    explicit FileModelItem (QString uri);
-    FileModelItem(FileModelItem& other);
-
-    QString name() const;
-    QString uri() const;
-    QString path() const;
-
-    QIcon icon() const;
-
-private:
-    File*                   mFile;                   // use graceful::File
-};
-
+class FileInfo;
+class FileRecords;
+class FileOperation;
+class FileNameIndex;
+class FileEnumerator;
+typedef QSharedPointer<const FileInfo> FileInfoPtr;
 
 class GRACEFUL_API FileModel : public QAbstractItemModel
 {
@@ -39,7 +37,8 @@ public:
         FileInfoRole = Qt::UserRole,
         FileIsDirRole,
         FileIsCutRole,
-        FileUriRole
+        FileUriRole,
+        FileUriIdRole                   // UriId of the row, see UriAtoms, valid while the row exists
     };
 
     enum ColumnId
@@ -55,16 +54,55 @@ public:
         NumOfColumns
     };
 
+    enum FilterMode
+    {
+        FilterSubstring,                // names containing the text, case ignored, in row order
+        FilterFuzzy                     // names sharing most trigrams with the text, best first
+    };
+
     explicit FileModel(QObject* parent = nullptr);
     ~FileModel() override;
 
     // specific api
     void setRootPath(QString rootPath);
 
+    /**
+     * @brief
+     * in streaming mode (default) every enumerated batch is inserted as soon
+     * as it arrives, otherwise rows are inserted once the listing finished
+     */
+    void setStreamingMode(bool streaming);
+    bool isStreamingMode() const;
+
+    /**
+     * @brief
+     * the File of the row at 'index', created on first call and owned by the
+     * model. It is deleted when the row is removed
+     */
+    File* file(const QModelIndex& index) const;
+
+    /**
+     * @brief
+     * move the files of 'indexes' to the trash, or delete them when
+     * 'permanently'. Their rows go once the monitor sees them gone. The
+     * operation deletes itself when done
+     */
+    FileOperation* removeFiles(const QModelIndexList& indexes, bool permanently = false);
+
+    /**
+     * @brief
+     * rows whose name matches 'text', all rows for an empty one. Names are
+     * looked up in a trigram index kept in the background, see FileNameIndex
+     */
+    QVector<int> filterRows(const QString& text, FilterMode mode = FilterSubstring) const;
+
 
     // override
     /**
-     * @brief list current folder's file
+     * @brief
+     * in streaming mode a directory without snapshot is listed a page at a
+     * time, the enumerator stays open in between. Sorting and filtering see
+     * the rows fetched so far
      */
     virtual void fetchMore(const QModelIndex &parent) override;
     virtual bool canFetchMore(const QModelIndex &parent) const override;
@@ -136,13 +174,119 @@ private:
      */
     void removeAll();
 
-    void insertFiles(int row, const QStringList& files);
+    /**
+     * @brief
+     * uri of the directory a drop on 'parent' goes into, empty if it isn't one
+     */
+    QString dropTarget(const QModelIndex& parent) const;
+
+    void insertFiles(int row, const QStringList& files, const QList<FileInfoPtr>& infos = QList<FileInfoPtr>());
+
+    /**
+     * @brief
+     * hand the names of the records 'ids' to the filter index
+     */
+    void indexNames(const QVector<int>& ids);
+
+    /**
+     * @brief
+     * remove the records 'ids' with one beginRemoveRows() per contiguous range
+     */
+    void removeRecords(const QSet<int>& ids);
+
+    /**
+     * @brief
+     * row of record 'id', -1 if it has none
+     */
+    int rowOf(int id);
+
+    /**
+     * @brief
+     * load the attributes of record 'id' in the background, its row is updated when done
+     */
+    void loadRecordAsync(int id);
+
+    /**
+     * @brief
+     * drop the requests of the thumbnails not made yet, see ThumbnailManager
+     */
+    void cancelThumbnails();
+
+    void startMonitor();
+    void stopMonitor();
+    void scheduleMonitorFlush();
+
+    /**
+     * @brief
+     * show the rows of the snapshot of a local root at once, the listing then
+     * confirms, updates or removes them
+     */
+    void loadSnapshot();
+    void listingFinished(bool successed);
+    void scheduleSnapshotSave();
+
+    /**
+     * @brief
+     * build the missing collation keys of the names of the rows, in parallel
+     */
+    void prepareNameKeys();
+    void scheduleSort();
+
+    static void monitorChangedCB(GFileMonitor*, GFile* file, GFile* otherFile, GFileMonitorEvent event, FileModel* model);
+
+private Q_SLOTS:
+    /**
+     * @brief
+     * apply the coalesced directory events and info updates as targeted row changes
+     */
+    void applyMonitorEvents();
+    void saveSnapshot();
+
+    /**
+     * @brief
+     * put the rows after mSortedRows in order, as one layoutChanged()
+     */
+    void sortRows();
+
+    /**
+     * @brief
+     * repaint the icon of the row waiting for thumbnail 'uri'
+     */
+    void onThumbnailFinished(const QString& uri, bool successed);
 
 Q_SIGNALS:
 
 private:
+    enum MonitorEvent
+    {
+        MonitorCreated,
+        MonitorDeleted,
+        MonitorChanged
+    };
+
+    bool                                            mStreaming = true;
     File*                                           mCurrentPath = nullptr;
-    QList<FileModelItem*>                           mItems;
+    QPointer<FileEnumerator>                        mEnumerator;
+    FileRecords*                                    mRecords = nullptr;
+    FileNameIndex*                                  mNameIndex = nullptr;
+    QVector<int>                                    mRows;                  // row -> record id
+    QVector<int>                                    mRowOfId;               // record id -> row, empty until rowOf() after a change of mRows
+
+    GFileMonitor*                                   mMonitor = nullptr;
+    QTimer*                                         mMonitorTimer = nullptr;
+    QHash<QString, int>                             mPendingEvents;         // uri -> MonitorEvent, the last event wins
+    QSet<int>                                       mDirtyRecords;          // records waiting for dataChanged()
+
+    bool                                            mListing = false;
+    QTimer*                                         mSnapshotTimer = nullptr;
+    QSet<int>                                       mUnconfirmed;           // snapshot rows the listing didn't report yet
+
+    int                                             mSortColumn = -1;       // -1 while not sorted
+    Qt::SortOrder                                   mSortOrder = Qt::AscendingOrder;
+    int                                             mSortedRows = 0;        // rows before this one are in order
+    QTimer*                                         mSortTimer = nullptr;
+
+    mutable QHash<QString, int>                     mThumbnailIds;          // uri -> record waiting for its thumbnail, one request each
 
     Q_DISABLE_COPY(FileModel)
 };
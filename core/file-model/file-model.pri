@@ -1,7 +1,13 @@
 HEADERS += \
+    $$PWD/dir-snapshot.h                \
+    $$PWD/file-records.h                \
+    $$PWD/file-name-index.h             \
     $$PWD/file-model.h
 
 SOURCES += \
+    $$PWD/dir-snapshot.cpp              \
+    $$PWD/file-records.cpp              \
+    $$PWD/file-name-index.cpp           \
     $$PWD/file-model.cpp
 
 
@@ -0,0 +1,359 @@
+#include "file-name-index.h"
+
+#include "log/log.h"
+#include "utils/utils.h"
+
+#include <QRunnable>
+#include <QReadLocker>
+#include <QThreadPool>
+#include <QWriteLocker>
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+namespace graceful
+{
+class NameIndexWorker : public QRunnable
+{
+public:
+    explicit NameIndexWorker(FileNameIndex* index) : mIndex(index)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        mIndex->runQueue();
+    }
+
+private:
+    FileNameIndex*                      mIndex = nullptr;
+};
+}
+
+
+graceful::FileNameIndex::FileNameIndex()
+{
+
+}
+
+graceful::FileNameIndex::~FileNameIndex()
+{
+    // the worker holds a pointer to this
+    {
+        QMutexLocker locker(&mQueueLock);
+        mQueue.clear();
+    }
+
+    waitIdle();
+}
+
+void graceful::FileNameIndex::add(int id, const char* name, int len)
+{
+    gf_return_if_fail(id >= 0 && name && len > 0);
+
+    Op op;
+    op.kind = OpAdd;
+    op.id = id;
+    op.name = QByteArray(name, len);
+
+    enqueue(op);
+}
+
+void graceful::FileNameIndex::remove(int id)
+{
+    gf_return_if_fail(id >= 0);
+
+    Op op;
+    op.kind = OpRemove;
+    op.id = id;
+
+    enqueue(op);
+}
+
+void graceful::FileNameIndex::clear()
+{
+    Op op;
+    op.kind = OpClear;
+
+    {
+        // whatever is still queued would be dropped by the clear anyway
+        QMutexLocker locker(&mQueueLock);
+        mQueue.clear();
+    }
+
+    enqueue(op);
+}
+
+QVector<int> graceful::FileNameIndex::findSubstring(const QString& text) const
+{
+    QVector<int> ids;
+
+    QString folded = fold(text);
+    if (folded.isEmpty()) {
+        return ids;
+    }
+
+    waitIdle();
+
+    QReadLocker locker(&mLock);
+
+    // no trigram to look up
+    if (folded.size() < 3) {
+        for (int id = 0; id < mNames.size(); ++id) {
+            if (!mNames.at(id).isEmpty() && mNames.at(id).contains(folded)) {
+                ids << id;
+            }
+        }
+        return ids;
+    }
+
+    QVector<const QVector<int>*> lists;
+    for (quint64 gram : trigrams(folded)) {
+        auto it = mPostings.constFind(gram);
+        if (mPostings.constEnd() == it) {
+            return ids;
+        }
+        lists << &it.value();
+    }
+
+    // the rarest trigram first, the candidates only shrink from there
+    std::sort(lists.begin(), lists.end(), [] (const QVector<int>* a, const QVector<int>* b) {
+        return a->size() < b->size();
+    });
+
+    ids = *lists.first();
+    for (int i = 1; i < lists.size() && !ids.isEmpty(); ++i) {
+        const QVector<int>& list = *lists.at(i);
+        QVector<int> kept;
+        kept.reserve(ids.size());
+        for (int id : ids) {
+            if (std::binary_search(list.constBegin(), list.constEnd(), id)) {
+                kept << id;
+            }
+        }
+        ids.swap(kept);
+    }
+
+    // the name holds every trigram, maybe not in the order of the text
+    if (3 == folded.size()) {
+        return ids;
+    }
+
+    QVector<int> matched;
+    matched.reserve(ids.size());
+    for (int id : ids) {
+        if (mNames.at(id).contains(folded)) {
+            matched << id;
+        }
+    }
+
+    return matched;
+}
+
+QVector<int> graceful::FileNameIndex::findFuzzy(const QString& text) const
+{
+    QString folded = fold(text);
+    if (folded.size() < 3) {
+        return findSubstring(text);
+    }
+
+    QVector<quint64> grams = trigrams(folded);
+    int needed = qMax(1, (grams.size() + 2) / 3);
+
+    waitIdle();
+
+    QReadLocker locker(&mLock);
+
+    QVector<int> hits(mNames.size(), 0);
+    QVector<int> candidates;
+    for (quint64 gram : grams) {
+        auto it = mPostings.constFind(gram);
+        if (mPostings.constEnd() == it) {
+            continue;
+        }
+        for (int id : it.value()) {
+            if (0 == hits[id]++) {
+                candidates << id;
+            }
+        }
+    }
+
+    // a name containing the text beats any number of shared trigrams
+    QVector<int> ids;
+    for (int id : candidates) {
+        if (hits.at(id) >= needed) {
+            ids << id;
+            if (hits.at(id) == grams.size() && mNames.at(id).contains(folded)) {
+                hits[id] = grams.size() + 1;
+            }
+        }
+    }
+
+    // most trigrams shared, then the length closest to the text
+    int len = folded.size();
+    std::sort(ids.begin(), ids.end(), [&] (int a, int b) {
+        if (hits.at(a) != hits.at(b)) {
+            return hits.at(a) > hits.at(b);
+        }
+        int da = qAbs(mNames.at(a).size() - len);
+        int db = qAbs(mNames.at(b).size() - len);
+        return (da != db) ? (da < db) : (a < b);
+    });
+
+    return ids;
+}
+
+void graceful::FileNameIndex::enqueue(const Op& op)
+{
+    QMutexLocker locker(&mQueueLock);
+
+    mQueue << op;
+
+    if (!mWorking) {
+        mWorking = true;
+        QThreadPool::globalInstance()->start(new NameIndexWorker(this));
+    }
+}
+
+void graceful::FileNameIndex::runQueue()
+{
+    for (;;) {
+        QList<Op> ops;
+        {
+            QMutexLocker locker(&mQueueLock);
+            if (mQueue.isEmpty()) {
+                mWorking = false;
+                mIdleCond.wakeAll();
+                return;
+            }
+            ops.swap(mQueue);
+        }
+
+        // decoded, folded and split before the lock, lookups are not held up by it
+        for (Op& op : ops) {
+            if (OpAdd != op.kind) {
+                continue;
+            }
+
+            QVarLengthArray<char, 256> buf(op.name.size());
+            int decoded = Utils::urlDecode(op.name.constData(), op.name.size(), buf.data());
+            op.folded = fold((decoded < 0) ? QString::fromUtf8(op.name) : QString::fromUtf8(buf.constData(), decoded));
+            op.grams = trigrams(op.folded);
+            op.name.clear();
+        }
+
+        QWriteLocker locker(&mLock);
+        for (const Op& op : ops) {
+            apply(op);
+        }
+    }
+}
+
+void graceful::FileNameIndex::waitIdle() const
+{
+    QMutexLocker locker(&mQueueLock);
+
+    while (mWorking) {
+        mIdleCond.wait(&mQueueLock);
+    }
+}
+
+void graceful::FileNameIndex::apply(const Op& op)
+{
+    switch (op.kind) {
+    case OpAdd:
+        if (op.folded.isEmpty()) {
+            break;
+        }
+        if (op.id >= mNames.size()) {
+            mNames.resize(op.id + 1);
+        }
+        unindex(op.id);
+        mNames[op.id] = op.folded;
+        for (quint64 gram : op.grams) {
+            insertId(gram, op.id);
+        }
+        break;
+    case OpRemove:
+        if (op.id < mNames.size()) {
+            unindex(op.id);
+        }
+        break;
+    case OpClear:
+        mNames.clear();
+        mPostings.clear();
+        break;
+    }
+}
+
+void graceful::FileNameIndex::unindex(int id)
+{
+    if (mNames.at(id).isEmpty()) {
+        return;
+    }
+
+    for (quint64 gram : trigrams(mNames.at(id))) {
+        removeId(gram, id);
+    }
+    mNames[id].clear();
+}
+
+void graceful::FileNameIndex::insertId(quint64 gram, int id)
+{
+    QVector<int>& ids = mPostings[gram];
+
+    // new records mostly get the highest id
+    if (ids.isEmpty() || ids.last() < id) {
+        ids.append(id);
+        return;
+    }
+
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (ids.end() == it || *it != id) {
+        ids.insert(it, id);
+    }
+}
+
+void graceful::FileNameIndex::removeId(quint64 gram, int id)
+{
+    auto pit = mPostings.find(gram);
+    if (mPostings.end() == pit) {
+        return;
+    }
+
+    QVector<int>& ids = pit.value();
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (ids.end() != it && *it == id) {
+        ids.erase(it);
+    }
+
+    if (ids.isEmpty()) {
+        mPostings.erase(pit);
+    }
+}
+
+QString graceful::FileNameIndex::fold(const QString& text)
+{
+    return text.toCaseFolded();
+}
+
+QVector<quint64> graceful::FileNameIndex::trigrams(const QString& folded)
+{
+    QVector<quint64> grams;
+    if (folded.size() < 3) {
+        return grams;
+    }
+
+    // three UTF-16 units, a surrogate pair is split the same way in the names and the text
+    const ushort* c = folded.utf16();
+    grams.reserve(folded.size() - 2);
+    for (int i = 0; i + 2 < folded.size(); ++i) {
+        grams << ((quint64(c[i]) << 32) | (quint64(c[i + 1]) << 16) | quint64(c[i + 2]));
+    }
+
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+
+    return grams;
+}
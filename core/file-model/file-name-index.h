@@ -0,0 +1,103 @@
+#ifndef FILENAMEINDEX_H
+#define FILENAMEINDEX_H
+
+#include "globals.h"
+
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+#include <QString>
+#include <QByteArray>
+#include <QWaitCondition>
+#include <QReadWriteLock>
+
+namespace graceful
+{
+/**
+ * @brief
+ * Trigram index over the names of the records of FileModel, for filtering
+ * as the user types. Every case folded name is split into the runs of three
+ * characters it contains, each run keeps the sorted list of the records
+ * holding it. A text is looked up by intersecting the lists of its runs, so
+ * only a few names are compared whatever the size of the directory.
+ *
+ * add(), remove() and clear() only queue the change, names are decoded,
+ * folded and split in QThreadPool::globalInstance(). A lookup first waits
+ * for the queued changes, so it sees every record added before it.
+ */
+class FileNameIndex
+{
+public:
+    FileNameIndex();
+    ~FileNameIndex();
+
+    /**
+     * @brief
+     * index record 'id' under 'name', encoded as in a uri
+     */
+    NO_BLOCKING void add(int id, const char* name, int len);
+    NO_BLOCKING void remove(int id);
+    NO_BLOCKING void clear();
+
+    /**
+     * @brief
+     * ids of the names containing 'text', case ignored, ascending. Texts of
+     * one or two characters compare every name
+     */
+    QVector<int> findSubstring(const QString& text) const;
+
+    /**
+     * @brief
+     * ids of the names sharing at least a third of the trigrams of 'text',
+     * the ones containing it first, then the most shared, so typos and
+     * swapped words still match. Same as
+     * findSubstring() for texts shorter than three characters
+     */
+    QVector<int> findFuzzy(const QString& text) const;
+
+private:
+    friend class NameIndexWorker;
+
+    enum OpKind
+    {
+        OpAdd,
+        OpRemove,
+        OpClear
+    };
+
+    struct Op
+    {
+        int                             kind = OpAdd;
+        int                             id = -1;
+        QByteArray                      name;
+        QString                         folded;                 // set by the worker, with the trigrams
+        QVector<quint64>                grams;
+    };
+
+    void enqueue(const Op& op);
+    void runQueue();
+    void waitIdle() const;
+    void apply(const Op& op);
+    void unindex(int id);
+    void insertId(quint64 gram, int id);
+    void removeId(quint64 gram, int id);
+
+    static QString fold(const QString& text);
+    static QVector<quint64> trigrams(const QString& folded);
+
+private:
+    mutable QMutex                      mQueueLock;
+    mutable QWaitCondition              mIdleCond;
+    QList<Op>                           mQueue;
+    bool                                mWorking = false;       // a worker drains mQueue
+
+    mutable QReadWriteLock              mLock;                  // the index below
+    QVector<QString>                    mNames;                 // id -> folded name, empty if not indexed
+    QHash<quint64, QVector<int>>        mPostings;              // trigram -> ascending ids
+
+    Q_DISABLE_COPY(FileNameIndex)
+};
+}
+
+#endif // FILENAMEINDEX_H
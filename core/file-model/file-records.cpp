@@ -0,0 +1,685 @@
+#include "file-records.h"
+
+#include "log/log.h"
+#include "file/file.h"
+#include "utils/utils.h"
+
+#include <QDate>
+#include <QTime>
+#include <QLocale>
+#include <QVarLengthArray>
+
+#include <time.h>
+
+#define SLOT_EMPTY                  -1
+#define SLOT_DELETED                -2
+#define SLOTS_MIN                   64
+
+// removed names are dropped from the buffer once they are this many bytes and half of it
+#define NAMES_COMPACT_MIN           (64 * 1024)
+
+static inline uint nameHash(const char* name, int len)
+{
+    return qHashBits(name, size_t(len));
+}
+
+graceful::FileRecords::FileRecords()
+{
+    mSlots.fill(SLOT_EMPTY, SLOTS_MIN);
+
+    // atom 0 is the unknown value
+    mAtoms.append(QByteArray());
+    mAtomText.append(QStringLiteral(""));
+    mAtomDescription.append(QStringLiteral(""));
+    mAtomIcon.append(QIcon::fromTheme(QStringLiteral("unknown")));
+    mAtomImage.append(false);
+}
+
+graceful::FileRecords::~FileRecords()
+{
+    qDeleteAll(mFiles);
+
+    for (UriId uriId : mUriId) {
+        UriAtoms::release(uriId);
+    }
+}
+
+void graceful::FileRecords::setBaseUri(const QString& uri)
+{
+    gf_return_if_fail(0 == mCount);
+
+    // escaped the way GIO escapes the child uris of the listing, else none
+    // of them would start with it and all would be stored whole
+    g_autoptr(GFile) file = g_file_new_for_uri(uri.toUtf8().constData());
+    g_autofree char* canonical = g_file_get_uri(file);
+    mBaseUri = canonical;
+    if (!mBaseUri.endsWith('/')) {
+        mBaseUri.append('/');
+    }
+}
+
+void graceful::FileRecords::clear()
+{
+    qDeleteAll(mFiles);
+    mFiles.clear();
+
+    // the interned uris go with their records
+    for (UriId uriId : mUriId) {
+        UriAtoms::release(uriId);
+    }
+
+    mNameOffset.clear();
+    mNameLength.clear();
+    mSize.clear();
+    mMTime.clear();
+    mMode.clear();
+    mType.clear();
+    mFlags.clear();
+    mUriId.clear();
+    mContentType.clear();
+    mOwner.clear();
+    mGroup.clear();
+    mNameKey.clear();
+    mDisplayName.clear();
+    mSizeText.clear();
+    mMTimeText.clear();
+
+    mNames.clear();
+    mNamesGarbage = 0;
+    mFreeIds.clear();
+    mCount = 0;
+
+    mSlots.fill(SLOT_EMPTY, SLOTS_MIN);
+    mSlotsUsed = 0;
+}
+
+int graceful::FileRecords::count() const
+{
+    return mCount;
+}
+
+int graceful::FileRecords::add(const QString& uri, const GFileInfo* info)
+{
+    QByteArray encoded = uri.toUtf8();
+
+    int start = 0;
+    bool absolute = false;
+    splitUri(encoded, start, absolute);
+
+    int id = insert(encoded.constData() + start, encoded.size() - start, absolute);
+    if (id >= 0 && info) {
+        update(id, info);
+    }
+
+    return id;
+}
+
+int graceful::FileRecords::addChild(const char* name, int len, GFileType type, quint64 size, quint64 mtime, quint32 mode)
+{
+    gf_return_val_if_fail(name && !memchr(name, '/', size_t(len)), -1);
+
+    int id = insert(name, len, false);
+    if (id >= 0) {
+        mType[id] = quint8(type);
+        mSize[id] = size;
+        mMTime[id] = mtime;
+        mMode[id] = mode;
+        mFlags[id] |= FlagLoaded;
+
+        // a guess from the name, no I/O. The listing brings the real one
+        if (G_FILE_TYPE_DIRECTORY == type) {
+            mContentType[id] = contentTypeAtom("inode/directory");
+        } else {
+            g_autofree char* guessed = g_content_type_guess(mDisplayName.at(id).toUtf8().constData(), nullptr, 0, nullptr);
+            mContentType[id] = contentTypeAtom(guessed);
+        }
+        formatFields(id);
+    }
+
+    return id;
+}
+
+int graceful::FileRecords::insert(const char* key, int len, bool absolute)
+{
+    gf_return_val_if_fail(len > 0, -1);
+
+    if (findSlot(key, len, nameHash(key, len)) >= 0) {
+        return -1;
+    }
+
+    int id;
+    if (!mFreeIds.isEmpty()) {
+        id = mFreeIds.takeLast();
+    } else {
+        id = mFlags.size();
+        mNameOffset.append(0);
+        mNameLength.append(0);
+        mSize.append(0);
+        mMTime.append(0);
+        mMode.append(0);
+        mType.append(G_FILE_TYPE_UNKNOWN);
+        mFlags.append(0);
+        mUriId.append(0);
+        mContentType.append(0);
+        mOwner.append(0);
+        mGroup.append(0);
+        mNameKey.append(QByteArray());
+        mDisplayName.append(QString());
+        mSizeText.append(QString());
+        mMTimeText.append(QString());
+    }
+
+    mNameOffset[id] = quint32(mNames.size());
+    mNameLength[id] = quint32(len);
+    mSize[id] = 0;
+    mMTime[id] = 0;
+    mMode[id] = 0;
+    mType[id] = G_FILE_TYPE_UNKNOWN;
+    mFlags[id] = FlagLive | (absolute ? FlagAbsolute : 0);
+    mUriId[id] = 0;
+    mContentType[id] = 0;
+    mOwner[id] = 0;
+    mGroup[id] = 0;
+    mNameKey[id].clear();
+    mSizeText[id].clear();
+    mMTimeText[id].clear();
+    mNames.append(key, len);
+    mDisplayName[id] = decodeName(id);
+
+    ++mCount;
+    insertSlot(id);
+
+    return id;
+}
+
+void graceful::FileRecords::remove(int id)
+{
+    gf_return_if_fail(id >= 0 && id < mFlags.size() && (mFlags.at(id) & FlagLive));
+
+    const char* key = mNames.constData() + mNameOffset.at(id);
+    int len = mNameLength.at(id);
+    int slot = findSlot(key, len, nameHash(key, len));
+    if (slot >= 0) {
+        mSlots[slot] = SLOT_DELETED;
+    }
+
+    resetFile(id);
+
+    UriAtoms::release(mUriId.at(id));
+    mUriId[id] = 0;
+    mFlags[id] = 0;
+    mDisplayName[id].clear();
+    mSizeText[id].clear();
+    mMTimeText[id].clear();
+    mNameKey[id].clear();
+    mNamesGarbage += len;
+    mFreeIds.append(id);
+    --mCount;
+
+    if (mNamesGarbage >= NAMES_COMPACT_MIN && mNamesGarbage * 2 >= mNames.size()) {
+        compactNames();
+    }
+}
+
+int graceful::FileRecords::find(const QString& uri) const
+{
+    QByteArray encoded = uri.toUtf8();
+
+    int start = 0;
+    bool absolute = false;
+    splitUri(encoded, start, absolute);
+
+    const char* key = encoded.constData() + start;
+    int len = encoded.size() - start;
+
+    int slot = findSlot(key, len, nameHash(key, len));
+
+    return (slot < 0) ? -1 : mSlots.at(slot);
+}
+
+bool graceful::FileRecords::update(int id, const GFileInfo* info)
+{
+    gf_return_val_if_fail(id >= 0 && id < mFlags.size() && G_IS_FILE_INFO(info), false);
+
+    GFileInfo* fi = const_cast<GFileInfo*>(info);
+
+    quint8 type = mType.at(id);
+    quint64 size = mSize.at(id);
+    quint64 mtime = mMTime.at(id);
+    quint32 mode = mMode.at(id);
+    quint16 contentType = mContentType.at(id);
+    quint16 owner = mOwner.at(id);
+    quint16 group = mGroup.at(id);
+
+    if (g_file_info_has_attribute(fi, G_FILE_ATTRIBUTE_STANDARD_TYPE)) {
+        mType[id] = quint8(g_file_info_get_file_type(fi));
+    }
+
+    if (g_file_info_has_attribute(fi, G_FILE_ATTRIBUTE_STANDARD_SIZE)) {
+        mSize[id] = quint64(g_file_info_get_size(fi));
+    }
+
+    if (g_file_info_has_attribute(fi, G_FILE_ATTRIBUTE_TIME_MODIFIED)) {
+        mMTime[id] = g_file_info_get_attribute_uint64(fi, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    }
+
+    if (g_file_info_has_attribute(fi, G_FILE_ATTRIBUTE_UNIX_MODE)) {
+        mMode[id] = g_file_info_get_attribute_uint32(fi, G_FILE_ATTRIBUTE_UNIX_MODE);
+    }
+
+    const char* value = g_file_info_get_attribute_string(fi, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE);
+    if (!value) {
+        value = g_file_info_get_attribute_string(fi, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+    }
+    if (value) {
+        mContentType[id] = contentTypeAtom(value);
+    }
+
+    if ((value = g_file_info_get_attribute_string(fi, G_FILE_ATTRIBUTE_OWNER_USER))) {
+        mOwner[id] = atom(value);
+    }
+
+    if ((value = g_file_info_get_attribute_string(fi, G_FILE_ATTRIBUTE_OWNER_GROUP))) {
+        mGroup[id] = atom(value);
+    }
+
+    mFlags[id] |= FlagLoaded;
+
+    if (type != mType.at(id) || size != mSize.at(id) || mtime != mMTime.at(id) || mSizeText.at(id).isNull()) {
+        formatFields(id);
+    }
+
+    return type != mType.at(id) || size != mSize.at(id) || mtime != mMTime.at(id) || mode != mMode.at(id)
+            || contentType != mContentType.at(id) || owner != mOwner.at(id) || group != mGroup.at(id);
+}
+
+int graceful::FileRecords::idCount() const
+{
+    return mFlags.size();
+}
+
+bool graceful::FileRecords::isLive(int id) const
+{
+    return id >= 0 && id < mFlags.size() && (mFlags.at(id) & FlagLive);
+}
+
+const char* graceful::FileRecords::childName(int id, int* len) const
+{
+    if (!(mFlags.at(id) & FlagLive) || (mFlags.at(id) & FlagAbsolute)) {
+        return nullptr;
+    }
+
+    *len = mNameLength.at(id);
+
+    return mNames.constData() + mNameOffset.at(id);
+}
+
+bool graceful::FileRecords::isLoaded(int id) const
+{
+    return mFlags.at(id) & FlagLoaded;
+}
+
+QString graceful::FileRecords::uri(int id) const
+{
+    const char* name = mNames.constData() + mNameOffset.at(id);
+    int len = mNameLength.at(id);
+
+    if (mFlags.at(id) & FlagAbsolute) {
+        return QString::fromUtf8(name, len);
+    }
+
+    QVarLengthArray<char, 1024> buf(mBaseUri.size() + len);
+    memcpy(buf.data(), mBaseUri.constData(), size_t(mBaseUri.size()));
+    memcpy(buf.data() + mBaseUri.size(), name, size_t(len));
+
+    return QString::fromUtf8(buf.constData(), buf.size());
+}
+
+graceful::UriId graceful::FileRecords::uriId(int id)
+{
+    if (!mUriId.at(id)) {
+        mUriId[id] = UriAtoms::intern(uri(id));
+    }
+
+    return mUriId.at(id);
+}
+
+const char* graceful::FileRecords::encodedName(int id, int* len) const
+{
+    const char* name = mNames.constData() + mNameOffset.at(id);
+    *len = mNameLength.at(id);
+
+    // the last segment of an absolute uri
+    if (mFlags.at(id) & FlagAbsolute) {
+        int end = *len;
+        while (end > 1 && '/' == name[end - 1]) {
+            --end;
+        }
+        int begin = end;
+        while (begin > 0 && '/' != name[begin - 1]) {
+            --begin;
+        }
+        name += begin;
+        *len = end - begin;
+    }
+
+    return name;
+}
+
+const QString& graceful::FileRecords::displayName(int id) const
+{
+    return mDisplayName.at(id);
+}
+
+const QString& graceful::FileRecords::sizeText(int id) const
+{
+    return mSizeText.at(id);
+}
+
+const QString& graceful::FileRecords::modifyTimeText(int id) const
+{
+    return mMTimeText.at(id);
+}
+
+const QString& graceful::FileRecords::typeText(int id) const
+{
+    return mAtomDescription.at(mContentType.at(id));
+}
+
+const QString& graceful::FileRecords::ownerText(int id) const
+{
+    return mAtomText.at(mOwner.at(id));
+}
+
+const QString& graceful::FileRecords::groupText(int id) const
+{
+    return mAtomText.at(mGroup.at(id));
+}
+
+const QIcon& graceful::FileRecords::icon(int id) const
+{
+    return mAtomIcon.at(mContentType.at(id));
+}
+
+bool graceful::FileRecords::isImage(int id) const
+{
+    return mAtomImage.at(mContentType.at(id));
+}
+
+GFileType graceful::FileRecords::type(int id) const
+{
+    return GFileType(mType.at(id));
+}
+
+quint64 graceful::FileRecords::size(int id) const
+{
+    return mSize.at(id);
+}
+
+quint64 graceful::FileRecords::modifyTime(int id) const
+{
+    return mMTime.at(id);
+}
+
+quint16 graceful::FileRecords::contentType(int id) const
+{
+    return mContentType.at(id);
+}
+
+quint16 graceful::FileRecords::owner(int id) const
+{
+    return mOwner.at(id);
+}
+
+quint16 graceful::FileRecords::group(int id) const
+{
+    return mGroup.at(id);
+}
+
+int graceful::FileRecords::atomCount() const
+{
+    return mAtoms.size();
+}
+
+const QByteArray& graceful::FileRecords::atomString(quint16 atom) const
+{
+    return mAtoms.at(atom);
+}
+
+const QByteArray& graceful::FileRecords::nameKey(int id) const
+{
+    return mNameKey.at(id);
+}
+
+void graceful::FileRecords::setNameKey(int id, const QByteArray& key)
+{
+    mNameKey[id] = key;
+}
+
+quint32 graceful::FileRecords::mode(int id) const
+{
+    return mMode.at(id);
+}
+
+graceful::File* graceful::FileRecords::file(int id)
+{
+    gf_return_val_if_fail(id >= 0 && id < mFlags.size() && (mFlags.at(id) & FlagLive), nullptr);
+
+    File* f = mFiles.value(id, nullptr);
+    if (!f) {
+        // attributes already enumerated come from FileInfoCache
+        f = new File(uri(id));
+        mFiles.insert(id, f);
+    }
+
+    return f;
+}
+
+graceful::File* graceful::FileRecords::peekFile(int id) const
+{
+    return mFiles.value(id, nullptr);
+}
+
+void graceful::FileRecords::resetFile(int id)
+{
+    File* f = mFiles.take(id);
+    if (f) {
+        delete f;
+    }
+}
+
+void graceful::FileRecords::splitUri(const QByteArray& uri, int& start, bool& absolute) const
+{
+    // a direct child of the base uri is stored by its name
+    if (uri.size() > mBaseUri.size() && uri.startsWith(mBaseUri) && uri.indexOf('/', mBaseUri.size()) < 0) {
+        start = mBaseUri.size();
+        absolute = false;
+        return;
+    }
+
+    start = 0;
+    absolute = true;
+}
+
+int graceful::FileRecords::findSlot(const char* key, int len, uint hash) const
+{
+    int mask = mSlots.size() - 1;
+    for (int i = int(hash) & mask; ; i = (i + 1) & mask) {
+        int id = mSlots.at(i);
+        if (SLOT_EMPTY == id) {
+            return -1;
+        }
+
+        if (SLOT_DELETED != id && quint32(len) == mNameLength.at(id) && 0 == memcmp(mNames.constData() + mNameOffset.at(id), key, size_t(len))) {
+            return i;
+        }
+    }
+}
+
+void graceful::FileRecords::insertSlot(int id)
+{
+    // keep the load below one half, deleted slots count as they lengthen probes
+    if ((mSlotsUsed + 1) * 2 > mSlots.size()) {
+        int capacity = SLOTS_MIN;
+        while (capacity < mCount * 4) {
+            capacity <<= 1;
+        }
+
+        // 'id' is live already, so it is placed with the others
+        rehash(capacity);
+        return;
+    }
+
+    const char* key = mNames.constData() + mNameOffset.at(id);
+    int len = mNameLength.at(id);
+
+    int mask = mSlots.size() - 1;
+    int i = int(nameHash(key, len)) & mask;
+    while (SLOT_EMPTY != mSlots.at(i)) {
+        i = (i + 1) & mask;
+    }
+
+    mSlots[i] = id;
+    ++mSlotsUsed;
+}
+
+void graceful::FileRecords::rehash(int capacity)
+{
+    mSlots.fill(SLOT_EMPTY, capacity);
+    mSlotsUsed = 0;
+
+    int mask = capacity - 1;
+    for (int id = 0; id < mFlags.size(); ++id) {
+        if (!(mFlags.at(id) & FlagLive)) {
+            continue;
+        }
+
+        const char* key = mNames.constData() + mNameOffset.at(id);
+        int len = mNameLength.at(id);
+
+        int i = int(nameHash(key, len)) & mask;
+        while (SLOT_EMPTY != mSlots.at(i)) {
+            i = (i + 1) & mask;
+        }
+        mSlots[i] = id;
+        ++mSlotsUsed;
+    }
+}
+
+quint16 graceful::FileRecords::atom(const char* value)
+{
+    QByteArray key = QByteArray::fromRawData(value, int(strlen(value)));
+
+    auto it = mAtomIds.constFind(key);
+    if (it != mAtomIds.constEnd()) {
+        return it.value();
+    }
+
+    // a directory holds a few distinct types and owners, never this many
+    gf_return_val_if_fail(mAtoms.size() <= 0xffff, 0);
+
+    quint16 a = quint16(mAtoms.size());
+    mAtoms.append(QByteArray(value));
+    mAtomIds.insert(mAtoms.last(), a);
+    mAtomText.append(QString::fromUtf8(value));
+    mAtomDescription.append(QString());
+    mAtomIcon.append(QIcon());
+    mAtomImage.append(false);
+
+    return a;
+}
+
+quint16 graceful::FileRecords::contentTypeAtom(const char* contentType)
+{
+    quint16 a = atom(contentType);
+
+    // once per content type, whatever the number of files of that type
+    if (a && mAtomDescription.at(a).isNull()) {
+        g_autofree char* description = g_content_type_get_description(contentType);
+        mAtomDescription[a] = description ? QString::fromUtf8(description) : mAtomText.at(a);
+        mAtomImage[a] = mAtoms.at(a).startsWith("image/");
+
+        g_autoptr(GIcon) gicon = g_content_type_get_icon(contentType);
+        if (G_IS_THEMED_ICON(gicon)) {
+            for (const char* const* name = g_themed_icon_get_names(G_THEMED_ICON(gicon)); name && *name; ++name) {
+                mAtomIcon[a] = QIcon::fromTheme(QString::fromUtf8(*name));
+                if (!mAtomIcon.at(a).isNull()) {
+                    break;
+                }
+            }
+        }
+        if (mAtomIcon.at(a).isNull()) {
+            mAtomIcon[a] = mAtomIcon.at(0);
+        }
+    }
+
+    return a;
+}
+
+QString graceful::FileRecords::decodeName(int id) const
+{
+    int len = 0;
+    const char* name = encodedName(id, &len);
+
+    QVarLengthArray<char, 256> buf(len);
+    int decoded = Utils::urlDecode(name, len, buf.data());
+
+    return (decoded < 0) ? QString::fromUtf8(name, len) : QString::fromUtf8(buf.constData(), decoded);
+}
+
+void graceful::FileRecords::formatFields(int id)
+{
+    // a directory has no size worth showing
+    if (G_FILE_TYPE_DIRECTORY == mType.at(id)) {
+        mSizeText[id] = QStringLiteral("");
+    } else {
+        g_autofree char* size = g_format_size(mSize.at(id));
+        mSizeText[id] = QString::fromUtf8(size);
+    }
+
+    mMTimeText[id] = formatTime(mMTime.at(id));
+}
+
+QString graceful::FileRecords::formatTime(quint64 secs)
+{
+    time_t t = time_t(secs);
+    struct tm tm;
+    if (0 == secs || !localtime_r(&t, &tm)) {
+        return QStringLiteral("");
+    }
+
+    // the files of a directory share a few days, a day has 1440 minutes
+    int day = (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+    auto it = mDateTexts.constFind(day);
+    if (it == mDateTexts.constEnd()) {
+        it = mDateTexts.insert(day, QLocale::system().toString(QDate(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday), QLocale::ShortFormat));
+    }
+
+    if (mTimeTexts.isEmpty()) {
+        mTimeTexts.resize(24 * 60);
+    }
+
+    QString& time = mTimeTexts[tm.tm_hour * 60 + tm.tm_min];
+    if (time.isNull()) {
+        time = QLocale::system().toString(QTime(tm.tm_hour, tm.tm_min), QLocale::ShortFormat);
+    }
+
+    return it.value() + QLatin1Char(' ') + time;
+}
+
+void graceful::FileRecords::compactNames()
+{
+    QByteArray names;
+    names.reserve(mNames.size() - mNamesGarbage);
+
+    for (int id = 0; id < mFlags.size(); ++id) {
+        if (mFlags.at(id) & FlagLive) {
+            quint32 offset = quint32(names.size());
+            names.append(mNames.constData() + mNameOffset.at(id), mNameLength.at(id));
+            mNameOffset[id] = offset;
+        }
+    }
+
+    mNames.swap(names);
+    mNamesGarbage = 0;
+}
@@ -0,0 +1,221 @@
+#ifndef FILERECORDS_H
+#define FILERECORDS_H
+
+#include "globals.h"
+#include "uri-atoms.h"
+
+#include <QHash>
+#include <QIcon>
+#include <QVector>
+#include <QString>
+#include <QByteArray>
+
+#include <gio/gio.h>
+
+namespace graceful
+{
+class File;
+
+/**
+ * @brief
+ * Compact storage for the rows of FileModel. A record is a stable integer id,
+ * its fields live in one flat array per field and the names of all records
+ * are packed into a single buffer. A child of the base uri only keeps its
+ * last, still encoded segment. The full File of a record is created when it
+ * is asked for and is owned by the records.
+ */
+class FileRecords
+{
+public:
+    FileRecords();
+    ~FileRecords();
+
+    /**
+     * @brief
+     * uri of the listed directory, records under it store only their name.
+     * It is kept in GIO's form whatever the form of 'uri'. Must be set while
+     * there are no records
+     */
+    void setBaseUri(const QString& uri);
+
+    void clear();
+    int count() const;
+
+    /**
+     * @brief
+     * add a record for 'uri' and fill it from 'info' when given, return its
+     * id or -1 if 'uri' has a record already
+     */
+    int add(const QString& uri, const GFileInfo* info);
+
+    /**
+     * @brief
+     * add a loaded record for the child 'name' of the base uri, 'name' is
+     * encoded as in a uri. Return its id or -1 if it has a record already
+     */
+    int addChild(const char* name, int len, GFileType type, quint64 size, quint64 mtime, quint32 mode);
+    void remove(int id);
+
+    /**
+     * @brief
+     * id of the record of 'uri', -1 if there is none
+     */
+    int find(const QString& uri) const;
+
+    /**
+     * @brief
+     * copy the fields present in 'info' into record 'id', return true if one of them changed
+     */
+    bool update(int id, const GFileInfo* info);
+
+    /**
+     * @brief
+     * ids are below idCount(), the ones of removed records are not live,
+     * isLive() is false for any id out of that range
+     */
+    int idCount() const;
+    bool isLive(int id) const;
+
+    /**
+     * @brief
+     * stored name of a child of the base uri, not terminated. nullptr for other records
+     */
+    const char* childName(int id, int* len) const;
+
+    /**
+     * @brief
+     * the fields were filled at least once
+     */
+    bool isLoaded(int id) const;
+
+    QString uri(int id) const;
+
+    /**
+     * @brief
+     * uri() interned by UriAtoms on first call, held until the record is removed
+     */
+    UriId uriId(int id);
+
+    /**
+     * @brief
+     * last segment of the uri of record 'id', still encoded and not terminated
+     */
+    const char* encodedName(int id, int* len) const;
+
+    /**
+     * @brief
+     * what FileModel::data() shows, formatted once when the fields are set.
+     * Type, owner and group texts and the icon are shared per atom
+     */
+    const QString& displayName(int id) const;
+    const QString& sizeText(int id) const;
+    const QString& modifyTimeText(int id) const;
+    const QString& typeText(int id) const;
+    const QString& ownerText(int id) const;
+    const QString& groupText(int id) const;
+    const QIcon& icon(int id) const;
+
+    /**
+     * @brief
+     * whether the content type of record 'id' is an image, known per atom
+     */
+    bool isImage(int id) const;
+    GFileType type(int id) const;
+    quint64 size(int id) const;
+    quint64 modifyTime(int id) const;
+    quint32 mode(int id) const;
+
+    /**
+     * @brief
+     * content type, owner user and owner group of record 'id' as atoms of
+     * atomString(), 0 while unknown. Atoms live as long as the records
+     */
+    quint16 contentType(int id) const;
+    quint16 owner(int id) const;
+    quint16 group(int id) const;
+    int atomCount() const;
+    const QByteArray& atomString(quint16 atom) const;
+
+    /**
+     * @brief
+     * collation key of the display name, empty until set. It goes with the
+     * record, a new record under the same id starts without one
+     */
+    const QByteArray& nameKey(int id) const;
+    void setNameKey(int id, const QByteArray& key);
+
+    /**
+     * @brief
+     * the File of record 'id', created on first call. It lives until the record is removed or resetFile()
+     */
+    File* file(int id);
+    File* peekFile(int id) const;
+    void resetFile(int id);
+
+private:
+    int insert(const char* key, int len, bool absolute);
+    quint16 atom(const char* value);
+    quint16 contentTypeAtom(const char* contentType);
+    QString decodeName(int id) const;
+    void formatFields(int id);
+    QString formatTime(quint64 secs);
+    void splitUri(const QByteArray& uri, int& start, bool& absolute) const;
+    int findSlot(const char* key, int len, uint hash) const;
+    void insertSlot(int id);
+    void rehash(int capacity);
+    void compactNames();
+
+private:
+    enum Flag
+    {
+        FlagLive        = 1 << 0,
+        FlagLoaded      = 1 << 1,
+        FlagAbsolute    = 1 << 2,               // the whole uri is stored, not a child of the base uri
+    };
+
+    QByteArray                          mBaseUri;               // encoded, ends with '/'
+
+    // one entry per id
+    QVector<quint32>                    mNameOffset;            // into mNames
+    QVector<quint32>                    mNameLength;            // absolute uris may be longer than 64 KiB
+    QVector<quint64>                    mSize;
+    QVector<quint64>                    mMTime;
+    QVector<quint32>                    mMode;
+    QVector<quint8>                     mType;                  // GFileType
+    QVector<quint8>                     mFlags;
+    QVector<UriId>                      mUriId;                 // 0 until asked for
+    QVector<quint16>                    mContentType;           // atoms
+    QVector<quint16>                    mOwner;
+    QVector<quint16>                    mGroup;
+    QVector<QByteArray>                 mNameKey;               // empty until sorted by name
+    QVector<QString>                    mDisplayName;
+    QVector<QString>                    mSizeText;
+    QVector<QString>                    mMTimeText;
+
+    QByteArray                          mNames;
+    int                                 mNamesGarbage = 0;      // bytes of removed records still in mNames
+
+    QVector<int>                        mFreeIds;
+    int                                 mCount = 0;
+
+    // open addressing, name -> id, compared against mNames so no key is copied
+    QVector<int>                        mSlots;
+    int                                 mSlotsUsed = 0;         // live and deleted slots
+
+    QHash<int, File*>                   mFiles;                 // only the records asked for
+
+    QVector<QByteArray>                 mAtoms;                 // content types, users and groups seen
+    QHash<QByteArray, quint16>          mAtomIds;
+    QVector<QString>                    mAtomText;
+    QVector<QString>                    mAtomDescription;       // of content types
+    QVector<QIcon>                      mAtomIcon;
+    QVector<bool>                       mAtomImage;             // content type is image/*
+
+    QHash<int, QString>                 mDateTexts;             // yyyymmdd -> text
+    QVector<QString>                    mTimeTexts;             // minute of the day -> text
+
+    Q_DISABLE_COPY(FileRecords)
+};
+}
+
+#endif // FILERECORDS_H
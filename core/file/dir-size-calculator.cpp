@@ -0,0 +1,765 @@
+#include "dir-size-calculator.h"
+
+#include "log/log.h"
+#include "file.h"
+#include "statx-fetcher.h"
+
+#include <QSet>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QMutex>
+#include <QTimer>
+#include <QThread>
+#include <QVector>
+#include <QAtomicInt>
+#include <QMutexLocker>
+#include <QWaitCondition>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#define DIR_SIZE_PROGRESS_INTERVAL_MS       200
+#define DIR_SIZE_SHARDS                     16                  // locks of the hard link sets and of the cache
+#define DIR_SIZE_CACHE_MAX                  (256 * 1024)        // directories cached for all calculators
+#define DIR_SIZE_STATX_MASK                 (STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_BLOCKS | STATX_NLINK | STATX_INO)
+
+#define DIR_SIZE_GIO_ATTRIBUTES \
+    G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE "," G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+    G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE
+
+namespace graceful
+{
+typedef QPair<quint64, quint64> InodeKey;                       // st_dev, st_ino
+
+static inline int shardOf(const InodeKey& key)
+{
+    return int(qHash(key) % DIR_SIZE_SHARDS);
+}
+
+struct LinkedFile
+{
+    InodeKey                            inode;
+    quint64                             size = 0;
+    quint64                             allocated = 0;
+};
+
+// what a directory holds itself, its subdirectories are walked on their own
+struct DirContent
+{
+    quint64                             size = 0;               // of the files with a single link
+    quint64                             allocated = 0;
+    quint64                             files = 0;
+    QVector<LinkedFile>                 linked;                 // counted once per calculation
+    QList<QByteArray>                   subdirs;                // names
+};
+
+// the names a directory holds, valid while its mtime is. Sizes are not kept,
+// a file written in place doesn't change the mtime of its directory
+struct DirListing
+{
+    qint64                              mtimeSec = 0;
+    qint64                              mtimeNsec = 0;
+    QList<QByteArray>                   files;                  // and whatever readdir() didn't type
+    QList<QByteArray>                   subdirs;
+};
+
+class DirListingCache
+{
+public:
+    static DirListingCache* getInstance();
+
+    bool lookup(const InodeKey& key, qint64 mtimeSec, qint64 mtimeNsec, DirListing& listing);
+    void insert(const InodeKey& key, const DirListing& listing);
+    void clear();
+
+private:
+    struct Shard
+    {
+        QMutex                          lock;
+        QHash<InodeKey, DirListing>     dirs;
+    };
+
+    Shard                               mShards[DIR_SIZE_SHARDS];
+};
+
+struct SizeTask
+{
+    QByteArray                          path;                   // local directories
+    GFile*                              dir = nullptr;          // the others
+    bool                                root = false;
+};
+
+class SizeWorker : public QThread
+{
+public:
+    explicit SizeWorker(DirSizeCalculatorPrivate* d);
+
+protected:
+    void run() override;
+
+public:
+    StatxFetcher                        mFetcher;
+    DirSizeCalculatorPrivate*           d = nullptr;
+};
+
+class DirSizeCalculatorPrivate
+{
+    Q_DECLARE_PUBLIC(DirSizeCalculator)
+public:
+    explicit DirSizeCalculatorPrivate(DirSizeCalculator* q);
+    ~DirSizeCalculatorPrivate();
+
+    bool nextTask(SizeTask& task);
+    void schedule(QList<SizeTask>& tasks);
+    void taskDone();
+
+    void walkLocal(SizeWorker* self, const SizeTask& task);
+    int readLocal(SizeWorker* self, int fd, const struct stat& st, DirContent& content);
+    void walkGio(const SizeTask& task);
+    void addContent(const DirContent& content, const QByteArray& path);
+    bool markInode(const InodeKey& key);
+
+    void reportError(const QString& uri, const QString& message);
+    void workerDone();
+    void joinWorkers();
+
+public:
+    bool                                mAutoDelete = false;
+    bool                                mRunning = false;
+    bool                                mRootFailed = false;
+    int                                 mThreadCount = 0;
+
+    QString                             mUri;
+    QTimer*                             mProgressTimer = nullptr;
+    GCancellable*                       mCancellable = nullptr;
+
+    QList<SizeWorker*>                  mWorkers;
+    QAtomicInt                          mRunningWorkers;
+
+    QMutex                              mQueueLock;
+    QWaitCondition                      mQueueCond;
+    QList<SizeTask>                     mQueue;                 // newest first, the walk stays depth first
+    int                                 mOutstanding = 0;       // directories queued or being walked
+
+    struct InodeShard
+    {
+        QMutex                          lock;
+        QSet<InodeKey>                  inodes;
+    };
+    InodeShard                          mInodes[DIR_SIZE_SHARDS];   // files with several links seen so far
+
+    QAtomicInteger<quint64>             mSize;
+    QAtomicInteger<quint64>             mAllocated;
+    QAtomicInteger<quint64>             mFiles;
+    QAtomicInteger<quint64>             mDirs;
+    quint64                             mReportedFiles = 0;
+    quint64                             mReportedDirs = 0;
+    quint64                             mReportedSize = 0;
+
+    QMutex                              mErrorLock;
+    bool                                mErrorsScheduled = false;
+    QList<QPair<QString, QString>>      mPendingErrors;
+
+    DirSizeCalculator*                  q_ptr = nullptr;
+};
+
+DirListingCache* DirListingCache::getInstance()
+{
+    static DirListingCache gInstance;
+
+    return &gInstance;
+}
+
+bool DirListingCache::lookup(const InodeKey& key, qint64 mtimeSec, qint64 mtimeNsec, DirListing& listing)
+{
+    Shard& shard = mShards[shardOf(key)];
+    QMutexLocker locker(&shard.lock);
+
+    auto it = shard.dirs.constFind(key);
+    if (it == shard.dirs.constEnd() || it->mtimeSec != mtimeSec || it->mtimeNsec != mtimeNsec) {
+        return false;
+    }
+
+    listing = *it;
+
+    return true;
+}
+
+void DirListingCache::insert(const InodeKey& key, const DirListing& listing)
+{
+    Shard& shard = mShards[shardOf(key)];
+    QMutexLocker locker(&shard.lock);
+
+    // a full shard starts over, the next calculation of a huge tree reads it again
+    if (shard.dirs.size() >= DIR_SIZE_CACHE_MAX / DIR_SIZE_SHARDS) {
+        shard.dirs.clear();
+    }
+
+    shard.dirs.insert(key, listing);
+}
+
+void DirListingCache::clear()
+{
+    for (auto& shard : mShards) {
+        QMutexLocker locker(&shard.lock);
+        shard.dirs.clear();
+    }
+}
+
+SizeWorker::SizeWorker(DirSizeCalculatorPrivate* d) : QThread(), d(d)
+{
+
+}
+
+void SizeWorker::run()
+{
+    SizeTask task;
+
+    while (d->nextTask(task)) {
+        if (task.dir) {
+            d->walkGio(task);
+            g_object_unref(task.dir);
+        } else {
+            d->walkLocal(this, task);
+        }
+        d->taskDone();
+    }
+
+    d->workerDone();
+}
+
+DirSizeCalculatorPrivate::DirSizeCalculatorPrivate(DirSizeCalculator* q) : q_ptr(q)
+{
+    mThreadCount = qMax(1, QThread::idealThreadCount());
+    mCancellable = g_cancellable_new();
+}
+
+DirSizeCalculatorPrivate::~DirSizeCalculatorPrivate()
+{
+    g_cancellable_cancel(mCancellable);
+    {
+        QMutexLocker locker(&mQueueLock);
+        mQueueCond.wakeAll();
+    }
+    joinWorkers();
+
+    if (mCancellable)                   g_object_unref(mCancellable);
+}
+
+bool DirSizeCalculatorPrivate::nextTask(SizeTask& task)
+{
+    QMutexLocker locker(&mQueueLock);
+
+    while (!g_cancellable_is_cancelled(mCancellable)) {
+        if (!mQueue.isEmpty()) {
+            task = mQueue.takeLast();
+            return true;
+        }
+
+        if (0 == mOutstanding) {
+            return false;
+        }
+
+        mQueueCond.wait(&mQueueLock);
+    }
+
+    return false;
+}
+
+void DirSizeCalculatorPrivate::schedule(QList<SizeTask>& tasks)
+{
+    if (tasks.isEmpty()) {
+        return;
+    }
+
+    QMutexLocker locker(&mQueueLock);
+
+    mOutstanding += tasks.size();
+    mQueue << tasks;
+    tasks.clear();
+
+    mQueueCond.wakeAll();
+}
+
+void DirSizeCalculatorPrivate::taskDone()
+{
+    QMutexLocker locker(&mQueueLock);
+
+    if (0 == --mOutstanding) {
+        mQueueCond.wakeAll();
+    }
+}
+
+void DirSizeCalculatorPrivate::walkLocal(SizeWorker* self, const SizeTask& task)
+{
+    // the root may be a link to a directory, the links met in the tree are counted, not walked
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOCTTY | (task.root ? 0 : O_NOFOLLOW);
+    int fd = ::open(task.path.constData(), flags);
+    struct stat st;
+    int err = (fd < 0) ? errno : 0;
+    if (fd >= 0 && 0 != ::fstat(fd, &st)) {
+        err = errno;
+        ::close(fd);
+    }
+
+    if (err) {
+        if (task.root) {
+            mRootFailed = true;
+        }
+        reportError(QFile::decodeName(task.path), QString::fromUtf8(g_strerror(err)));
+        return;
+    }
+
+    DirContent content;
+    err = readLocal(self, fd, st, content);
+    if (g_cancellable_is_cancelled(mCancellable)) {
+        return;
+    }
+
+    if (err) {
+        reportError(QFile::decodeName(task.path), QString::fromUtf8(g_strerror(err)));
+    }
+
+    addContent(content, task.path);
+}
+
+int DirSizeCalculatorPrivate::readLocal(SizeWorker* self, int fd, const struct stat& st, DirContent& content)
+{
+    InodeKey key(quint64(st.st_dev), quint64(st.st_ino));
+
+    // an unchanged directory isn't read again, its files are still stat'ed
+    DIR* dir = nullptr;
+    DirListing listing;
+    int err = 0;
+    if (!DirListingCache::getInstance()->lookup(key, qint64(st.st_mtim.tv_sec), qint64(st.st_mtim.tv_nsec), listing)) {
+        dir = ::fdopendir(fd);
+        if (!dir) {
+            err = errno;
+            ::close(fd);
+            return err;
+        }
+
+        // entries reported as directories need no statx(), their own walk opens them
+        while (!g_cancellable_is_cancelled(mCancellable)) {
+            errno = 0;
+            struct dirent* e = ::readdir(dir);
+            if (!e) {
+                err = errno;
+                break;
+            }
+
+            const char* name = e->d_name;
+            if ('.' == name[0] && (!name[1] || ('.' == name[1] && !name[2]))) {
+                continue;
+            }
+
+            if (DT_DIR == e->d_type) {
+                listing.subdirs << QByteArray(name);
+            } else {
+                listing.files << QByteArray(name);
+            }
+        }
+
+        // the mtime from before the read, a directory changed meanwhile is read again next time
+        if (!err && !g_cancellable_is_cancelled(mCancellable)) {
+            listing.mtimeSec = qint64(st.st_mtim.tv_sec);
+            listing.mtimeNsec = qint64(st.st_mtim.tv_nsec);
+            DirListingCache::getInstance()->insert(key, listing);
+        }
+
+        fd = ::dirfd(dir);
+    }
+
+    const QList<QByteArray>& names = listing.files;
+    content.subdirs = listing.subdirs;
+
+    QVector<struct statx> stats;
+    QVector<int> results;
+    if (!names.isEmpty() && !g_cancellable_is_cancelled(mCancellable)) {
+        self->mFetcher.fetch(fd, names, DIR_SIZE_STATX_MASK, stats, results);
+    }
+
+    for (int i = 0; i < results.size(); ++i) {
+        // removed since it was read
+        if (0 != results.at(i)) {
+            continue;
+        }
+
+        const struct statx& s = stats.at(i);
+        if (S_ISDIR(s.stx_mode)) {
+            content.subdirs << names.at(i);
+            continue;
+        }
+
+        quint64 allocated = quint64(s.stx_blocks) * 512;
+        if (s.stx_nlink > 1) {
+            LinkedFile f;
+            f.inode = InodeKey(quint64(makedev(s.stx_dev_major, s.stx_dev_minor)), quint64(s.stx_ino));
+            f.size = s.stx_size;
+            f.allocated = allocated;
+            content.linked << f;
+        } else {
+            content.size += s.stx_size;
+            content.allocated += allocated;
+            ++content.files;
+        }
+    }
+
+    if (dir) {
+        ::closedir(dir);
+    } else {
+        ::close(fd);
+    }
+
+    return err;
+}
+
+void DirSizeCalculatorPrivate::walkGio(const SizeTask& task)
+{
+    GError* error = nullptr;
+    g_autoptr(GFileEnumerator) enumerator = g_file_enumerate_children(task.dir, DIR_SIZE_GIO_ATTRIBUTES, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, mCancellable, &error);
+    if (error) {
+        if (task.root) {
+            mRootFailed = true;
+        }
+        if (G_IO_ERROR_CANCELLED != error->code) {
+            g_autofree char* uri = g_file_get_uri(task.dir);
+            reportError(uri, error->message);
+        }
+        g_error_free(error);
+        return;
+    }
+
+    quint64 size = 0;
+    quint64 allocated = 0;
+    quint64 files = 0;
+    QList<SizeTask> subdirs;
+
+    while (GFileInfo* info = g_file_enumerator_next_file(enumerator, mCancellable, &error)) {
+        if (G_FILE_TYPE_DIRECTORY == g_file_info_get_file_type(info)) {
+            SizeTask t;
+            t.dir = g_file_enumerator_get_child(enumerator, info);
+            subdirs << t;
+        } else {
+            size += quint64(g_file_info_get_size(info));
+            allocated += g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE);
+            ++files;
+        }
+        g_object_unref(info);
+    }
+
+    if (error) {
+        if (G_IO_ERROR_CANCELLED != error->code) {
+            g_autofree char* uri = g_file_get_uri(task.dir);
+            reportError(uri, error->message);
+        }
+        g_error_free(error);
+    }
+
+    mSize.fetchAndAddRelaxed(size);
+    mAllocated.fetchAndAddRelaxed(allocated);
+    mFiles.fetchAndAddRelaxed(files);
+    mDirs.fetchAndAddRelaxed(quint64(subdirs.size()));
+
+    schedule(subdirs);
+}
+
+void DirSizeCalculatorPrivate::addContent(const DirContent& content, const QByteArray& path)
+{
+    quint64 size = content.size;
+    quint64 allocated = content.allocated;
+    quint64 files = content.files;
+
+    for (const auto& f : content.linked) {
+        if (markInode(f.inode)) {
+            size += f.size;
+            allocated += f.allocated;
+            ++files;
+        }
+    }
+
+    mSize.fetchAndAddRelaxed(size);
+    mAllocated.fetchAndAddRelaxed(allocated);
+    mFiles.fetchAndAddRelaxed(files);
+    mDirs.fetchAndAddRelaxed(quint64(content.subdirs.size()));
+
+    QByteArray prefix = path.endsWith('/') ? path : path + '/';
+
+    QList<SizeTask> subdirs;
+    for (const auto& name : content.subdirs) {
+        SizeTask t;
+        t.path = prefix + name;
+        subdirs << t;
+    }
+
+    schedule(subdirs);
+}
+
+bool DirSizeCalculatorPrivate::markInode(const InodeKey& key)
+{
+    InodeShard& shard = mInodes[shardOf(key)];
+    QMutexLocker locker(&shard.lock);
+
+    if (shard.inodes.contains(key)) {
+        return false;
+    }
+    shard.inodes << key;
+
+    return true;
+}
+
+void DirSizeCalculatorPrivate::reportError(const QString& uri, const QString& message)
+{
+    log_debug("dir size '%s' error: %s", uri.toUtf8().constData(), message.toUtf8().constData());
+
+    // many workers, one queued delivery
+    QMutexLocker locker(&mErrorLock);
+
+    mPendingErrors << qMakePair(uri, message);
+    if (!mErrorsScheduled) {
+        mErrorsScheduled = true;
+        QMetaObject::invokeMethod(q_ptr, "onErrorsReady", Qt::QueuedConnection);
+    }
+}
+
+void DirSizeCalculatorPrivate::workerDone()
+{
+    if (!mRunningWorkers.deref()) {
+        QMetaObject::invokeMethod(q_ptr, "onWalkFinished", Qt::QueuedConnection);
+    }
+}
+
+void DirSizeCalculatorPrivate::joinWorkers()
+{
+    for (auto w : mWorkers) {
+        w->wait();
+    }
+    qDeleteAll(mWorkers);
+    mWorkers.clear();
+
+    // left by a cancellation
+    for (auto t : mQueue) {
+        if (t.dir) {
+            g_object_unref(t.dir);
+        }
+    }
+    mQueue.clear();
+    mOutstanding = 0;
+}
+}
+
+
+graceful::DirSizeCalculator::DirSizeCalculator(QObject *parent) : QObject(parent), d_ptr(new DirSizeCalculatorPrivate(this))
+{
+    Q_D(DirSizeCalculator);
+
+    d->mProgressTimer = new QTimer(this);
+    d->mProgressTimer->setInterval(DIR_SIZE_PROGRESS_INTERVAL_MS);
+    connect(d->mProgressTimer, &QTimer::timeout, this, &DirSizeCalculator::onProgressTimeout);
+}
+
+graceful::DirSizeCalculator::~DirSizeCalculator()
+{
+    delete d_ptr;
+}
+
+void graceful::DirSizeCalculator::setAutoDelete(bool autoDelete)
+{
+    Q_D(DirSizeCalculator);
+
+    d->mAutoDelete = autoDelete;
+}
+
+void graceful::DirSizeCalculator::setUri(const QString& uri)
+{
+    Q_D(DirSizeCalculator);
+
+    gf_return_if_fail(!d->mRunning);
+
+    d->mUri = uri;
+}
+
+void graceful::DirSizeCalculator::setThreadCount(int count)
+{
+    Q_D(DirSizeCalculator);
+
+    d->mThreadCount = count > 0 ? count : qMax(1, QThread::idealThreadCount());
+}
+
+void graceful::DirSizeCalculator::setProgressInterval(int ms)
+{
+    Q_D(DirSizeCalculator);
+
+    gf_return_if_fail(ms > 0);
+
+    d->mProgressTimer->setInterval(ms);
+}
+
+void graceful::DirSizeCalculator::calculateAsync()
+{
+    Q_D(DirSizeCalculator);
+
+    gf_return_if_fail(!d->mRunning && !d->mUri.isEmpty());
+
+    File root(d->mUri);
+    const GFile* rootFile = root.getGFile();
+
+    gf_return_if_fail(rootFile && G_IS_FILE(rootFile));
+
+    log_debug("start dir size: '%s'", d->mUri.toUtf8().constData());
+
+    if (g_cancellable_is_cancelled(d->mCancellable)) {
+        g_object_unref(d->mCancellable);
+        d->mCancellable = g_cancellable_new();
+    }
+
+    for (auto& shard : d->mInodes) {
+        shard.inodes.clear();
+    }
+    d->mSize.store(0);
+    d->mAllocated.store(0);
+    d->mFiles.store(0);
+    d->mDirs.store(0);
+    d->mReportedSize = 0;
+    d->mReportedFiles = 0;
+    d->mReportedDirs = 0;
+    d->mRootFailed = false;
+    d->mRunning = true;
+
+    SizeTask task;
+    task.root = true;
+    if (root.getUri().isLocal()) {
+        task.path = QFile::encodeName(root.getUri().path());
+    } else {
+        task.dir = G_FILE(g_object_ref(const_cast<GFile*>(rootFile)));
+    }
+    d->mQueue << task;
+    d->mOutstanding = 1;
+
+    for (int i = 0; i < d->mThreadCount; ++i) {
+        d->mWorkers << new SizeWorker(d);
+    }
+
+    d->mRunningWorkers.store(d->mWorkers.size());
+    for (auto w : d->mWorkers) {
+        w->start();
+    }
+
+    d->mProgressTimer->start();
+}
+
+void graceful::DirSizeCalculator::cancel()
+{
+    Q_D(DirSizeCalculator);
+
+    g_cancellable_cancel(d->mCancellable);
+
+    QMutexLocker locker(&d->mQueueLock);
+    d->mQueueCond.wakeAll();
+}
+
+bool graceful::DirSizeCalculator::isRunning() const
+{
+    Q_D(const DirSizeCalculator);
+
+    return d->mRunning;
+}
+
+quint64 graceful::DirSizeCalculator::size() const
+{
+    Q_D(const DirSizeCalculator);
+
+    return d->mSize.load();
+}
+
+quint64 graceful::DirSizeCalculator::allocatedSize() const
+{
+    Q_D(const DirSizeCalculator);
+
+    return d->mAllocated.load();
+}
+
+quint64 graceful::DirSizeCalculator::fileCount() const
+{
+    Q_D(const DirSizeCalculator);
+
+    return d->mFiles.load();
+}
+
+quint64 graceful::DirSizeCalculator::directoryCount() const
+{
+    Q_D(const DirSizeCalculator);
+
+    return d->mDirs.load();
+}
+
+void graceful::DirSizeCalculator::clearCache()
+{
+    DirListingCache::getInstance()->clear();
+}
+
+void graceful::DirSizeCalculator::onProgressTimeout()
+{
+    Q_D(DirSizeCalculator);
+
+    quint64 size = d->mSize.load();
+    quint64 files = d->mFiles.load();
+    quint64 dirs = d->mDirs.load();
+
+    // nothing new, nothing to repaint
+    if (size == d->mReportedSize && files == d->mReportedFiles && dirs == d->mReportedDirs) {
+        return;
+    }
+
+    d->mReportedSize = size;
+    d->mReportedFiles = files;
+    d->mReportedDirs = dirs;
+
+    Q_EMIT progress(size, files, dirs);
+}
+
+void graceful::DirSizeCalculator::onErrorsReady()
+{
+    Q_D(DirSizeCalculator);
+
+    QList<QPair<QString, QString>> errors;
+    {
+        QMutexLocker locker(&d->mErrorLock);
+        errors.swap(d->mPendingErrors);
+        d->mErrorsScheduled = false;
+    }
+
+    for (auto e : errors) {
+        Q_EMIT errored(e.first, e.second);
+    }
+}
+
+void graceful::DirSizeCalculator::onWalkFinished()
+{
+    Q_D(DirSizeCalculator);
+
+    d->joinWorkers();
+    d->mProgressTimer->stop();
+
+    onErrorsReady();
+
+    d->mRunning = false;
+
+    if (g_cancellable_is_cancelled(d->mCancellable)) {
+        Q_EMIT cancelled();
+    } else {
+        onProgressTimeout();
+        Q_EMIT finished(!d->mRootFailed);
+    }
+
+    if (d->mAutoDelete) {
+        deleteLater();
+    }
+}
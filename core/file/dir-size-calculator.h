@@ -0,0 +1,87 @@
+#ifndef DIRSIZECALCULATOR_H
+#define DIRSIZECALCULATOR_H
+
+#include "globals.h"
+
+#include <QObject>
+
+namespace graceful
+{
+class DirSizeCalculatorPrivate;
+
+/**
+ * @brief
+ * Computes the recursive size of a directory in a bounded pool of worker
+ * threads, results are delivered in the thread which owns this object.
+ * Symbolic links are counted, never followed. A file with several hard links
+ * is counted once.
+ *
+ * Local directories are read with openat() and batched statx(). The names a
+ * local directory holds are cached by its device, inode and mtime, asking
+ * again skips the readdir() of unchanged directories. Files are stat'ed on
+ * every calculation, a file changed in place doesn't touch the mtime of its
+ * directory. Other uris are walked with GIO and not cached.
+ */
+class GRACEFUL_API DirSizeCalculator : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DirSizeCalculator(QObject *parent = nullptr);
+    ~DirSizeCalculator();
+
+    void setAutoDelete(bool autoDelete=true);
+    void setUri(const QString& uri);
+
+    /**
+     * @brief
+     * number of worker threads, default is QThread::idealThreadCount()
+     */
+    void setThreadCount(int count);
+
+    /**
+     * @brief
+     * progress() is emitted at most once per 'ms', default 200
+     */
+    void setProgressInterval(int ms);
+
+    void calculateAsync();
+    void cancel();
+
+    bool isRunning() const;
+
+    /**
+     * @brief
+     * totals so far, final once finished() is emitted. size is the sum of the
+     * file sizes, allocated the disk space they use. The directory itself is
+     * not counted
+     */
+    quint64 size() const;
+    quint64 allocatedSize() const;
+    quint64 fileCount() const;
+    quint64 directoryCount() const;
+
+    /**
+     * @brief
+     * forget the cached directory listings of every calculator
+     */
+    static void clearCache();
+
+Q_SIGNALS:
+    void progress(quint64 size, quint64 files, quint64 directories);
+    void errored(const QString& uri, const QString& message);
+    void finished(bool successed=false);
+    void cancelled();
+
+private Q_SLOTS:
+    void onProgressTimeout();
+    void onErrorsReady();
+    void onWalkFinished();
+
+private:
+    DirSizeCalculatorPrivate*           d_ptr = nullptr;
+    Q_DISABLE_COPY(DirSizeCalculator)
+    Q_DECLARE_PRIVATE(DirSizeCalculator)
+};
+}
+
+#endif // DIRSIZECALCULATOR_H
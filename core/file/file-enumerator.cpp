@@ -1,9 +1,14 @@
 #include "file-enumerator.h"
 #include "file.h"
 #include "log/log.h"
+#include "file-info-cache.h"
+#include "local-dir-reader.h"
+#include <QElapsedTimer>
 #include <private/qobject_p.h>
 
-#define ENUMERATOR_FILE_NUM 100
+#define ENUMERATOR_FILE_NUM_MIN             32                  // small first batch, the view shows something at once
+#define ENUMERATOR_FILE_NUM_MAX             4096
+#define ENUMERATOR_BATCH_COST_MS            40                  // grow while a batch costs less, shrink when it costs twice as much
 
 namespace graceful
 {
@@ -18,10 +23,21 @@ public:
     void cancel();
     void enumerateASync();
 
+    void nextFiles(GFileEnumerator* enumerator);
+    void nextLocalFiles();
+    bool deliverFiles(const QStringList& uris, const QList<GFileInfo*>& infos);
+    int requestSize();
+    void continueWith(GFileEnumerator* enumerator);
+    void adaptBatchSize(int fileNum, qint64 costMs);
+
+    bool finishPending();
+
     static GAsyncReadyCallback enumerateAsyncCB(GFile*, GAsyncResult*, FileEnumeratorPrivate*);
     static GAsyncReadyCallback mountMountableCB(GFile*, GAsyncResult*, FileEnumeratorPrivate*);
     static GAsyncReadyCallback mountEnclosingVolumeCB(GFile*, GAsyncResult*, FileEnumeratorPrivate*);
     static GAsyncReadyCallback enumeratorNextFilesAsyncReadyCB(GFileEnumerator*, GAsyncResult*, FileEnumeratorPrivate*);
+    static GAsyncReadyCallback localNextFilesAsyncReadyCB(GObject*, GAsyncResult*, FileEnumeratorPrivate*);
+    static void localNextFilesThread(GTask*, gpointer, gpointer, GCancellable*);
 
 public Q_SLOTS:
     bool onError(const GError* error);
@@ -30,13 +46,35 @@ private:
     bool                        mTryAgain = false;
     bool                        mAutoDelete = false;
     bool                        mFinished = false;
+    bool                        mOrphaned = false;                  // FileEnumerator is gone, free this in the pending callback
+    int                         mPendingOps = 0;
+    File::Attributes            mAttributes = File::AttributeStandard;
+    int                         mBatchSize = ENUMERATOR_FILE_NUM_MIN;
+    int                         mMinBatchSize = ENUMERATOR_FILE_NUM_MIN;
+    int                         mMaxBatchSize = ENUMERATOR_FILE_NUM_MAX;
+    int                         mRequested = 0;                     // children asked for by the pending batch
+    int                         mPageSize = 0;
+    int                         mPageDelivered = 0;
+    bool                        mPaused = false;
+    GFileEnumerator*            mPausedEnumerator = nullptr;        // nullptr while paused on the local reader
+    QElapsedTimer               mBatchTimer;
     QString                     mRootFile = nullptr;
     File*                       mFile = nullptr;
     GCancellable*               mCancellable = nullptr;
     QStringList*                mChildrenList = nullptr;
+    QList<FileInfoPtr>*         mChildrenInfos = nullptr;
+    QSharedPointer<LocalDirReader>  mLocalReader;                   // file:// uris skip GFileEnumerator
     FileEnumerator*             q_ptr = nullptr;
 };
 
+struct LocalNextFilesData
+{
+    QSharedPointer<LocalDirReader>  reader;
+    int                         num = 0;
+    QStringList                 uris;
+    QList<GFileInfo*>           infos;
+};
+
 FileEnumerator::FileEnumerator(QObject *parent) : QObject(parent), d_ptr(new FileEnumeratorPrivate(this))
 {
     Q_D(FileEnumerator);
@@ -53,7 +91,15 @@ FileEnumerator::FileEnumerator(QObject *parent) : QObject(parent), d_ptr(new Fil
 
 FileEnumerator::~FileEnumerator()
 {
+    Q_D(FileEnumerator);
+
+    if (d->mPendingOps > 0) {
+        d->mOrphaned = true;
+        g_cancellable_cancel(d->mCancellable);
+        return;
+    }
 
+    delete d;
 }
 
 void FileEnumerator::setAutoDelete(bool autoDelete)
@@ -69,6 +115,72 @@ void FileEnumerator::setEnumerateDirectory(QString uri)
     d->init(uri);
 }
 
+void FileEnumerator::setQueryAttributes(File::Attributes attrs)
+{
+    Q_D(FileEnumerator);
+
+    d->mAttributes = attrs;
+}
+
+File::Attributes FileEnumerator::queryAttributes() const
+{
+    Q_D(const FileEnumerator);
+
+    return d->mAttributes;
+}
+
+void FileEnumerator::setBatchSize(int min, int max)
+{
+    Q_D(FileEnumerator);
+
+    gf_return_if_fail(min > 0 && max >= min);
+
+    d->mMinBatchSize = min;
+    d->mMaxBatchSize = max;
+    d->mBatchSize = min;
+}
+
+void FileEnumerator::setPageSize(int rows)
+{
+    Q_D(FileEnumerator);
+
+    d->mPageSize = qMax(rows, 0);
+}
+
+bool FileEnumerator::canFetchMore() const
+{
+    Q_D(const FileEnumerator);
+
+    return d->mPaused;
+}
+
+void FileEnumerator::fetchMore()
+{
+    Q_D(FileEnumerator);
+
+    gf_return_if_fail(d->mPaused);
+
+    log_debug("fetch more of '%s'", d->mRootFile.toUtf8().constData());
+
+    d->mPaused = false;
+    d->mPageDelivered = 0;
+
+    GFileEnumerator* enumerator = d->mPausedEnumerator;
+    d->mPausedEnumerator = nullptr;
+    if (enumerator) {
+        d->nextFiles(enumerator);
+    } else {
+        d->nextLocalFiles();
+    }
+}
+
+int FileEnumerator::batchSize() const
+{
+    Q_D(const FileEnumerator);
+
+    return d->mBatchSize;
+}
+
 void FileEnumerator::enumerateAsync()
 {
     Q_D(FileEnumerator);
@@ -79,7 +191,22 @@ void FileEnumerator::enumerateAsync()
 
     log_debug("start enumerate path: '%s'", d->mRootFile.toUtf8().constData());
 
-    g_file_enumerate_children_async(const_cast<GFile*>(file), G_FILE_ATTRIBUTE_STANDARD_NAME, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, G_PRIORITY_DEFAULT, d->mCancellable, GAsyncReadyCallback(d->enumerateAsyncCB), d);
+    // the child uri is built from standard::name
+    QString attrs = File::attributesToString(d->mAttributes);
+    if (!(d->mAttributes & File::AttributeStandard)) {
+        attrs = attrs.isEmpty() ? G_FILE_ATTRIBUTE_STANDARD_NAME : QString(G_FILE_ATTRIBUTE_STANDARD_NAME ",") + attrs;
+    }
+
+    g_autofree char* path = g_file_has_uri_scheme(const_cast<GFile*>(file), "file") ? g_file_get_path(const_cast<GFile*>(file)) : nullptr;
+    if (path && LocalDirReader::isSupported(d->mAttributes)) {
+        d->mLocalReader.reset(new LocalDirReader(path, d->mAttributes));
+        d->mBatchSize = d->mMinBatchSize;
+        d->nextLocalFiles();
+        return;
+    }
+
+    ++d->mPendingOps;
+    g_file_enumerate_children_async(const_cast<GFile*>(file), attrs.toUtf8().constData(), G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, G_PRIORITY_DEFAULT, d->mCancellable, GAsyncReadyCallback(d->enumerateAsyncCB), d);
 }
 
 const QStringList FileEnumerator::getChildrenUris()
@@ -93,6 +220,17 @@ const QStringList FileEnumerator::getChildrenUris()
     return QStringList();
 }
 
+const QList<FileInfoPtr> FileEnumerator::getChildrenInfos()
+{
+    Q_D(FileEnumerator);
+
+    if (d->mFinished) {
+        return *(d->mChildrenInfos);
+    }
+
+    return QList<FileInfoPtr>();
+}
+
 void FileEnumeratorPrivate::init(QString uri)
 {
     if (mCancellable) {
@@ -109,6 +247,120 @@ void FileEnumeratorPrivate::init(QString uri)
     }
 
     mChildrenList->clear();
+    mChildrenInfos->clear();
+    mBatchSize = mMinBatchSize;
+    mLocalReader.reset();
+    mPaused = false;
+    mPageDelivered = 0;
+    if (mPausedEnumerator) {
+        g_object_unref(mPausedEnumerator);
+        mPausedEnumerator = nullptr;
+    }
+}
+
+void FileEnumeratorPrivate::nextFiles(GFileEnumerator* enumerator)
+{
+    mBatchTimer.start();
+    ++mPendingOps;
+    g_file_enumerator_next_files_async(enumerator, requestSize(), G_PRIORITY_DEFAULT, mCancellable, GAsyncReadyCallback(enumeratorNextFilesAsyncReadyCB), this);
+}
+
+void FileEnumeratorPrivate::nextLocalFiles()
+{
+    LocalNextFilesData* data = new LocalNextFilesData;
+    data->reader = mLocalReader;
+    data->num = requestSize();
+
+    mBatchTimer.start();
+    ++mPendingOps;
+
+    GTask* task = g_task_new(nullptr, mCancellable, GAsyncReadyCallback(localNextFilesAsyncReadyCB), this);
+    g_task_set_task_data(task, data, nullptr);
+    g_task_run_in_thread(task, localNextFilesThread);
+    g_object_unref(task);
+}
+
+bool FileEnumeratorPrivate::deliverFiles(const QStringList& uris, const QList<GFileInfo*>& infos)
+{
+    Q_Q(FileEnumerator);
+
+    QList<FileInfoPtr> infoList;
+    FileInfoCache* cache = FileInfoCache::getInstance();
+    for (int i = 0; i < infos.size(); ++i) {
+        FileInfoPtr rec = cache->insert(uris.at(i), infos.at(i), mAttributes);
+        if (!rec) {
+            rec = FileInfoPtr(new FileInfo(uris.at(i), G_FILE_INFO(g_object_ref(infos.at(i))), mAttributes));
+        }
+        infoList << rec;
+        g_object_unref(infos.at(i));
+    }
+
+    *mChildrenList << uris;
+    *mChildrenInfos << infoList;
+    Q_EMIT q->childrenUpdate(uris);
+    Q_EMIT q->childrenInfoUpdate(uris, infoList);
+
+    // the cost includes the receivers, e.g. streaming rows into a model
+    bool fullBatch = (infos.size() >= mRequested);
+    if (mRequested == mBatchSize) {
+        adaptBatchSize(infos.size(), mBatchTimer.elapsed());
+    }
+    mPageDelivered += infos.size();
+
+    return fullBatch;
+}
+
+int FileEnumeratorPrivate::requestSize()
+{
+    // a batch never runs past the end of the page
+    mRequested = (mPageSize > 0) ? qBound(1, mPageSize - mPageDelivered, mBatchSize) : mBatchSize;
+
+    return mRequested;
+}
+
+void FileEnumeratorPrivate::continueWith(GFileEnumerator* enumerator)
+{
+    // the page is full, the directory stays open until fetchMore()
+    if (mPageSize > 0 && mPageDelivered >= mPageSize) {
+        log_debug("enumerate '%s' paused after a page", mRootFile.toUtf8().constData());
+        mPaused = true;
+        mPausedEnumerator = enumerator;
+        return;
+    }
+
+    if (enumerator) {
+        nextFiles(enumerator);
+    } else {
+        nextLocalFiles();
+    }
+}
+
+void FileEnumeratorPrivate::adaptBatchSize(int fileNum, qint64 costMs)
+{
+    // the batch was cut by the end of directory, it says nothing
+    if (fileNum < mBatchSize) {
+        return;
+    }
+
+    if (costMs < ENUMERATOR_BATCH_COST_MS) {
+        mBatchSize = qMin(mBatchSize * 2, mMaxBatchSize);
+    } else if (costMs > 2 * ENUMERATOR_BATCH_COST_MS) {
+        mBatchSize = qMax(mBatchSize / 2, mMinBatchSize);
+    }
+
+    log_debug("enumerate batch: %d files, %lld ms, next batch size: %d", fileNum, costMs, mBatchSize);
+}
+
+bool FileEnumeratorPrivate::finishPending()
+{
+    --mPendingOps;
+
+    if (mOrphaned && mPendingOps <= 0) {
+        delete this;
+        return false;
+    }
+
+    return !mOrphaned;
 }
 
 FileEnumeratorPrivate::FileEnumeratorPrivate(FileEnumerator* f) : QObjectPrivate(), q_ptr(f)
@@ -117,19 +369,18 @@ FileEnumeratorPrivate::FileEnumeratorPrivate(FileEnumerator* f) : QObjectPrivate
     mFile = new File(mRootFile);
     mCancellable = g_cancellable_new();
     mChildrenList = new QStringList;
+    mChildrenInfos = new QList<FileInfoPtr>;
 }
 
 FileEnumeratorPrivate::~FileEnumeratorPrivate()
 {
-    Q_Q(FileEnumerator);
-
     if (nullptr != mCancellable)    g_cancellable_cancel(mCancellable);
 
-    q->disconnect();
-
     if (nullptr != mFile)           mFile->deleteLater();
     if (nullptr != mCancellable)    g_object_unref(mCancellable);
     if (nullptr != mChildrenList)   delete mChildrenList;
+    if (nullptr != mChildrenInfos)  delete mChildrenInfos;
+    if (nullptr != mPausedEnumerator) g_object_unref(mPausedEnumerator);
 }
 
 GAsyncReadyCallback FileEnumeratorPrivate::enumerateAsyncCB(GFile* file, GAsyncResult* res, FileEnumeratorPrivate* fileEnum)
@@ -139,6 +390,12 @@ GAsyncReadyCallback FileEnumeratorPrivate::enumerateAsyncCB(GFile* file, GAsyncR
 
     gf_return_val_if_fail(fileEnum, nullptr);
 
+    if (!fileEnum->finishPending()) {
+        if (error)                  g_error_free(error);
+        if (enumerator)             g_object_unref(enumerator);
+        return nullptr;
+    }
+
     if (error && G_IO_ERROR_CANCELLED == error->code) {
         g_error_free(error);
         Q_EMIT fileEnum->q_func()->cancelled();
@@ -150,6 +407,8 @@ GAsyncReadyCallback FileEnumeratorPrivate::enumerateAsyncCB(GFile* file, GAsyncR
         g_autofree gchar* uri = g_file_get_uri(file);
         log_error("enumerator error: %s, uri:'%s'", error->message, uri);
         g_error_free(error);
+        // the listing is over, receivers waiting for the end must see it
+        Q_EMIT fileEnum->q_func()->enumerateFinished(false);
         return nullptr;
     }
 
@@ -159,7 +418,8 @@ GAsyncReadyCallback FileEnumeratorPrivate::enumerateAsyncCB(GFile* file, GAsyncR
         return nullptr;
     }
 
-    g_file_enumerator_next_files_async(enumerator, ENUMERATOR_FILE_NUM, G_PRIORITY_DEFAULT, fileEnum->mCancellable, GAsyncReadyCallback(enumeratorNextFilesAsyncReadyCB), fileEnum);
+    fileEnum->mBatchSize = fileEnum->mMinBatchSize;
+    fileEnum->nextFiles(enumerator);
 
     return nullptr;
 }
@@ -170,7 +430,16 @@ GAsyncReadyCallback FileEnumeratorPrivate::enumeratorNextFilesAsyncReadyCB(GFile
 
     GError* error = nullptr;
     GList* files = g_file_enumerator_next_files_finish(enumerator, res, &error);
+
+    if (!fileEnum->finishPending()) {
+        if (error)                  g_error_free(error);
+        g_list_free_full(files, g_object_unref);
+        g_object_unref(enumerator);
+        return nullptr;
+    }
+
     if (error) {
+        g_object_unref(enumerator);
         if (G_IO_ERROR_CANCELLED == error->code) {
             g_error_free(error);
             fileEnum->q_func()->cancelled();
@@ -185,35 +454,103 @@ GAsyncReadyCallback FileEnumeratorPrivate::enumeratorNextFilesAsyncReadyCB(GFile
 
     // has no file
     if (!files) {
+        g_object_unref(enumerator);
         fileEnum->q_func()->enumerateFinished(true);
         return nullptr;
     }
 
-    GList* l = files;
     QStringList uriList;
-    int fileNum = 0;
-    while (l) {
+    QList<GFileInfo*> infoList;
+    for (GList* l = files; l; l = l->next) {
         GFileInfo* info = static_cast<GFileInfo*>(l->data);
         g_autoptr(GFile) file = g_file_enumerator_get_child(enumerator, info);
         g_autofree char* uri = g_file_get_uri(file);
         uriList << uri;
-        ++fileNum;
-        l = l->next;
+        infoList << info;
     }
-    g_list_free_full(files, g_object_unref);
-
-    *fileEnum->mChildrenList << uriList;
-    Q_EMIT fileEnum->q_func()->childrenUpdate(uriList);
+    // the references move to deliverFiles()
+    g_list_free(files);
 
-    if (ENUMERATOR_FILE_NUM == fileNum) {
-        g_file_enumerator_next_files_async(enumerator, ENUMERATOR_FILE_NUM, G_PRIORITY_DEFAULT, fileEnum->mCancellable, GAsyncReadyCallback(enumeratorNextFilesAsyncReadyCB), fileEnum);
+    if (fileEnum->deliverFiles(uriList, infoList)) {
+        fileEnum->continueWith(enumerator);
     } else {
+        g_object_unref(enumerator);
         fileEnum->q_func()->enumerateFinished(true);
     }
 
     return nullptr;
 }
 
+void FileEnumeratorPrivate::localNextFilesThread(GTask* task, gpointer, gpointer udata, GCancellable* cancellable)
+{
+    LocalNextFilesData* data = static_cast<LocalNextFilesData*>(udata);
+
+    GError* error = nullptr;
+    if (!data->reader->isOpened() && !data->reader->open(&error)) {
+        g_task_return_error(task, error);
+        return;
+    }
+
+    if (!data->reader->nextFiles(data->num, data->uris, data->infos, cancellable, &error)) {
+        g_task_return_error(task, error);
+        return;
+    }
+
+    g_task_return_boolean(task, TRUE);
+}
+
+GAsyncReadyCallback FileEnumeratorPrivate::localNextFilesAsyncReadyCB(GObject*, GAsyncResult* res, FileEnumeratorPrivate* fileEnum)
+{
+    gf_return_val_if_fail(fileEnum, nullptr);
+
+    GError* error = nullptr;
+    LocalNextFilesData* data = static_cast<LocalNextFilesData*>(g_task_get_task_data(G_TASK(res)));
+    g_task_propagate_boolean(G_TASK(res), &error);
+
+    QStringList uriList = data->uris;
+    QList<GFileInfo*> infoList = data->infos;
+    bool opened = data->reader->isOpened();
+    delete data;
+
+    if (!fileEnum->finishPending()) {
+        if (error)                  g_error_free(error);
+        for (auto info : infoList)  g_object_unref(info);
+        return nullptr;
+    }
+
+    if (error) {
+        for (auto info : infoList)  g_object_unref(info);
+        if (G_IO_ERROR_CANCELLED == error->code) {
+            g_error_free(error);
+            Q_EMIT fileEnum->q_func()->cancelled();
+            return nullptr;
+        }
+
+        // same reporting as the GIO path, see enumerateAsyncCB()
+        log_error("enumerator error: %s, uri:'%s'", error->message, fileEnum->mRootFile.toUtf8().constData());
+        if (!opened) {
+            fileEnum->onError(error);
+        } else {
+            Q_EMIT fileEnum->q_func()->errored(error, fileEnum->mFile->path(), true);
+        }
+        Q_EMIT fileEnum->q_func()->enumerateFinished(false);
+        return nullptr;
+    }
+
+    if (uriList.isEmpty()) {
+        Q_EMIT fileEnum->q_func()->enumerateFinished(true);
+        return nullptr;
+    }
+
+    if (fileEnum->deliverFiles(uriList, infoList)) {
+        fileEnum->continueWith(nullptr);
+    } else {
+        Q_EMIT fileEnum->q_func()->enumerateFinished(true);
+    }
+
+    return nullptr;
+}
+
 bool FileEnumeratorPrivate::onError(const GError *error)
 {
     Q_Q(FileEnumerator);
@@ -2,6 +2,7 @@
 #define FILEENUMERATOR_H
 
 #include "globals.h"
+#include "file.h"
 #include <QObject>
 
 #include <gio/gio.h>
@@ -19,12 +20,57 @@ public:
     void setAutoDelete(bool autoDelete=true);
     void setEnumerateDirectory(QString uri);
 
+    /**
+     * @brief
+     * attribute groups queried for every child in the same readdir pass,
+     * default is File::AttributeStandard. Must be set before enumerateAsync()
+     */
+    void setQueryAttributes(File::Attributes attrs);
+    File::Attributes queryAttributes() const;
+
+    /**
+     * @brief
+     * children are read in batches which start at 'min' entries and grow up
+     * to 'max' while a batch, including its receivers, stays cheap.
+     * min == max gives a fixed batch size
+     */
+    void setBatchSize(int min, int max);
+    int batchSize() const;
+
+    /**
+     * @brief
+     * with 'rows' > 0 the enumeration pauses, its directory still open, once
+     * that many children were delivered, fetchMore() reads the next page.
+     * 0 (default) reads to the end. Must be set before enumerateAsync()
+     */
+    void setPageSize(int rows);
+
+    /**
+     * @brief
+     * paused at the end of a page, no I/O
+     */
+    bool canFetchMore() const;
+    void fetchMore();
+
     void enumerateAsync();
     const QStringList getChildrenUris();
+    const QList<FileInfoPtr> getChildrenInfos();
 
 Q_SIGNALS:
     void errored(const GError* err=nullptr, const QString& targetUri=nullptr, bool critical=false);
     void childrenUpdate(const QStringList& uriList);
+
+    /**
+     * @brief
+     * same batch as childrenUpdate(), infos[i] holds the queried attributes of uriList[i].
+     * The infos are in FileInfoCache too, so a File built for one of them does no I/O
+     */
+    void childrenInfoUpdate(const QStringList& uriList, const QList<FileInfoPtr>& infos);
+
+    /**
+     * @brief
+     * the end of every enumeration not cancelled, false also after a critical errored()
+     */
     void enumerateFinished(bool successed=false);
     void cancelled();
 
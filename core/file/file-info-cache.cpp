@@ -0,0 +1,414 @@
+#include "file-info-cache.h"
+
+#include "log/log.h"
+#include "utils/utils.h"
+
+#include <QSet>
+#include <QHash>
+#include <QCache>
+#include <QMutex>
+#include <QMutexLocker>
+
+#define FILE_INFO_CACHE_MAX_COST            (16 * 1024 * 1024)
+#define FILE_INFO_CACHE_MAX_MONITORS        64
+#define FILE_INFO_CACHE_MAX_UNWATCHABLE     256
+#define FILE_INFO_ATTRIBUTE_COST            48
+
+namespace graceful
+{
+class FileInfoCachePrivate
+{
+    Q_DECLARE_PUBLIC(FileInfoCache)
+public:
+    explicit FileInfoCachePrivate(FileInfoCache* q);
+    ~FileInfoCachePrivate();
+
+    bool isWatched(const QString& dirUri) const;
+    bool isUnwatchable(const QString& dirUri) const;
+    QStringList removeEntriesOf(const QString& dirUri);
+
+    static QString parentUri(const QString& uri);
+    static gboolean watchDirectoryCB(gpointer udata);
+    static void monitorChangedCB(GFileMonitor*, GFile* file, GFile* otherFile, GFileMonitorEvent event, FileInfoCachePrivate* d);
+
+public:
+    mutable QMutex                          mLock;
+
+    QCache<QString, FileInfoPtr>            mCache;
+
+    QHash<QString, GFileMonitor*>           mMonitors;                      // parent uri -> monitor
+    QStringList                             mMonitorOrder;
+    QSet<QString>                           mUnwatchable;                   // directories which can't be monitored, e.g. some remote schemes
+    QSet<QString>                           mWatchPending;                  // directories whose monitor is scheduled
+
+    quint64                                 mHits = 0;
+    quint64                                 mMisses = 0;
+
+    FileInfoCache*                          q_ptr = nullptr;
+};
+
+struct WatchDirectoryData
+{
+    FileInfoCachePrivate*                   d = nullptr;
+    QString                                 dirUri;
+};
+
+FileInfoCachePrivate::FileInfoCachePrivate(FileInfoCache* q) : q_ptr(q)
+{
+    mCache.setMaxCost(FILE_INFO_CACHE_MAX_COST);
+}
+
+FileInfoCachePrivate::~FileInfoCachePrivate()
+{
+    for (auto monitor : mMonitors) {
+        g_file_monitor_cancel(monitor);
+        g_object_unref(monitor);
+    }
+    mMonitors.clear();
+}
+
+bool FileInfoCachePrivate::isWatched(const QString& dirUri) const
+{
+    return mMonitors.contains(dirUri);
+}
+
+bool FileInfoCachePrivate::isUnwatchable(const QString& dirUri) const
+{
+    return mUnwatchable.contains(dirUri);
+}
+
+QStringList FileInfoCachePrivate::removeEntriesOf(const QString& dirUri)
+{
+    QStringList removed;
+
+    for (auto uri : mCache.keys()) {
+        if (parentUri(uri) == dirUri) {
+            mCache.remove(uri);
+            removed << uri;
+        }
+    }
+
+    return removed;
+}
+
+QString FileInfoCachePrivate::parentUri(const QString& uri)
+{
+    int idx = uri.lastIndexOf('/');
+    gf_return_val_if_fail(idx > 0, uri);
+
+    // keep the last '/' of "file:///"
+    return uri.left('/' == uri.at(idx - 1) ? idx + 1 : idx);
+}
+
+gboolean FileInfoCachePrivate::watchDirectoryCB(gpointer udata)
+{
+    WatchDirectoryData* data = static_cast<WatchDirectoryData*>(udata);
+    FileInfoCachePrivate* d = data->d;
+    QString dirUri = data->dirUri;
+    delete data;
+
+    {
+        QMutexLocker locker(&d->mLock);
+        d->mWatchPending.remove(dirUri);
+        if (d->isWatched(dirUri) || d->isUnwatchable(dirUri)) {
+            return G_SOURCE_REMOVE;
+        }
+    }
+
+    // not under mLock, for gvfs uris this is a D-Bus round trip and the
+    // enumerator threads keep using the cache meanwhile
+    GError* error = nullptr;
+    g_autoptr(GFile) dir = g_file_new_for_uri(dirUri.toUtf8().constData());
+    GFileMonitor* monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_WATCH_MOVES, nullptr, &error);
+
+    QStringList dropped;
+    {
+        QMutexLocker locker(&d->mLock);
+        if (error) {
+            log_debug("monitor directory '%s' error: %s", dirUri.toUtf8().constData(), error->message);
+            g_error_free(error);
+            if (d->mUnwatchable.size() >= FILE_INFO_CACHE_MAX_UNWATCHABLE) {
+                d->mUnwatchable.clear();
+            }
+            d->mUnwatchable << dirUri;
+            return G_SOURCE_REMOVE;
+        }
+
+        if (d->isWatched(dirUri)) {
+            g_file_monitor_cancel(monitor);
+            g_object_unref(monitor);
+            return G_SOURCE_REMOVE;
+        }
+
+        g_signal_connect(monitor, "changed", G_CALLBACK(monitorChangedCB), d);
+        d->mMonitors.insert(dirUri, monitor);
+        d->mMonitorOrder << dirUri;
+
+        if (d->mMonitorOrder.size() > FILE_INFO_CACHE_MAX_MONITORS) {
+            QString oldest = d->mMonitorOrder.takeFirst();
+            GFileMonitor* m = d->mMonitors.take(oldest);
+            if (m) {
+                g_signal_handlers_disconnect_by_data(m, d);
+                g_file_monitor_cancel(m);
+                g_object_unref(m);
+            }
+            dropped = d->removeEntriesOf(oldest);
+        }
+    }
+
+    for (auto uri : dropped) {
+        Q_EMIT d->q_func()->invalidated(uri);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+void FileInfoCachePrivate::monitorChangedCB(GFileMonitor*, GFile* file, GFile* otherFile, GFileMonitorEvent event, FileInfoCachePrivate* d)
+{
+    QStringList uris;
+
+    if (file) {
+        g_autofree char* uri = g_file_get_uri(file);
+        uris << uri;
+    }
+
+    if (otherFile) {
+        g_autofree char* uri = g_file_get_uri(otherFile);
+        uris << uri;
+    }
+
+    // the directory's own mtime changes too
+    switch (event) {
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_DELETED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+    case G_FILE_MONITOR_EVENT_MOVED_OUT:
+    case G_FILE_MONITOR_EVENT_RENAMED:
+        if (file) {
+            g_autofree char* uri = g_file_get_uri(file);
+            uris << parentUri(uri);
+        }
+        break;
+    default:
+        break;
+    }
+
+    for (auto uri : uris) {
+        d->q_func()->invalidate(uri);
+    }
+}
+
+FileInfo::FileInfo(const QString& uri, GFileInfo* info, File::Attributes attrs) : mUri(uri), mInfo(info), mAttributes(attrs)
+{
+    mCost = int(sizeof(FileInfo)) + mUri.size() * int(sizeof(QChar));
+
+    if (G_IS_FILE_INFO(mInfo)) {
+        g_auto(GStrv) ls = g_file_info_list_attributes(mInfo, nullptr);
+        mCost += (ls ? int(g_strv_length(ls)) : 0) * FILE_INFO_ATTRIBUTE_COST;
+    }
+}
+
+FileInfo::~FileInfo()
+{
+    if (mInfo)                              g_object_unref(mInfo);
+}
+
+QString FileInfo::uri() const
+{
+    return mUri;
+}
+
+File::Attributes FileInfo::attributes() const
+{
+    return mAttributes;
+}
+
+const GFileInfo* FileInfo::getGFileInfo() const
+{
+    return mInfo;
+}
+
+int FileInfo::cost() const
+{
+    return mCost;
+}
+}
+
+
+graceful::FileInfoCache *graceful::FileInfoCache::getInstance()
+{
+    static QMutex mutex;
+    static FileInfoCache* gInstance = nullptr;
+    if (!gInstance) {
+        mutex.lock();
+        gInstance = gInstance ? gInstance : new FileInfoCache;
+        mutex.unlock();
+    }
+
+    return gInstance;
+}
+
+graceful::FileInfoPtr graceful::FileInfoCache::lookup(const QString& uri, File::Attributes attrs)
+{
+    Q_D(FileInfoCache);
+
+    QMutexLocker locker(&d->mLock);
+
+    FileInfoPtr* info = d->mCache.object(uri);
+    if (info && ((*info)->attributes() & attrs) == attrs) {
+        ++d->mHits;
+        return *info;
+    }
+
+    ++d->mMisses;
+
+    return FileInfoPtr();
+}
+
+graceful::FileInfoPtr graceful::FileInfoCache::insert(const QString& uri, const GFileInfo* info, File::Attributes attrs)
+{
+    Q_D(FileInfoCache);
+
+    gf_return_val_if_fail(!uri.isEmpty() && G_IS_FILE_INFO(info), FileInfoPtr());
+
+    QString dirUri = FileInfoCachePrivate::parentUri(uri);
+
+    FileInfoPtr snapshot;
+    bool watched = false;
+    bool unwatchable = false;
+    bool pending = false;
+    {
+        QMutexLocker locker(&d->mLock);
+
+        GFileInfo* merged = nullptr;
+        FileInfoPtr* old = d->mCache.object(uri);
+        if (old) {
+            merged = g_file_info_dup(const_cast<GFileInfo*>((*old)->getGFileInfo()));
+            attrs |= (*old)->attributes();
+            Utils::mergeFileInfo(merged, const_cast<GFileInfo*>(info));
+        } else {
+            merged = G_FILE_INFO(g_object_ref(const_cast<GFileInfo*>(info)));
+        }
+
+        snapshot = FileInfoPtr(new FileInfo(uri, merged, attrs));
+        watched = d->isWatched(dirUri);
+        unwatchable = d->isUnwatchable(dirUri);
+        if (!watched && !unwatchable) {
+            pending = d->mWatchPending.contains(dirUri);
+            d->mWatchPending.insert(dirUri);
+        }
+
+        // until the monitor is set up the entry is only handed back to the caller
+        if (watched) {
+            d->mCache.insert(uri, new FileInfoPtr(snapshot), snapshot->cost());
+        }
+    }
+
+    // from an idle source, never inline: creating a monitor may block
+    if (!watched && !unwatchable && !pending) {
+        WatchDirectoryData* data = new WatchDirectoryData;
+        data->d = d;
+        data->dirUri = dirUri;
+        g_idle_add(FileInfoCachePrivate::watchDirectoryCB, data);
+    }
+
+    return snapshot;
+}
+
+void graceful::FileInfoCache::invalidate(const QString& uri)
+{
+    Q_D(FileInfoCache);
+
+    bool removed = false;
+    {
+        QMutexLocker locker(&d->mLock);
+        removed = d->mCache.remove(uri);
+    }
+
+    if (removed) {
+        Q_EMIT invalidated(uri);
+    }
+}
+
+void graceful::FileInfoCache::clear()
+{
+    Q_D(FileInfoCache);
+
+    QMutexLocker locker(&d->mLock);
+
+    d->mCache.clear();
+}
+
+void graceful::FileInfoCache::setMaxCost(int bytes)
+{
+    Q_D(FileInfoCache);
+
+    QMutexLocker locker(&d->mLock);
+
+    d->mCache.setMaxCost(bytes);
+}
+
+int graceful::FileInfoCache::maxCost() const
+{
+    Q_D(const FileInfoCache);
+
+    QMutexLocker locker(&d->mLock);
+
+    return d->mCache.maxCost();
+}
+
+int graceful::FileInfoCache::totalCost() const
+{
+    Q_D(const FileInfoCache);
+
+    QMutexLocker locker(&d->mLock);
+
+    return d->mCache.totalCost();
+}
+
+int graceful::FileInfoCache::count() const
+{
+    Q_D(const FileInfoCache);
+
+    QMutexLocker locker(&d->mLock);
+
+    return d->mCache.count();
+}
+
+quint64 graceful::FileInfoCache::hitCount() const
+{
+    Q_D(const FileInfoCache);
+
+    QMutexLocker locker(&d->mLock);
+
+    return d->mHits;
+}
+
+quint64 graceful::FileInfoCache::missCount() const
+{
+    Q_D(const FileInfoCache);
+
+    QMutexLocker locker(&d->mLock);
+
+    return d->mMisses;
+}
+
+void graceful::FileInfoCache::resetStatistics()
+{
+    Q_D(FileInfoCache);
+
+    QMutexLocker locker(&d->mLock);
+
+    d->mHits = 0;
+    d->mMisses = 0;
+}
+
+graceful::FileInfoCache::FileInfoCache(QObject *parent) : QObject(parent), d_ptr(new FileInfoCachePrivate(this))
+{
+
+}
+
+graceful::FileInfoCache::~FileInfoCache()
+{
+    delete d_ptr;
+}
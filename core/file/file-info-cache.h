@@ -0,0 +1,110 @@
+#ifndef FILEINFOCACHE_H
+#define FILEINFOCACHE_H
+
+#include "globals.h"
+#include "file.h"
+
+#include <QObject>
+#include <QSharedPointer>
+
+#include <gio/gio.h>
+
+namespace graceful
+{
+/**
+ * @brief
+ * Immutable snapshot of the attributes queried for one uri.
+ * A snapshot is never modified once it is in FileInfoCache, a newer query
+ * replaces it by a new snapshot.
+ */
+class GRACEFUL_API FileInfo
+{
+public:
+    FileInfo(const QString& uri, GFileInfo* info, File::Attributes attrs);
+    ~FileInfo();
+
+    QString uri() const;
+    File::Attributes attributes() const;
+    const GFileInfo* getGFileInfo() const;
+
+    /**
+     * @brief
+     * estimated memory used by this snapshot in bytes
+     */
+    int cost() const;
+
+private:
+    QString                     mUri;
+    GFileInfo*                  mInfo = nullptr;
+    File::Attributes            mAttributes;
+    int                         mCost = 0;
+
+    Q_DISABLE_COPY(FileInfo)
+};
+
+typedef QSharedPointer<const FileInfo> FileInfoPtr;
+
+class FileInfoCachePrivate;
+
+/**
+ * @brief
+ * Process wide, uri keyed cache of FileInfo snapshots shared by every File.
+ * Directories holding cached entries are watched with a GFileMonitor, any
+ * event on an entry drops it from the cache. The monitor is created from an
+ * idle of the default GMainContext, entries of a directory are only kept
+ * once it is set up.
+ * All methods are thread safe, monitors are driven by the default GMainContext.
+ */
+class GRACEFUL_API FileInfoCache : public QObject
+{
+    Q_OBJECT
+public:
+    static FileInfoCache* getInstance();
+
+    /**
+     * @brief
+     * return the snapshot of 'uri' if it holds all groups in 'attrs', null otherwise
+     */
+    FileInfoPtr lookup(const QString& uri, File::Attributes attrs);
+
+    /**
+     * @brief
+     * merge 'info' into the snapshot of 'uri' and return the new snapshot.
+     * If 'uri' has no snapshot yet 'info' is referenced instead of copied,
+     * so it must not be modified afterwards
+     */
+    FileInfoPtr insert(const QString& uri, const GFileInfo* info, File::Attributes attrs);
+
+    void invalidate(const QString& uri);
+    void clear();
+
+    /**
+     * @brief
+     * memory bound of all snapshots in bytes
+     */
+    void setMaxCost(int bytes);
+    int maxCost() const;
+    int totalCost() const;
+    int count() const;
+
+    quint64 hitCount() const;
+    quint64 missCount() const;
+    void resetStatistics();
+
+Q_SIGNALS:
+    void invalidated(const QString& uri);
+
+private:
+    explicit FileInfoCache(QObject* parent = nullptr);
+    ~FileInfoCache();
+
+private:
+    FileInfoCachePrivate*       d_ptr = nullptr;
+    Q_DISABLE_COPY(FileInfoCache)
+    Q_DECLARE_PRIVATE(FileInfoCache)
+};
+}
+
+Q_DECLARE_METATYPE(graceful::FileInfoPtr)
+
+#endif // FILEINFOCACHE_H
@@ -0,0 +1,1317 @@
+#include "file-operation.h"
+
+#include "log/log.h"
+#include "file.h"
+#include "statx-fetcher.h"
+
+#include <QSet>
+#include <QFile>
+#include <QList>
+#include <QPair>
+#include <QMutex>
+#include <QTimer>
+#include <QThread>
+#include <QVector>
+#include <QAtomicInt>
+#include <QMutexLocker>
+#include <QWaitCondition>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+
+#define FILE_OPERATION_PROGRESS_INTERVAL_MS     200
+#define FILE_OPERATION_THREADS_MIN              4               // small files wait on the disk, not the CPU
+#define FILE_OPERATION_QUEUE_MAX                4096            // jobs queued ahead of the workers
+#define FILE_OPERATION_BUFFER_SIZE              (1024 * 1024)
+#define FILE_OPERATION_BUFFER_ALIGN             4096
+#define FILE_OPERATION_CHUNK_SIZE               (16 * 1024 * 1024)  // copied between two pause and cancel checks
+
+#define FILE_OPERATION_STATX_MASK               (STATX_TYPE | STATX_MODE | STATX_SIZE)
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE                        (1 << 0)
+#endif
+
+namespace graceful
+{
+enum JobKind
+{
+    JobCopyFile,
+    JobCopySymlink,
+    JobUnlink
+};
+
+struct OperationJob
+{
+    int                                 kind = JobCopyFile;
+    int                                 item = 0;               // index of the source it belongs to
+    bool                                overwrite = false;
+    QByteArray                          src;
+    QByteArray                          dst;
+};
+
+class OperationWorker : public QThread
+{
+public:
+    explicit OperationWorker(FileOperationPrivate* d);
+    ~OperationWorker();
+
+protected:
+    void run() override;
+
+public:
+    char*                               mBuffer = nullptr;      // for copies without kernel help
+    FileOperationPrivate*               d = nullptr;
+};
+
+class OperationRunner : public QThread
+{
+public:
+    explicit OperationRunner(FileOperationPrivate* d) : QThread(), d(d) {}
+
+protected:
+    void run() override;
+
+public:
+    FileOperationPrivate*               d = nullptr;
+};
+
+class FileOperationPrivate
+{
+    Q_DECLARE_PUBLIC(FileOperation)
+public:
+    explicit FileOperationPrivate(FileOperation* q);
+    ~FileOperationPrivate();
+
+    // runner thread
+    void runItems();
+    QByteArray localTarget(int item, const QByteArray& src, bool& overwrite);
+    GFile* gioTarget(int item, GFile* src, bool& overwrite);
+    void moveLocal(int item, const QByteArray& src);
+    void copyLocal(int item, const QByteArray& src, const QByteArray& dst, bool overwrite);
+    void deleteLocal(int item, const QByteArray& path);
+    bool copyGio(int item, GFile* src, GFile* dst, bool overwrite);
+    bool deleteGio(int item, GFile* file);
+    void moveGio(int item, GFile* src);
+
+    void pushJob(const OperationJob& job);
+    void waitIdle();
+    void finishJobs();
+
+    // worker threads
+    bool nextJob(OperationJob& job);
+    void jobDone();
+    void runJob(OperationWorker* self, const OperationJob& job);
+    void copyFile(OperationWorker* self, const OperationJob& job);
+    int copyData(OperationWorker* self, int in, int out, quint64 size);
+    void copySymlink(const OperationJob& job);
+
+    // any thread
+    bool checkPoint();
+    bool isCancelled() const;
+    void reportError(int item, const QString& uri, const QString& message);
+    void reportError(int item, const QByteArray& path, int err);
+    void reportError(int item, GFile* file, const GError* error);
+    bool itemFailed(int item);
+
+public:
+    FileOperation::Type                 mType;
+    FileOperation::ConflictPolicy       mPolicy = FileOperation::ConflictRename;
+    QStringList                         mSources;
+    QString                             mDestination;
+
+    bool                                mAutoDelete = false;
+    bool                                mRunning = false;
+    int                                 mThreadCount = 0;
+    QTimer*                             mProgressTimer = nullptr;
+    GCancellable*                       mCancellable = nullptr;
+
+    OperationRunner*                    mRunner = nullptr;
+    QList<OperationWorker*>             mWorkers;
+    StatxFetcher                        mFetcher;               // the runner's
+
+    QMutex                              mQueueLock;
+    QWaitCondition                      mQueueCond;             // workers wait for jobs
+    QWaitCondition                      mIdleCond;              // the runner waits for room or for the end of the jobs
+    QList<OperationJob>                 mJobs;
+    int                                 mActive = 0;            // jobs queued or running
+    bool                                mNoMoreJobs = false;
+
+    QMutex                              mPauseLock;
+    QWaitCondition                      mPauseCond;
+    bool                                mPaused = false;
+
+    QAtomicInteger<quint64>             mTotalBytes;
+    QAtomicInteger<quint64>             mDoneBytes;
+    QAtomicInteger<quint64>             mTotalFiles;
+    QAtomicInteger<quint64>             mDoneFiles;
+    quint64                             mReportedBytes = 0;
+    quint64                             mReportedFiles = 0;
+    quint64                             mReportedTotal = 0;
+
+    QMutex                              mErrorLock;
+    bool                                mErrorsScheduled = false;
+    QSet<int>                           mFailedItems;
+    QList<QPair<QString, QString>>      mPendingErrors;
+
+    FileOperation*                      q_ptr = nullptr;
+};
+
+static inline bool isDotOrDotDot(const char* name)
+{
+    return '.' == name[0] && (!name[1] || ('.' == name[1] && !name[2]));
+}
+
+static inline QByteArray joinPath(const QByteArray& dir, const QByteArray& name)
+{
+    return dir.endsWith('/') ? dir + name : dir + '/' + name;
+}
+
+static inline QByteArray baseName(const QByteArray& path)
+{
+    int end = path.size();
+    while (end > 1 && '/' == path.at(end - 1)) {
+        --end;
+    }
+
+    int start = path.lastIndexOf('/', end - 1) + 1;
+
+    return path.mid(start, end - start);
+}
+
+static inline bool exists(const QByteArray& path)
+{
+    struct stat st;
+
+    return 0 == ::lstat(path.constData(), &st);
+}
+
+static int renameNoReplace(const char* src, const char* dst)
+{
+#ifdef SYS_renameat2
+    if (0 == ::syscall(SYS_renameat2, AT_FDCWD, src, AT_FDCWD, dst, RENAME_NOREPLACE)) {
+        return 0;
+    }
+    if (ENOSYS != errno && EINVAL != errno) {
+        return errno;
+    }
+#endif
+    // the target was checked to be free, a file created since then is replaced
+    return (0 == ::rename(src, dst)) ? 0 : errno;
+}
+
+static bool writeAll(int fd, const char* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = ::write(fd, buf, len);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return false;
+        }
+        buf += n;
+        len -= size_t(n);
+    }
+
+    return true;
+}
+
+// "name (2).ext", the extension of a directory is part of its name
+static QByteArray numberedName(const QByteArray& name, bool isDir, int n)
+{
+    int dot = isDir ? -1 : name.lastIndexOf('.');
+    if (dot <= 0) {
+        dot = name.size();
+    }
+
+    return name.left(dot) + " (" + QByteArray::number(n) + ")" + name.mid(dot);
+}
+
+OperationWorker::OperationWorker(FileOperationPrivate* d) : QThread(), d(d)
+{
+
+}
+
+OperationWorker::~OperationWorker()
+{
+    free(mBuffer);
+}
+
+void OperationWorker::run()
+{
+    OperationJob job;
+
+    while (d->nextJob(job)) {
+        d->runJob(this, job);
+        d->jobDone();
+    }
+}
+
+void OperationRunner::run()
+{
+    d->runItems();
+    d->finishJobs();
+
+    QMetaObject::invokeMethod(d->q_ptr, "onRunFinished", Qt::QueuedConnection);
+}
+
+FileOperationPrivate::FileOperationPrivate(FileOperation* q) : q_ptr(q)
+{
+    mThreadCount = qMax(FILE_OPERATION_THREADS_MIN, QThread::idealThreadCount());
+    mCancellable = g_cancellable_new();
+}
+
+FileOperationPrivate::~FileOperationPrivate()
+{
+    g_cancellable_cancel(mCancellable);
+    {
+        QMutexLocker locker(&mPauseLock);
+        mPauseCond.wakeAll();
+    }
+    {
+        QMutexLocker locker(&mQueueLock);
+        mIdleCond.wakeAll();
+    }
+
+    if (mRunner) {
+        mRunner->wait();
+        delete mRunner;
+    }
+
+    for (auto w : mWorkers) {
+        w->wait();
+    }
+    qDeleteAll(mWorkers);
+
+    if (mCancellable)                   g_object_unref(mCancellable);
+}
+
+void FileOperationPrivate::runItems()
+{
+    for (int i = 0; i < mSources.size() && checkPoint(); ++i) {
+        File src(mSources.at(i));
+        bool local = src.getUri().isLocal();
+        if (FileOperation::Copy == mType || FileOperation::Move == mType) {
+            local = local && File(mDestination).getUri().isLocal();
+        }
+
+        QByteArray path = local ? QFile::encodeName(src.getUri().path()) : QByteArray();
+        GFile* file = const_cast<GFile*>(src.getGFile());
+
+        switch (mType) {
+        case FileOperation::Copy: {
+            bool overwrite = false;
+            if (local) {
+                QByteArray dst = localTarget(i, path, overwrite);
+                if (!dst.isEmpty()) {
+                    copyLocal(i, path, dst, overwrite);
+                }
+            } else {
+                g_autoptr(GFile) dst = gioTarget(i, file, overwrite);
+                if (dst) {
+                    copyGio(i, file, dst, overwrite);
+                }
+            }
+            break;
+        }
+        case FileOperation::Move:
+            local ? moveLocal(i, path) : moveGio(i, file);
+            break;
+        case FileOperation::Delete:
+            if (local) {
+                deleteLocal(i, path);
+            } else {
+                deleteGio(i, file);
+            }
+            break;
+        case FileOperation::Trash: {
+            GError* error = nullptr;
+            mTotalFiles.fetchAndAddRelaxed(1);
+            if (g_file_trash(file, mCancellable, &error)) {
+                mDoneFiles.fetchAndAddRelaxed(1);
+            } else {
+                reportError(i, file, error);
+                g_error_free(error);
+            }
+            break;
+        }
+        }
+    }
+
+    waitIdle();
+}
+
+QByteArray FileOperationPrivate::localTarget(int item, const QByteArray& src, bool& overwrite)
+{
+    overwrite = false;
+
+    struct stat st;
+    if (0 != ::lstat(src.constData(), &st)) {
+        reportError(item, src, errno);
+        return QByteArray();
+    }
+
+    QByteArray dir = QFile::encodeName(File(mDestination).getUri().path());
+    QByteArray name = baseName(src);
+    QByteArray dst = joinPath(dir, name);
+    bool isDir = S_ISDIR(st.st_mode);
+
+    // a directory can't go into itself
+    if (isDir && (dst == src || (dst.startsWith(src) && '/' == dst.at(src.size())))) {
+        if (dst != src || FileOperation::Move == mType) {
+            reportError(item, QFile::decodeName(src), QObject::tr("Cannot copy or move a folder into itself"));
+            return QByteArray();
+        }
+    }
+
+    if (!exists(dst)) {
+        return dst;
+    }
+
+    // moving a file onto itself does nothing
+    if (dst == src && FileOperation::Move == mType) {
+        return QByteArray();
+    }
+
+    switch (mPolicy) {
+    case FileOperation::ConflictSkip:
+        return QByteArray();
+    case FileOperation::ConflictOverwrite:
+        if (dst == src) {
+            reportError(item, QFile::decodeName(src), QObject::tr("Cannot copy a file onto itself"));
+            return QByteArray();
+        }
+        overwrite = true;
+        return dst;
+    case FileOperation::ConflictRename:
+        for (int n = 2; n < INT_MAX; ++n) {
+            QByteArray candidate = joinPath(dir, numberedName(name, isDir, n));
+            if (!exists(candidate)) {
+                return candidate;
+            }
+        }
+        break;
+    }
+
+    return QByteArray();
+}
+
+GFile* FileOperationPrivate::gioTarget(int item, GFile* src, bool& overwrite)
+{
+    overwrite = false;
+
+    g_autoptr(GFile) dir = g_file_new_for_uri(mDestination.toUtf8().constData());
+    g_autofree char* name = g_file_get_basename(src);
+    gf_return_val_if_fail(name, nullptr);
+
+    if (g_file_equal(dir, src) || g_file_has_prefix(dir, src)) {
+        g_autofree char* uri = g_file_get_uri(src);
+        reportError(item, uri, QObject::tr("Cannot copy or move a folder into itself"));
+        return nullptr;
+    }
+
+    GFile* dst = g_file_get_child(dir, name);
+    if (!g_file_query_exists(dst, mCancellable)) {
+        return dst;
+    }
+
+    if (g_file_equal(dst, src) && FileOperation::Move == mType) {
+        g_object_unref(dst);
+        return nullptr;
+    }
+
+    switch (mPolicy) {
+    case FileOperation::ConflictSkip:
+        break;
+    case FileOperation::ConflictOverwrite:
+        if (!g_file_equal(dst, src)) {
+            overwrite = true;
+            return dst;
+        }
+        break;
+    case FileOperation::ConflictRename: {
+        bool isDir = (G_FILE_TYPE_DIRECTORY == g_file_query_file_type(src, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, mCancellable));
+        for (int n = 2; n < INT_MAX && !isCancelled(); ++n) {
+            GFile* candidate = g_file_get_child(dir, numberedName(name, isDir, n).constData());
+            if (!g_file_query_exists(candidate, mCancellable)) {
+                g_object_unref(dst);
+                return candidate;
+            }
+            g_object_unref(candidate);
+        }
+        break;
+    }
+    }
+
+    g_object_unref(dst);
+
+    return nullptr;
+}
+
+void FileOperationPrivate::moveLocal(int item, const QByteArray& src)
+{
+    bool overwrite = false;
+    QByteArray dst = localTarget(item, src, overwrite);
+    if (dst.isEmpty()) {
+        return;
+    }
+
+    // one rename() on the same filesystem, whatever the size of the tree
+    int err = overwrite ? ((0 == ::rename(src.constData(), dst.constData())) ? 0 : errno) : renameNoReplace(src.constData(), dst.constData());
+    if (0 == err) {
+        mTotalFiles.fetchAndAddRelaxed(1);
+        mDoneFiles.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    // another filesystem, or a directory merged into a non empty one
+    if (EXDEV != err && ENOTEMPTY != err && EEXIST != err) {
+        reportError(item, src, err);
+        return;
+    }
+
+    copyLocal(item, src, dst, overwrite);
+    waitIdle();
+
+    // the source is only removed once all of it was copied
+    if (!isCancelled() && !itemFailed(item)) {
+        deleteLocal(item, src);
+    }
+}
+
+void FileOperationPrivate::copyLocal(int item, const QByteArray& src, const QByteArray& dst, bool overwrite)
+{
+    struct stat st;
+    if (0 != ::lstat(src.constData(), &st)) {
+        reportError(item, src, errno);
+        return;
+    }
+
+    OperationJob job;
+    job.item = item;
+    job.overwrite = overwrite;
+
+    if (!S_ISDIR(st.st_mode)) {
+        if (S_ISREG(st.st_mode)) {
+            job.kind = JobCopyFile;
+            mTotalBytes.fetchAndAddRelaxed(quint64(st.st_size));
+        } else if (S_ISLNK(st.st_mode)) {
+            job.kind = JobCopySymlink;
+        } else {
+            reportError(item, QFile::decodeName(src), QObject::tr("Special files are not copied"));
+            return;
+        }
+        mTotalFiles.fetchAndAddRelaxed(1);
+        job.src = src;
+        job.dst = dst;
+        pushJob(job);
+        return;
+    }
+
+    // directories are created here before their files are queued, writable
+    // until the end so read only ones can be filled. Merged into existing
+    // ones keep their mode
+    struct CopyDir
+    {
+        QByteArray                      src;
+        QByteArray                      dst;
+        mode_t                          mode;
+    };
+    QList<CopyDir> stack;
+    QList<QPair<QByteArray, mode_t>> modes;             // of the directories created
+    stack << CopyDir{src, dst, mode_t(st.st_mode & 07777)};
+
+    while (!stack.isEmpty() && checkPoint()) {
+        CopyDir dir = stack.takeLast();
+
+        if (0 == ::mkdir(dir.dst.constData(), 0700)) {
+            modes << qMakePair(dir.dst, dir.mode);
+        } else if (!(EEXIST == errno && overwrite)) {
+            reportError(item, dir.dst, errno);
+            continue;
+        }
+        mTotalFiles.fetchAndAddRelaxed(1);
+        mDoneFiles.fetchAndAddRelaxed(1);
+
+        int fd = ::open(dir.src.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC | O_NOCTTY);
+        DIR* d = (fd >= 0) ? ::fdopendir(fd) : nullptr;
+        if (!d) {
+            reportError(item, dir.src, errno);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            continue;
+        }
+
+        QList<QByteArray> names;
+        while (struct dirent* e = ::readdir(d)) {
+            if (!isDotOrDotDot(e->d_name)) {
+                names << QByteArray(e->d_name);
+            }
+        }
+
+        QVector<struct statx> stats;
+        QVector<int> results;
+        mFetcher.fetch(::dirfd(d), names, FILE_OPERATION_STATX_MASK, stats, results);
+
+        for (int i = 0; i < names.size(); ++i) {
+            QByteArray childSrc = joinPath(dir.src, names.at(i));
+            QByteArray childDst = joinPath(dir.dst, names.at(i));
+            if (0 != results.at(i)) {
+                reportError(item, childSrc, results.at(i));
+                continue;
+            }
+
+            const struct statx& s = stats.at(i);
+            if (S_ISDIR(s.stx_mode)) {
+                stack << CopyDir{childSrc, childDst, mode_t(s.stx_mode & 07777)};
+                continue;
+            }
+
+            if (S_ISREG(s.stx_mode)) {
+                job.kind = JobCopyFile;
+                mTotalBytes.fetchAndAddRelaxed(s.stx_size);
+            } else if (S_ISLNK(s.stx_mode)) {
+                job.kind = JobCopySymlink;
+            } else {
+                reportError(item, QFile::decodeName(childSrc), QObject::tr("Special files are not copied"));
+                continue;
+            }
+
+            mTotalFiles.fetchAndAddRelaxed(1);
+            job.src = childSrc;
+            job.dst = childDst;
+            pushJob(job);
+        }
+
+        ::closedir(d);
+    }
+
+    // modes go on once nothing is written into the directories anymore
+    waitIdle();
+    for (int i = modes.size() - 1; i >= 0; --i) {
+        ::chmod(modes.at(i).first.constData(), modes.at(i).second);
+    }
+}
+
+void FileOperationPrivate::deleteLocal(int item, const QByteArray& path)
+{
+    struct stat st;
+    if (0 != ::lstat(path.constData(), &st)) {
+        reportError(item, path, errno);
+        return;
+    }
+
+    OperationJob job;
+    job.kind = JobUnlink;
+    job.item = item;
+
+    mTotalFiles.fetchAndAddRelaxed(1);
+    if (!S_ISDIR(st.st_mode)) {
+        job.src = path;
+        pushJob(job);
+        return;
+    }
+
+    // files are unlinked by the workers, directories here, deepest first
+    QList<QByteArray> dirs;
+    QList<QByteArray> stack;
+    stack << path;
+
+    while (!stack.isEmpty() && checkPoint()) {
+        QByteArray dir = stack.takeLast();
+        dirs << dir;
+
+        int fd = ::open(dir.constData(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC | O_NOCTTY);
+        DIR* d = (fd >= 0) ? ::fdopendir(fd) : nullptr;
+        if (!d) {
+            reportError(item, dir, errno);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            continue;
+        }
+
+        while (struct dirent* e = ::readdir(d)) {
+            if (isDotOrDotDot(e->d_name)) {
+                continue;
+            }
+
+            QByteArray child = joinPath(dir, e->d_name);
+            bool isDir = (DT_DIR == e->d_type);
+            if (DT_UNKNOWN == e->d_type) {
+                struct stat cst;
+                isDir = (0 == ::fstatat(::dirfd(d), e->d_name, &cst, AT_SYMLINK_NOFOLLOW) && S_ISDIR(cst.st_mode));
+            }
+
+            mTotalFiles.fetchAndAddRelaxed(1);
+            if (isDir) {
+                stack << child;
+            } else {
+                job.src = child;
+                pushJob(job);
+            }
+        }
+
+        ::closedir(d);
+    }
+
+    waitIdle();
+
+    // a directory left non empty by a failure already reported is not one more
+    for (int i = dirs.size() - 1; i >= 0 && !isCancelled(); --i) {
+        if (0 == ::rmdir(dirs.at(i).constData())) {
+            mDoneFiles.fetchAndAddRelaxed(1);
+            continue;
+        }
+
+        int err = errno;
+        if (!((ENOTEMPTY == err || EEXIST == err) && itemFailed(item))) {
+            reportError(item, dirs.at(i), err);
+        }
+    }
+}
+
+static void gioProgressCB(goffset current, goffset total, gpointer data)
+{
+    auto state = static_cast<QPair<FileOperationPrivate*, goffset>*>(data);
+
+    state->first->mDoneBytes.fetchAndAddRelaxed(quint64(current - state->second));
+    state->second = current;
+
+    // blocks the copy while paused
+    state->first->checkPoint();
+
+    Q_UNUSED(total)
+}
+
+bool FileOperationPrivate::copyGio(int item, GFile* src, GFile* dst, bool overwrite)
+{
+    GError* error = nullptr;
+    g_autoptr(GFileInfo) info = g_file_query_info(src, G_FILE_ATTRIBUTE_STANDARD_TYPE "," G_FILE_ATTRIBUTE_STANDARD_SIZE, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, mCancellable, &error);
+    if (error) {
+        reportError(item, src, error);
+        g_error_free(error);
+        return false;
+    }
+
+    mTotalFiles.fetchAndAddRelaxed(1);
+
+    if (G_FILE_TYPE_DIRECTORY != g_file_info_get_file_type(info)) {
+        quint64 size = quint64(g_file_info_get_size(info));
+        mTotalBytes.fetchAndAddRelaxed(size);
+
+        QPair<FileOperationPrivate*, goffset> state(this, 0);
+        GFileCopyFlags flags = GFileCopyFlags(G_FILE_COPY_NOFOLLOW_SYMLINKS | G_FILE_COPY_ALL_METADATA | (overwrite ? G_FILE_COPY_OVERWRITE : 0));
+        if (!g_file_copy(src, dst, flags, mCancellable, gioProgressCB, &state, &error)) {
+            reportError(item, src, error);
+            g_error_free(error);
+            return false;
+        }
+
+        mDoneBytes.fetchAndAddRelaxed(size - quint64(state.second));
+        mDoneFiles.fetchAndAddRelaxed(1);
+        return true;
+    }
+
+    if (!g_file_make_directory(dst, mCancellable, &error)) {
+        if (!(overwrite && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_EXISTS))) {
+            reportError(item, dst, error);
+            g_error_free(error);
+            return false;
+        }
+        g_clear_error(&error);
+    }
+    mDoneFiles.fetchAndAddRelaxed(1);
+
+    g_autoptr(GFileEnumerator) enumerator = g_file_enumerate_children(src, G_FILE_ATTRIBUTE_STANDARD_NAME, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, mCancellable, &error);
+    if (error) {
+        reportError(item, src, error);
+        g_error_free(error);
+        return false;
+    }
+
+    bool successed = true;
+    while (GFileInfo* child = g_file_enumerator_next_file(enumerator, mCancellable, &error)) {
+        g_autoptr(GFile) childSrc = g_file_enumerator_get_child(enumerator, child);
+        g_autoptr(GFile) childDst = g_file_get_child(dst, g_file_info_get_name(child));
+        g_object_unref(child);
+
+        if (!checkPoint()) {
+            return false;
+        }
+        successed = copyGio(item, childSrc, childDst, overwrite) && successed;
+    }
+
+    if (error) {
+        reportError(item, src, error);
+        g_error_free(error);
+        return false;
+    }
+
+    return successed;
+}
+
+bool FileOperationPrivate::deleteGio(int item, GFile* file)
+{
+    GError* error = nullptr;
+
+    mTotalFiles.fetchAndAddRelaxed(1);
+
+    if (G_FILE_TYPE_DIRECTORY == g_file_query_file_type(file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, mCancellable)) {
+        g_autoptr(GFileEnumerator) enumerator = g_file_enumerate_children(file, G_FILE_ATTRIBUTE_STANDARD_NAME, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, mCancellable, &error);
+        if (error) {
+            reportError(item, file, error);
+            g_error_free(error);
+            return false;
+        }
+
+        while (GFileInfo* child = g_file_enumerator_next_file(enumerator, mCancellable, &error)) {
+            g_autoptr(GFile) childFile = g_file_enumerator_get_child(enumerator, child);
+            g_object_unref(child);
+
+            if (!checkPoint() || !deleteGio(item, childFile)) {
+                return false;
+            }
+        }
+
+        if (error) {
+            reportError(item, file, error);
+            g_error_free(error);
+            return false;
+        }
+    }
+
+    if (!g_file_delete(file, mCancellable, &error)) {
+        reportError(item, file, error);
+        g_error_free(error);
+        return false;
+    }
+    mDoneFiles.fetchAndAddRelaxed(1);
+
+    return true;
+}
+
+void FileOperationPrivate::moveGio(int item, GFile* src)
+{
+    bool overwrite = false;
+    g_autoptr(GFile) dst = gioTarget(item, src, overwrite);
+    if (!dst) {
+        return;
+    }
+
+    GError* error = nullptr;
+    GFileCopyFlags flags = GFileCopyFlags(G_FILE_COPY_NOFOLLOW_SYMLINKS | G_FILE_COPY_ALL_METADATA | G_FILE_COPY_NO_FALLBACK_FOR_MOVE | (overwrite ? G_FILE_COPY_OVERWRITE : 0));
+    mTotalFiles.fetchAndAddRelaxed(1);
+    if (g_file_move(src, dst, flags, mCancellable, nullptr, nullptr, &error)) {
+        mDoneFiles.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    // no native move between these two, or a directory to merge
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED) && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_RECURSE)
+            && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_MERGE)) {
+        reportError(item, src, error);
+        g_error_free(error);
+        return;
+    }
+    g_error_free(error);
+    mTotalFiles.fetchAndSubRelaxed(1);
+
+    if (copyGio(item, src, dst, overwrite) && !isCancelled()) {
+        deleteGio(item, src);
+    }
+}
+
+void FileOperationPrivate::pushJob(const OperationJob& job)
+{
+    QMutexLocker locker(&mQueueLock);
+
+    // the walk doesn't run far ahead of the copies
+    while (mJobs.size() >= FILE_OPERATION_QUEUE_MAX && !isCancelled()) {
+        mIdleCond.wait(&mQueueLock);
+    }
+
+    mJobs << job;
+    ++mActive;
+    mQueueCond.wakeOne();
+}
+
+void FileOperationPrivate::waitIdle()
+{
+    QMutexLocker locker(&mQueueLock);
+
+    while (mActive > 0) {
+        mIdleCond.wait(&mQueueLock);
+    }
+}
+
+void FileOperationPrivate::finishJobs()
+{
+    {
+        QMutexLocker locker(&mQueueLock);
+        mNoMoreJobs = true;
+        mQueueCond.wakeAll();
+    }
+
+    for (auto w : mWorkers) {
+        w->wait();
+    }
+}
+
+bool FileOperationPrivate::nextJob(OperationJob& job)
+{
+    QMutexLocker locker(&mQueueLock);
+
+    while (mJobs.isEmpty()) {
+        if (mNoMoreJobs) {
+            return false;
+        }
+        mQueueCond.wait(&mQueueLock);
+    }
+
+    job = mJobs.takeFirst();
+
+    return true;
+}
+
+void FileOperationPrivate::jobDone()
+{
+    QMutexLocker locker(&mQueueLock);
+
+    --mActive;
+    if (0 == mActive || mJobs.size() < FILE_OPERATION_QUEUE_MAX / 2) {
+        mIdleCond.wakeAll();
+    }
+}
+
+void FileOperationPrivate::runJob(OperationWorker* self, const OperationJob& job)
+{
+    // cancelled jobs are still taken off the queue, so the runner sees it drain
+    if (!checkPoint()) {
+        return;
+    }
+
+    switch (job.kind) {
+    case JobCopyFile:
+        copyFile(self, job);
+        break;
+    case JobCopySymlink:
+        copySymlink(job);
+        break;
+    case JobUnlink:
+        if (0 == ::unlink(job.src.constData())) {
+            mDoneFiles.fetchAndAddRelaxed(1);
+        } else {
+            reportError(job.item, job.src, errno);
+        }
+        break;
+    }
+}
+
+void FileOperationPrivate::copyFile(OperationWorker* self, const OperationJob& job)
+{
+    int in = ::open(job.src.constData(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NOCTTY);
+    struct stat st;
+    if (in < 0 || 0 != ::fstat(in, &st)) {
+        reportError(job.item, job.src, errno);
+        if (in >= 0) {
+            ::close(in);
+        }
+        return;
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | O_NOFOLLOW | O_NOCTTY | (job.overwrite ? O_TRUNC : O_EXCL);
+    int out = ::open(job.dst.constData(), flags, 0600);
+    if (out < 0) {
+        reportError(job.item, job.dst, errno);
+        ::close(in);
+        return;
+    }
+
+    int err = copyData(self, in, out, quint64(st.st_size));
+    if (0 == err) {
+        struct timespec times[2] = { st.st_atim, st.st_mtim };
+        ::futimens(out, times);
+        ::fchmod(out, st.st_mode & 07777);
+    }
+
+    // NFS reports failed writes on close
+    if (0 != ::close(out) && 0 == err) {
+        err = errno;
+    }
+    ::close(in);
+
+    if (0 == err) {
+        mDoneFiles.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    ::unlink(job.dst.constData());
+    if (ECANCELED != err) {
+        reportError(job.item, job.src, err);
+    }
+}
+
+int FileOperationPrivate::copyData(OperationWorker* self, int in, int out, quint64 size)
+{
+    // a reflink shares the blocks, nothing is copied
+#ifdef FICLONE
+    if (size > 0 && 0 == ::ioctl(out, FICLONE, in)) {
+        mDoneBytes.fetchAndAddRelaxed(size);
+        return 0;
+    }
+#endif
+
+    quint64 done = 0;
+
+    // in kernel, which may still reflink or copy on the server
+#ifdef SYS_copy_file_range
+    while (done < size) {
+        if (!checkPoint()) {
+            return ECANCELED;
+        }
+
+        size_t chunk = size_t(qMin<quint64>(size - done, FILE_OPERATION_CHUNK_SIZE));
+        ssize_t n = ::syscall(SYS_copy_file_range, in, nullptr, out, nullptr, chunk, 0);
+        if (n < 0 && EINTR == errno) {
+            continue;
+        }
+
+        if (n <= 0) {
+            // not supported between these two, the offsets are where the copy stopped
+            if (0 == n || EXDEV == errno || EINVAL == errno || ENOSYS == errno || EOPNOTSUPP == errno || EBADF == errno || ETXTBSY == errno) {
+                break;
+            }
+            return errno;
+        }
+
+        done += quint64(n);
+        mDoneBytes.fetchAndAddRelaxed(quint64(n));
+    }
+#endif
+
+    if (!self->mBuffer && 0 != ::posix_memalign(reinterpret_cast<void**>(&self->mBuffer), FILE_OPERATION_BUFFER_ALIGN, FILE_OPERATION_BUFFER_SIZE)) {
+        self->mBuffer = nullptr;
+        return ENOMEM;
+    }
+
+    ::posix_fadvise(in, off_t(done), 0, POSIX_FADV_SEQUENTIAL);
+
+    // the size may change while copying, read up to the end
+    quint64 sinceCheck = 0;
+    for (;;) {
+        if (sinceCheck >= FILE_OPERATION_CHUNK_SIZE) {
+            if (!checkPoint()) {
+                return ECANCELED;
+            }
+            sinceCheck = 0;
+        }
+
+        ssize_t n = ::read(in, self->mBuffer, FILE_OPERATION_BUFFER_SIZE);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return errno;
+        }
+
+        if (0 == n) {
+            break;
+        }
+
+        if (!writeAll(out, self->mBuffer, size_t(n))) {
+            return errno;
+        }
+
+        sinceCheck += quint64(n);
+        mDoneBytes.fetchAndAddRelaxed(quint64(n));
+    }
+
+    return 0;
+}
+
+void FileOperationPrivate::copySymlink(const OperationJob& job)
+{
+    char target[PATH_MAX + 1];
+    ssize_t len = ::readlink(job.src.constData(), target, PATH_MAX);
+    if (len < 0) {
+        reportError(job.item, job.src, errno);
+        return;
+    }
+    target[len] = '\0';
+
+    if (0 != ::symlink(target, job.dst.constData())) {
+        if (!(EEXIST == errno && job.overwrite && 0 == ::unlink(job.dst.constData()) && 0 == ::symlink(target, job.dst.constData()))) {
+            reportError(job.item, job.dst, errno);
+            return;
+        }
+    }
+
+    mDoneFiles.fetchAndAddRelaxed(1);
+}
+
+bool FileOperationPrivate::checkPoint()
+{
+    if (isCancelled()) {
+        return false;
+    }
+
+    QMutexLocker locker(&mPauseLock);
+    while (mPaused && !isCancelled()) {
+        mPauseCond.wait(&mPauseLock);
+    }
+
+    return !isCancelled();
+}
+
+bool FileOperationPrivate::isCancelled() const
+{
+    return g_cancellable_is_cancelled(mCancellable);
+}
+
+void FileOperationPrivate::reportError(int item, const QString& uri, const QString& message)
+{
+    log_debug("file operation '%s' error: %s", uri.toUtf8().constData(), message.toUtf8().constData());
+
+    // many workers, one queued delivery
+    QMutexLocker locker(&mErrorLock);
+
+    mFailedItems << item;
+    mPendingErrors << qMakePair(uri, message);
+    if (!mErrorsScheduled) {
+        mErrorsScheduled = true;
+        QMetaObject::invokeMethod(q_ptr, "onErrorsReady", Qt::QueuedConnection);
+    }
+}
+
+void FileOperationPrivate::reportError(int item, const QByteArray& path, int err)
+{
+    reportError(item, QFile::decodeName(path), QString::fromUtf8(g_strerror(err)));
+}
+
+void FileOperationPrivate::reportError(int item, GFile* file, const GError* error)
+{
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+        return;
+    }
+
+    g_autofree char* uri = g_file_get_uri(file);
+    reportError(item, QString(uri), QString(error->message));
+}
+
+bool FileOperationPrivate::itemFailed(int item)
+{
+    QMutexLocker locker(&mErrorLock);
+
+    return mFailedItems.contains(item);
+}
+}
+
+
+graceful::FileOperation::FileOperation(Type type, const QStringList& sources, const QString& destination, QObject *parent)
+    : QObject(parent), d_ptr(new FileOperationPrivate(this))
+{
+    Q_D(FileOperation);
+
+    d->mType = type;
+    d->mSources = sources;
+    d->mDestination = destination;
+
+    d->mProgressTimer = new QTimer(this);
+    d->mProgressTimer->setInterval(FILE_OPERATION_PROGRESS_INTERVAL_MS);
+    connect(d->mProgressTimer, &QTimer::timeout, this, &FileOperation::onProgressTimeout);
+}
+
+graceful::FileOperation::~FileOperation()
+{
+    delete d_ptr;
+}
+
+void graceful::FileOperation::setAutoDelete(bool autoDelete)
+{
+    Q_D(FileOperation);
+
+    d->mAutoDelete = autoDelete;
+}
+
+void graceful::FileOperation::setConflictPolicy(ConflictPolicy policy)
+{
+    Q_D(FileOperation);
+
+    gf_return_if_fail(!d->mRunning);
+
+    d->mPolicy = policy;
+}
+
+void graceful::FileOperation::setThreadCount(int count)
+{
+    Q_D(FileOperation);
+
+    gf_return_if_fail(!d->mRunning);
+
+    d->mThreadCount = count > 0 ? count : qMax(FILE_OPERATION_THREADS_MIN, QThread::idealThreadCount());
+}
+
+void graceful::FileOperation::setProgressInterval(int ms)
+{
+    Q_D(FileOperation);
+
+    gf_return_if_fail(ms > 0);
+
+    d->mProgressTimer->setInterval(ms);
+}
+
+graceful::FileOperation::Type graceful::FileOperation::type() const
+{
+    Q_D(const FileOperation);
+
+    return d->mType;
+}
+
+void graceful::FileOperation::startAsync()
+{
+    Q_D(FileOperation);
+
+    gf_return_if_fail(!d->mRunning && !d->mRunner && !d->mSources.isEmpty());
+    gf_return_if_fail(Delete == d->mType || Trash == d->mType || !d->mDestination.isEmpty());
+
+    log_debug("start file operation %d on %d files", int(d->mType), d->mSources.size());
+
+    d->mRunning = true;
+
+    // trash goes through GIO, one file at a time
+    int threads = (Trash == d->mType) ? 0 : d->mThreadCount;
+    for (int i = 0; i < threads; ++i) {
+        d->mWorkers << new OperationWorker(d);
+        d->mWorkers.last()->start();
+    }
+
+    d->mRunner = new OperationRunner(d);
+    d->mRunner->start();
+
+    d->mProgressTimer->start();
+}
+
+void graceful::FileOperation::pause()
+{
+    Q_D(FileOperation);
+
+    QMutexLocker locker(&d->mPauseLock);
+
+    d->mPaused = true;
+}
+
+void graceful::FileOperation::resume()
+{
+    Q_D(FileOperation);
+
+    QMutexLocker locker(&d->mPauseLock);
+
+    d->mPaused = false;
+    d->mPauseCond.wakeAll();
+}
+
+void graceful::FileOperation::cancel()
+{
+    Q_D(FileOperation);
+
+    g_cancellable_cancel(d->mCancellable);
+
+    {
+        QMutexLocker locker(&d->mPauseLock);
+        d->mPauseCond.wakeAll();
+    }
+
+    QMutexLocker locker(&d->mQueueLock);
+    d->mIdleCond.wakeAll();
+}
+
+bool graceful::FileOperation::isRunning() const
+{
+    Q_D(const FileOperation);
+
+    return d->mRunning;
+}
+
+bool graceful::FileOperation::isPaused() const
+{
+    Q_D(const FileOperation);
+
+    return d->mPaused;
+}
+
+void graceful::FileOperation::onProgressTimeout()
+{
+    Q_D(FileOperation);
+
+    quint64 doneBytes = d->mDoneBytes.load();
+    quint64 doneFiles = d->mDoneFiles.load();
+    quint64 totalBytes = d->mTotalBytes.load();
+    quint64 totalFiles = d->mTotalFiles.load();
+
+    // nothing new, nothing to repaint
+    if (doneBytes == d->mReportedBytes && doneFiles == d->mReportedFiles && totalBytes + totalFiles == d->mReportedTotal) {
+        return;
+    }
+
+    d->mReportedBytes = doneBytes;
+    d->mReportedFiles = doneFiles;
+    d->mReportedTotal = totalBytes + totalFiles;
+
+    Q_EMIT progress(doneBytes, totalBytes, doneFiles, totalFiles);
+}
+
+void graceful::FileOperation::onErrorsReady()
+{
+    Q_D(FileOperation);
+
+    QList<QPair<QString, QString>> errors;
+    {
+        QMutexLocker locker(&d->mErrorLock);
+        errors.swap(d->mPendingErrors);
+        d->mErrorsScheduled = false;
+    }
+
+    for (auto e : errors) {
+        Q_EMIT errored(e.first, e.second);
+    }
+}
+
+void graceful::FileOperation::onRunFinished()
+{
+    Q_D(FileOperation);
+
+    d->mRunner->wait();
+    delete d->mRunner;
+    d->mRunner = nullptr;
+
+    qDeleteAll(d->mWorkers);
+    d->mWorkers.clear();
+
+    d->mProgressTimer->stop();
+    onErrorsReady();
+
+    d->mRunning = false;
+
+    if (g_cancellable_is_cancelled(d->mCancellable)) {
+        Q_EMIT cancelled();
+    } else {
+        onProgressTimeout();
+        Q_EMIT finished(d->mFailedItems.isEmpty());
+    }
+
+    if (d->mAutoDelete) {
+        deleteLater();
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef FILEOPERATION_H
+#define FILEOPERATION_H
+
+#include "globals.h"
+
+#include <QObject>
+#include <QStringList>
+
+namespace graceful
+{
+class FileOperationPrivate;
+
+/**
+ * @brief
+ * Copies, moves, deletes or trashes a list of uris in the background.
+ *
+ * Local files are handled without GIO: a move is a rename() when source and
+ * destination share a filesystem, a copy tries a reflink (FICLONE), then
+ * copy_file_range(), then read()/write() through a large aligned buffer.
+ * Files are copied and deleted by a pool of worker threads, so trees of many
+ * small files don't wait on one file at a time. Other uris go through GIO
+ * one file at a time.
+ *
+ * Totals grow while the sources are walked, progress() is emitted at most
+ * once per interval in the thread which owns this object.
+ */
+class GRACEFUL_API FileOperation : public QObject
+{
+    Q_OBJECT
+public:
+    enum Type
+    {
+        Copy,
+        Move,
+        Delete,                         // permanently
+        Trash
+    };
+    Q_ENUM(Type)
+
+    enum ConflictPolicy
+    {
+        ConflictRename,                 // "name (2).ext", the default
+        ConflictSkip,
+        ConflictOverwrite               // files are replaced, directories merged
+    };
+    Q_ENUM(ConflictPolicy)
+
+    /**
+     * @brief
+     * 'destination' is the directory the sources are copied or moved into,
+     * unused for Delete and Trash
+     */
+    explicit FileOperation(Type type, const QStringList& sources, const QString& destination = QString(), QObject *parent = nullptr);
+    ~FileOperation();
+
+    void setAutoDelete(bool autoDelete=true);
+    void setConflictPolicy(ConflictPolicy policy);
+
+    /**
+     * @brief
+     * files handled at once, default is QThread::idealThreadCount() but at least 4
+     */
+    void setThreadCount(int count);
+
+    /**
+     * @brief
+     * progress() is emitted at most once per 'ms', default 200
+     */
+    void setProgressInterval(int ms);
+
+    Type type() const;
+
+    void startAsync();
+    void pause();
+    void resume();
+    void cancel();
+
+    bool isRunning() const;
+    bool isPaused() const;
+
+Q_SIGNALS:
+    void progress(quint64 doneBytes, quint64 totalBytes, quint64 doneFiles, quint64 totalFiles);
+    void errored(const QString& uri, const QString& message);
+    void finished(bool successed=false);
+    void cancelled();
+
+private Q_SLOTS:
+    void onProgressTimeout();
+    void onErrorsReady();
+    void onRunFinished();
+
+private:
+    FileOperationPrivate*               d_ptr = nullptr;
+    Q_DISABLE_COPY(FileOperation)
+    Q_DECLARE_PRIVATE(FileOperation)
+};
+}
+
+#endif // FILEOPERATION_H
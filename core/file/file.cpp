@@ -1,40 +1,60 @@
 #include "file.h"
 #include "log/log.h"
 #include "utils/utils.h"
+#include "file-info-cache.h"
+#include "mime-classifier.h"
 #include "regular-file-type.h"
 #include "thumbnail-manager.h"
 
 #include <QUrl>
+#include <QFile>
 #include <QIcon>
 #include <QDebug>
-#include <QRegExp>
 #include <private/qobject_p.h>
 
 namespace graceful
 {
-// .jpg, .jpeg, .jfif, .pjpeg, .pjp, .png
-QRegExp gImageFile("(\\.jpg|\\.jpeg|\\.jfif|\\.pjpeg|\\.pjp|\\.png)$");
-
 class FilePrivate : public QObjectPrivate
 {
     Q_DECLARE_PUBLIC(File)
 public:
-    explicit FilePrivate(File* f, QString uri);
+    explicit FilePrivate(File* f, const Uri& uri);
     ~FilePrivate();
 
     void queryFileType();
+    void queryMimeType();
+    void dropDerived(File::Attributes attrs);
 
     void queryAccessInfo();
 
+    bool ensureInfo(File::Attributes attrs);
+    bool loadFromCache(File::Attributes attrs);
+    bool getBoolean(const char* attr, bool def);
+
+    void mergeInfo(GFileInfo* info);
+    void mergeSnapshot(const FileInfoPtr& snapshot);
+
+    const QString& cacheKey();
+
+    static GAsyncReadyCallback queryInfoAsyncCB(GFile*, GAsyncResult*, gpointer);
+
 public:
     GFile*                              mFile = nullptr;
-    GFileInfo*                          mFileStandardInfo = nullptr;
+    GFileInfo*                          mFileInfo = nullptr;                // every loaded attribute group is merged here
+    bool                                mFileInfoShared = false;            // mFileInfo belongs to a FileInfo snapshot, copy before writing
+    GCancellable*                       mCancellable = nullptr;
+
+    Uri                                 mUri;
+    QString                             mNativePath = nullptr;              // g_file_get_path() of non file:// uris, e.g. a gvfs fuse path
+    bool                                mNativePathQueried = false;
+    QString                             mCacheKey = nullptr;                // uri as GFile prints it, uri() and key of FileInfoCache
 
-    QString                             mUri = nullptr;
-    QString                             mSchema = nullptr;
+    File::Attributes                    mLoaded = File::AttributeNone;
+    File::Attributes                    mPending = File::AttributeNone;
 
     GFileType                           mFileType = G_FILE_TYPE_UNKNOWN;
     MIMEType                            mFileMimeType = FILE_TYPE_UNKNOW;
+    bool                                mMimeTypeQueried = false;
 
     bool                                mQueryAccess = false;
     bool                                mCanRead = true;
@@ -50,37 +70,92 @@ public:
     File*                               q_ptr = nullptr;
 };
 
-FilePrivate::FilePrivate(File* f, QString uri) : QObjectPrivate(), q_ptr(f)
+struct QueryInfoAsyncData
 {
-    if (uri.split("://").size() == 2) {
-        mUri = uri;
-    } else if (uri.startsWith("/")) {
-        mUri = "file://" + uri;
-    }
-
-    log_debug("new file by uri:%s", mUri.toUtf8().constData());
+    FilePrivate*                        d = nullptr;
+    File::Attributes                    attrs;
+};
 
-    if (!mUri.isNull() && !mUri.isEmpty()) {
-        mFile = g_file_new_for_uri(Utils::urlEncode(mUri).toUtf8().constData());
-        mFileStandardInfo = g_file_query_info(mFile, "standard::*", G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, nullptr, nullptr);
+FilePrivate::FilePrivate(File* f, const Uri& uri) : QObjectPrivate(), mUri(uri), q_ptr(f)
+{
+    log_debug("new file by uri:%s", mUri.toEncoded().constData());
 
-        QStringList ls = mUri.split("://");
-        if (2 == ls.size()) {
-            mSchema = ls.first();
-        }
+    // no I/O here, attributes are loaded on demand
+    if (mUri.isValid()) {
+        mFile = g_file_new_for_uri(mUri.toEncoded().constData());
     }
+
+    mFileInfo = g_file_info_new();
+    mCancellable = g_cancellable_new();
 }
 
 FilePrivate::~FilePrivate()
 {
+    if (mCancellable)                       g_cancellable_cancel(mCancellable);
+    if (mCancellable)                       g_object_unref(mCancellable);
     if (mFile)                              g_object_unref(mFile);
-    if (mFileStandardInfo)                  g_object_unref(mFileStandardInfo);
+    if (mFileInfo)                          g_object_unref(mFileInfo);
 }
 
 void FilePrivate::queryFileType()
 {
     if (G_FILE_TYPE_UNKNOWN == mFileType) {
-        mFileType = g_file_query_file_type(mFile, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, nullptr);
+        ensureInfo(File::AttributeStandard);
+        if (g_file_info_has_attribute(mFileInfo, G_FILE_ATTRIBUTE_STANDARD_TYPE)) {
+            mFileType = g_file_info_get_file_type(mFileInfo);
+        }
+    }
+}
+
+void FilePrivate::queryMimeType()
+{
+    if (mMimeTypeQueried) {
+        return;
+    }
+
+    queryFileType();
+
+    switch (mFileType) {
+    case G_FILE_TYPE_DIRECTORY:
+        mFileMimeType = FILE_TYPE_DIRECTORY;
+        break;
+    case G_FILE_TYPE_SYMBOLIC_LINK:
+        mFileMimeType = FILE_TYPE_SYMBOLIC_LINK;
+        break;
+    case G_FILE_TYPE_REGULAR: {
+        const QString& name = mUri.basename();
+        mFileMimeType = MimeClassifier::fromFileName(name);
+        if (FILE_TYPE_UNKNOW != mFileMimeType) {
+            break;
+        }
+
+        // GIO has guessed it already when the standard group came with a content type
+        if (g_file_info_has_attribute(mFileInfo, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE)) {
+            mFileMimeType = MimeClassifier::fromContentType(g_file_info_get_content_type(mFileInfo));
+        }
+
+        if (FILE_TYPE_UNKNOW == mFileMimeType && !MimeClassifier::hasExtension(name) && mUri.isLocal()) {
+            mFileMimeType = MimeClassifier::fromFile(QFile::encodeName(mUri.path()).constData());
+        }
+        break;
+    }
+    default:
+        mFileMimeType = FILE_TYPE_UNKNOW;
+        break;
+    }
+
+    mMimeTypeQueried = true;
+}
+
+void FilePrivate::dropDerived(File::Attributes attrs)
+{
+    if (attrs & File::AttributeAccess) {
+        mQueryAccess = false;
+    }
+
+    if (attrs & File::AttributeStandard) {
+        mFileType = G_FILE_TYPE_UNKNOWN;
+        mMimeTypeQueried = false;
     }
 }
 
@@ -88,93 +163,226 @@ void FilePrivate::queryAccessInfo()
 {
     gf_return_if_fail(G_IS_FILE(mFile));
 
+    ensureInfo(File::AttributeAccess);
+
+    mCanRead = getBoolean(G_FILE_ATTRIBUTE_ACCESS_CAN_READ, true);
+    mCanWrite = getBoolean(G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE, true);
+    mCanExecute = getBoolean(G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE, true);
+    mCanDelete = getBoolean(G_FILE_ATTRIBUTE_ACCESS_CAN_DELETE, true);
+    mCanTrash = getBoolean(G_FILE_ATTRIBUTE_ACCESS_CAN_TRASH, true);
+    mCanRename = getBoolean(G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME, true);
+
+    mQueryAccess = true;
+}
+
+bool FilePrivate::ensureInfo(File::Attributes attrs)
+{
+    File::Attributes missing = attrs & ~mLoaded;
+    if (File::AttributeNone == missing) {
+        return true;
+    }
+
+    gf_return_val_if_fail(G_IS_FILE(mFile), false);
+
+    if (loadFromCache(missing)) {
+        return true;
+    }
+
     GError* error = nullptr;
-    g_autoptr(GFileInfo) fileInfo = g_file_query_info(mFile, "access::*", G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, nullptr, &error);
+    QByteArray attrStr = File::attributesToString(missing).toUtf8();
+    g_autoptr(GFileInfo) fileInfo = g_file_query_info(mFile, attrStr.constData(), G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, nullptr, &error);
+
+    // a failed group is marked as loaded too, so the getters don't stat again and again
+    mLoaded |= missing;
+
     if (error) {
-        log_error("query file info access:: error: %d -- %s", error->code, error->message);
+        log_error("query file info '%s' error: %d -- %s", attrStr.constData(), error->code, error->message);
         g_error_free(error);
-        return;
+        return false;
     }
 
-    if (g_file_info_has_attribute(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_READ)) {
-        mCanRead = g_file_info_get_attribute_boolean(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_READ);
+    mergeSnapshot(FileInfoCache::getInstance()->insert(cacheKey(), fileInfo, missing));
+
+    return true;
+}
+
+bool FilePrivate::loadFromCache(File::Attributes attrs)
+{
+    FileInfoPtr cached = FileInfoCache::getInstance()->lookup(cacheKey(), attrs);
+    if (!cached) {
+        return false;
     }
 
-    if (g_file_info_has_attribute(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE)) {
-        mCanWrite = g_file_info_get_attribute_boolean(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE);
+    mergeSnapshot(cached);
+    mLoaded |= attrs;
+
+    return true;
+}
+
+void FilePrivate::mergeInfo(GFileInfo* info)
+{
+    gf_return_if_fail(G_IS_FILE_INFO(info));
+
+    if (mFileInfoShared) {
+        GFileInfo* own = g_file_info_dup(mFileInfo);
+        g_object_unref(mFileInfo);
+        mFileInfo = own;
+        mFileInfoShared = false;
     }
 
-    if (g_file_info_has_attribute(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE)) {
-        mCanExecute = g_file_info_get_attribute_boolean(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE);
+    Utils::mergeFileInfo(mFileInfo, info);
+}
+
+void FilePrivate::mergeSnapshot(const FileInfoPtr& snapshot)
+{
+    gf_return_if_fail(snapshot);
+
+    GFileInfo* info = const_cast<GFileInfo*>(snapshot->getGFileInfo());
+
+    // nothing loaded yet, share the snapshot instead of copying it
+    if (File::AttributeNone == (mLoaded & ~snapshot->attributes()) && G_IS_FILE_INFO(info)) {
+        if (mFileInfo)                      g_object_unref(mFileInfo);
+        mFileInfo = G_FILE_INFO(g_object_ref(info));
+        mFileInfoShared = true;
+        return;
     }
 
-    if (g_file_info_has_attribute(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_DELETE)) {
-        mCanDelete = g_file_info_get_attribute_boolean(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_DELETE);
+    mergeInfo(info);
+}
+
+bool FilePrivate::getBoolean(const char* attr, bool def)
+{
+    if (g_file_info_has_attribute(mFileInfo, attr)) {
+        return g_file_info_get_attribute_boolean(mFileInfo, attr);
     }
 
-    if (g_file_info_has_attribute(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_TRASH)) {
-        mCanTrash = g_file_info_get_attribute_boolean(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_TRASH);
+    return def;
+}
+
+const QString& FilePrivate::cacheKey()
+{
+    if (mCacheKey.isNull() && G_IS_FILE(mFile)) {
+        g_autofree char* uri = g_file_get_uri(mFile);
+        mCacheKey = uri;
     }
 
-    if (g_file_info_has_attribute(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME)) {
-        mCanRename = g_file_info_get_attribute_boolean(fileInfo, G_FILE_ATTRIBUTE_ACCESS_CAN_RENAME);
+    return mCacheKey;
+}
+
+GAsyncReadyCallback FilePrivate::queryInfoAsyncCB(GFile* file, GAsyncResult* res, gpointer udata)
+{
+    QueryInfoAsyncData* data = static_cast<QueryInfoAsyncData*>(udata);
+
+    GError* error = nullptr;
+    g_autoptr(GFileInfo) fileInfo = g_file_query_info_finish(file, res, &error);
+
+    // File was destroyed
+    if (error && G_IO_ERROR_CANCELLED == error->code) {
+        g_error_free(error);
+        delete data;
+        return nullptr;
     }
-    mQueryAccess = true;
+
+    FilePrivate* d = data->d;
+    File::Attributes attrs = data->attrs;
+    delete data;
+
+    d->mPending &= ~attrs;
+    d->mLoaded |= attrs;
+
+    if (error) {
+        log_error("query file info async error: %d -- %s", error->code, error->message);
+        g_error_free(error);
+        Q_EMIT d->q_func()->infoLoaded(attrs, false);
+        return nullptr;
+    }
+
+    d->mergeSnapshot(FileInfoCache::getInstance()->insert(d->cacheKey(), fileInfo, attrs));
+
+    // drop what was derived from an older info
+    d->dropDerived(attrs);
+
+    Q_EMIT d->q_func()->infoLoaded(attrs, true);
+
+    return nullptr;
 }
 
 }
 
 
-graceful::File::File(QString uri, QObject *parent) : QObject(parent), d_ptr(new FilePrivate(this, uri))
+graceful::File::File(QString uri, QObject *parent) : QObject(parent), d_ptr(new FilePrivate(this, Uri(uri)))
 {
 
 }
 
-graceful::File::~File()
+graceful::File::File(const Uri& uri, QObject *parent) : QObject(parent), d_ptr(new FilePrivate(this, uri))
+{
+
+}
+
+graceful::File::File(QString uri, Attributes prefetch, QObject *parent) : QObject(parent), d_ptr(new FilePrivate(this, Uri(uri)))
 {
+    queryInfoAsync(prefetch);
+}
 
+graceful::File::~File()
+{
+    delete d_ptr;
 }
 
 QString graceful::File::uri()
 {
     Q_D(File);
 
-    g_autofree char* uri = g_file_get_uri(d->mFile);
+    // the form GIO prints, what listings and monitors report for the same file
+    const QString& uri = d->cacheKey();
 
-    return uri;
+    return uri.isNull() ? d->mUri.toString() : uri;
 }
 
 QString graceful::File::path()
 {
     Q_D(File);
 
-    g_autofree char* path = g_file_get_path(d->mFile);
+    if (d->mUri.isLocal()) {
+        return d->mUri.path();
+    }
 
-    return path;
+    if (!d->mNativePathQueried && d->mFile) {
+        g_autofree char* path = g_file_get_path(d->mFile);
+        d->mNativePath = path;
+        d->mNativePathQueried = true;
+    }
+
+    return d->mNativePath;
 }
 
 QString graceful::File::schema()
 {
     Q_D(File);
-    if (!d->mSchema.isNull() && !d->mSchema.isEmpty()) {
-        return d->mSchema;
-    }
 
-    return "";
+    return d->mUri.scheme();
 }
 
 QString graceful::File::fileName()
 {
     Q_D(File);
 
-    g_autofree char* name = g_file_get_basename(d->mFile);
-
-    return name;
+    return d->mUri.basename();
 }
 
 QString graceful::File::uriDisplay()
 {
-    return Utils::urlDecode(uri());
+    Q_D(File);
+
+    return d->mUri.displayUri();
+}
+
+const graceful::Uri& graceful::File::getUri() const
+{
+    Q_D(const File);
+
+    return d->mUri;
 }
 
 QString graceful::File::getContentType()
@@ -185,9 +393,11 @@ QString graceful::File::getContentType()
         return d->mContentType;
     }
 
-    gf_return_val_if_fail(G_IS_FILE_INFO(d->mFileStandardInfo), nullptr);
+    d->ensureInfo(AttributeStandard);
+
+    gf_return_val_if_fail(g_file_info_has_attribute(d->mFileInfo, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE), "");
 
-    d->mContentType = g_file_info_get_content_type(d->mFileStandardInfo);
+    d->mContentType = g_file_info_get_content_type(d->mFileInfo);
 
     gf_return_val_if_fail(!d->mContentType.isNull() && !d->mContentType.isEmpty(), "");
 
@@ -206,6 +416,8 @@ int graceful::File::getMIMEType()
 {
     Q_D(File);
 
+    d->queryMimeType();
+
     return d->mFileMimeType;
 }
 
@@ -215,27 +427,16 @@ bool graceful::File::isDir()
 
     d->queryFileType();
 
-    if (d->mFileType == G_FILE_TYPE_DIRECTORY) {
-        d->mFileMimeType = FILE_TYPE_DIRECTORY;
-    }
-
-    return false;
+    return d->mFileType == G_FILE_TYPE_DIRECTORY;
 }
 
 bool graceful::File::isImage()
 {
     Q_D(File);
 
-    if (FILE_TYPE_IMAGE == d->mFileMimeType) {
-        return true;
-    }
-
-    if (isRegularFile() && path().contains(gImageFile)) {
-        d->mFileMimeType = FILE_TYPE_IMAGE;
-        return true;
-    }
+    d->queryMimeType();
 
-    return false;
+    return FILE_TYPE_IMAGE == d->mFileMimeType;
 }
 
 bool graceful::File::isRegularFile()
@@ -251,6 +452,11 @@ bool graceful::File::isValid()
 {
     Q_D(File);
 
+    // the standard group was queried successfully, so the file exists
+    if ((d->mLoaded & AttributeStandard) && g_file_info_has_attribute(d->mFileInfo, G_FILE_ATTRIBUTE_STANDARD_TYPE)) {
+        return true;
+    }
+
     return g_file_query_exists(d->mFile, nullptr);
 }
 
@@ -330,6 +536,116 @@ bool graceful::File::canRename()
     return d->mCanRename;
 }
 
+quint64 graceful::File::size()
+{
+    Q_D(File);
+
+    d->ensureInfo(AttributeStandard);
+
+    return g_file_info_get_attribute_uint64(d->mFileInfo, G_FILE_ATTRIBUTE_STANDARD_SIZE);
+}
+
+quint64 graceful::File::modifyTime()
+{
+    Q_D(File);
+
+    d->ensureInfo(AttributeTime);
+
+    return g_file_info_get_attribute_uint64(d->mFileInfo, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+}
+
+QString graceful::File::owner()
+{
+    Q_D(File);
+
+    d->ensureInfo(AttributeOwner);
+
+    return g_file_info_get_attribute_string(d->mFileInfo, G_FILE_ATTRIBUTE_OWNER_USER);
+}
+
+QString graceful::File::group()
+{
+    Q_D(File);
+
+    d->ensureInfo(AttributeOwner);
+
+    return g_file_info_get_attribute_string(d->mFileInfo, G_FILE_ATTRIBUTE_OWNER_GROUP);
+}
+
+QString graceful::File::thumbnailPath()
+{
+    Q_D(File);
+
+    d->ensureInfo(AttributeThumbnail);
+
+    return g_file_info_get_attribute_byte_string(d->mFileInfo, G_FILE_ATTRIBUTE_THUMBNAIL_PATH);
+}
+
+graceful::File::Attributes graceful::File::loadedAttributes() const
+{
+    Q_D(const File);
+
+    return d->mLoaded;
+}
+
+bool graceful::File::queryInfo(Attributes attrs)
+{
+    Q_D(File);
+
+    return d->ensureInfo(attrs);
+}
+
+void graceful::File::queryInfoAsync(Attributes attrs)
+{
+    Q_D(File);
+
+    Attributes missing = attrs & ~(d->mLoaded | d->mPending);
+
+    gf_return_if_fail(G_IS_FILE(d->mFile));
+
+    if (AttributeNone == missing) {
+        return;
+    }
+
+    if (d->loadFromCache(missing)) {
+        d->dropDerived(missing);
+        Q_EMIT infoLoaded(missing, true);
+        return;
+    }
+
+    d->mPending |= missing;
+
+    QueryInfoAsyncData* data = new QueryInfoAsyncData;
+    data->d = d;
+    data->attrs = missing;
+
+    g_file_query_info_async(d->mFile, attributesToString(missing).toUtf8().constData(), G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, G_PRIORITY_DEFAULT, d->mCancellable, GAsyncReadyCallback(d->queryInfoAsyncCB), data);
+}
+
+void graceful::File::setFileInfo(const GFileInfo* info, Attributes attrs)
+{
+    Q_D(File);
+
+    gf_return_if_fail(G_IS_FILE_INFO(info));
+
+    d->mergeSnapshot(FileInfoCache::getInstance()->insert(d->cacheKey(), info, attrs));
+    d->mLoaded |= attrs;
+
+    d->dropDerived(attrs);
+}
+
+void graceful::File::setFileInfo(const FileInfoPtr& info)
+{
+    Q_D(File);
+
+    gf_return_if_fail(info);
+
+    d->mergeSnapshot(info);
+    d->mLoaded |= info->attributes();
+
+    d->dropDerived(info->attributes());
+}
+
 const GFile* graceful::File::getGFile()
 {
     Q_D(File);
@@ -341,6 +657,21 @@ const GFileInfo* graceful::File::getGFileStandardInfo()
 {
     Q_D(File);
 
-    return d->mFileStandardInfo;
+    d->ensureInfo(AttributeStandard);
+
+    return d->mFileInfo;
+}
+
+QString graceful::File::attributesToString(Attributes attrs)
+{
+    QStringList ls;
+
+    if (attrs & AttributeStandard)          ls << "standard::*";
+    if (attrs & AttributeAccess)            ls << "access::*";
+    if (attrs & AttributeTime)              ls << "time::*";
+    if (attrs & AttributeOwner)             ls << "owner::*" << "unix::*";
+    if (attrs & AttributeThumbnail)         ls << "thumbnail::*";
+
+    return ls.join(",");
 }
 
@@ -2,20 +2,50 @@
 #define FILE_H
 
 #include <QObject>
+#include <QSharedPointer>
 #include "globals.h"
+#include "uri.h"
 #include <gio/gio.h>
 
 namespace graceful
 {
+class FileInfo;
 class FilePrivate;
+typedef QSharedPointer<const FileInfo> FileInfoPtr;
 
 class GRACEFUL_API File : public QObject
 {
     Q_OBJECT
 public:
+    /**
+     * @brief
+     * Groups of GFileInfo attributes. Constructing a File does no I/O, a group
+     * is queried the first time one of its getters is used, or ahead of time
+     * with queryInfo()/queryInfoAsync().
+     */
+    enum Attribute
+    {
+        AttributeNone           = 0,
+        AttributeStandard       = 1 << 0,           // standard::*
+        AttributeAccess         = 1 << 1,           // access::*
+        AttributeTime           = 1 << 2,           // time::*
+        AttributeOwner          = 1 << 3,           // owner::*, unix::*
+        AttributeThumbnail      = 1 << 4,           // thumbnail::*
+        AttributeAll            = AttributeStandard | AttributeAccess | AttributeTime | AttributeOwner | AttributeThumbnail
+    };
+    Q_DECLARE_FLAGS(Attributes, Attribute)
+    Q_FLAG(Attributes)
+
     explicit File(QString uri, QObject* parent = nullptr);
+    explicit File(const Uri& uri, QObject* parent = nullptr);
+    explicit File(QString uri, Attributes prefetch, QObject* parent = nullptr);
     ~File();
 
+    /**
+     * @brief
+     * the uri as GIO prints it, it compares equal to the ones of listings
+     * and monitors. getUri() keeps the form File was built from
+     */
     QString uri();
     QString path();
     QString schema();
@@ -23,6 +53,12 @@ public:
     QString uriDisplay();
     QString getContentType();
 
+    /**
+     * @brief
+     * the parsed uri, shared with the one File was built from
+     */
+    const Uri& getUri() const;
+
     QIcon icon();
     int getMIMEType();
 
@@ -40,12 +76,51 @@ public:
     bool canTrash();
     bool canRename();
 
+    quint64 size();
+    quint64 modifyTime();
+    QString owner();
+    QString group();
+    QString thumbnailPath();
+
+    /**
+     * @brief
+     * attribute groups already loaded, reading them does no I/O
+     */
+    Attributes loadedAttributes() const;
+
+    /**
+     * @brief
+     * blocking query of the groups in 'attrs' that are not loaded yet
+     */
+    BLOCKING bool queryInfo(Attributes attrs);
 
+    /**
+     * @brief
+     * query the missing groups in 'attrs' in the GMainContext, emit infoLoaded() when done
+     */
+    NO_BLOCKING void queryInfoAsync(Attributes attrs);
+
+    /**
+     * @brief
+     * fill the groups in 'attrs' from an info which was already queried,
+     * e.g. by a GFileEnumerator. 'info' is published to FileInfoCache and
+     * may be shared with other Files, it must not be modified afterwards
+     */
+    void setFileInfo(const GFileInfo* info, Attributes attrs);
+
+    /**
+     * @brief
+     * fill the groups held by a FileInfoCache snapshot, the snapshot is shared, not copied
+     */
+    void setFileInfo(const FileInfoPtr& info);
 
     const GFile* getGFile();
     const GFileInfo* getGFileStandardInfo();
 
+    static QString attributesToString(Attributes attrs);
+
 Q_SIGNALS:
+    void infoLoaded(Attributes attrs, bool successed);
 
 private:
     FilePrivate*                d_ptr = nullptr;
@@ -54,4 +129,6 @@ private:
 };
 }
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(graceful::File::Attributes)
+
 #endif // FILE_H
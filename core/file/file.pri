@@ -1,12 +1,38 @@
+INCLUDEPATH += $$PWD
+
 HEADERS += \
+    $$PWD/dir-size-calculator.h         \
     $$PWD/file-enumerator.h             \
+    $$PWD/file-info-cache.h             \
+    $$PWD/file-operation.h              \
+    $$PWD/local-dir-reader.h            \
+    $$PWD/mime-classifier.h             \
+    $$PWD/recursive-file-enumerator.h   \
+    $$PWD/statx-fetcher.h               \
+    $$PWD/uri.h                         \
+    $$PWD/uri-atoms.h                   \
     $$PWD/file.h
 
 SOURCES += \
+    $$PWD/dir-size-calculator.cpp       \
     $$PWD/file-enumerator.cpp           \
+    $$PWD/file-info-cache.cpp           \
+    $$PWD/file-operation.cpp            \
+    $$PWD/local-dir-reader.cpp          \
+    $$PWD/mime-classifier.cpp           \
+    $$PWD/recursive-file-enumerator.cpp \
+    $$PWD/statx-fetcher.cpp             \
+    $$PWD/uri.cpp                       \
+    $$PWD/uri-atoms.cpp                 \
     $$PWD/file.cpp
 
 
 FILE_FILE_HEADERS = \
     $$PWD/file.h                        \
+    $$PWD/dir-size-calculator.h         \
     $$PWD/file-enumerator.h             \
+    $$PWD/file-info-cache.h             \
+    $$PWD/file-operation.h              \
+    $$PWD/recursive-file-enumerator.h   \
+    $$PWD/uri.h                         \
+    $$PWD/uri-atoms.h                   \
@@ -0,0 +1,314 @@
+#include "local-dir-reader.h"
+
+#include "log/log.h"
+#include "statx-fetcher.h"
+
+#include <grp.h>
+#include <errno.h>
+#include <pwd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#define LOCAL_DIR_READER_BUFFER_SIZE        (128 * 1024)        // a few thousand entries per getdents64()
+#define LOCAL_DIR_READER_SNIFF_SIZE         4096                // same as GIO's local backend
+
+namespace graceful
+{
+static GFileType fileType(quint32 mode)
+{
+    if (S_ISREG(mode))              return G_FILE_TYPE_REGULAR;
+    if (S_ISDIR(mode))              return G_FILE_TYPE_DIRECTORY;
+    if (S_ISLNK(mode))              return G_FILE_TYPE_SYMBOLIC_LINK;
+
+    return G_FILE_TYPE_SPECIAL;
+}
+
+static void setErrorFromErrno(GError** error, int errsv, const char* fmt, const char* path)
+{
+    g_autofree char* display = g_filename_display_name(path);
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(errsv), fmt, display, g_strerror(errsv));
+}
+}
+
+
+graceful::LocalDirReader::LocalDirReader(const QByteArray& path, File::Attributes attrs) : mPath(path), mAttributes(attrs)
+{
+
+}
+
+graceful::LocalDirReader::~LocalDirReader()
+{
+    if (mFd >= 0)                           close(mFd);
+    if (mBuffer)                            g_free(mBuffer);
+
+    for (auto i : mIcons)                   g_object_unref(i);
+    for (auto i : mSymbolicIcons)           g_object_unref(i);
+}
+
+bool graceful::LocalDirReader::isSupported(File::Attributes attrs)
+{
+    return !(attrs & (File::AttributeAccess | File::AttributeThumbnail));
+}
+
+bool graceful::LocalDirReader::isOpened() const
+{
+    return mFd >= 0;
+}
+
+bool graceful::LocalDirReader::open(GError** error)
+{
+    gf_return_val_if_fail(mFd < 0, true);
+
+    mFd = ::open(mPath.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (mFd < 0) {
+        setErrorFromErrno(error, errno, "Error opening directory '%s': %s", mPath.constData());
+        return false;
+    }
+
+    mBuffer = static_cast<char*>(g_malloc(LOCAL_DIR_READER_BUFFER_SIZE));
+
+    return true;
+}
+
+bool graceful::LocalDirReader::nextFiles(int num, QStringList& uris, QList<GFileInfo*>& infos, GCancellable* cancellable, GError** error)
+{
+    gf_return_val_if_fail(mFd >= 0, false);
+
+    // names first, then the whole batch is stated at once
+    int added = 0;
+    bool end = false;
+    while (added < num && !end) {
+        QList<QByteArray> names;
+        while (names.size() < num - added) {
+            if (mBufferPos >= mBufferLen) {
+                if (g_cancellable_set_error_if_cancelled(cancellable, error)) {
+                    return false;
+                }
+
+                long len = syscall(SYS_getdents64, mFd, mBuffer, LOCAL_DIR_READER_BUFFER_SIZE);
+                if (len < 0) {
+                    if (EINTR == errno) {
+                        continue;
+                    }
+                    setErrorFromErrno(error, errno, "Error reading directory '%s': %s", mPath.constData());
+                    return false;
+                }
+
+                if (0 == len) {
+                    end = true;
+                    break;
+                }
+
+                mBufferLen = len;
+                mBufferPos = 0;
+            }
+
+            struct dirent64* ent = reinterpret_cast<struct dirent64*>(mBuffer + mBufferPos);
+            mBufferPos += ent->d_reclen;
+
+            const char* name = ent->d_name;
+            if ('.' == name[0] && ('\0' == name[1] || ('.' == name[1] && '\0' == name[2]))) {
+                continue;
+            }
+
+            names << QByteArray(name);
+        }
+
+        if (g_cancellable_set_error_if_cancelled(cancellable, error)) {
+            return false;
+        }
+
+        QVector<struct statx> stats;
+        QVector<int> results;
+        mFetcher.fetch(mFd, names, statxMask(), stats, results);
+
+        for (int i = 0; i < names.size(); ++i) {
+            const char* name = names.at(i).constData();
+
+            // removed between getdents64() and statx()
+            if (0 != results.at(i)) {
+                log_debug("stat '%s/%s' error: %s", mPath.constData(), name, g_strerror(results.at(i)));
+                continue;
+            }
+
+            GFileInfo* info = g_file_info_new();
+            fill(info, name, stats.at(i));
+
+            g_autofree char* path = g_build_filename(mPath.constData(), name, nullptr);
+            g_autofree char* uri = g_filename_to_uri(path, nullptr, nullptr);
+
+            uris << uri;
+            infos << info;
+            ++added;
+        }
+    }
+
+    return true;
+}
+
+unsigned int graceful::LocalDirReader::statxMask() const
+{
+    unsigned int mask = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_BLOCKS;
+    if (mAttributes & File::AttributeTime) {
+        mask |= STATX_ATIME | STATX_MTIME | STATX_CTIME | STATX_BTIME;
+    }
+    if (mAttributes & File::AttributeOwner) {
+        mask |= STATX_UID | STATX_GID | STATX_NLINK | STATX_INO;
+    }
+
+    return mask;
+}
+
+void graceful::LocalDirReader::fill(GFileInfo* info, const char* name, const struct statx& st)
+{
+    g_file_info_set_name(info, name);
+
+    if (mAttributes & File::AttributeStandard) {
+        if (g_utf8_validate(name, -1, nullptr)) {
+            g_file_info_set_display_name(info, name);
+            g_file_info_set_edit_name(info, name);
+        } else {
+            g_autofree char* display = g_filename_display_name(name);
+            g_file_info_set_display_name(info, display);
+            g_file_info_set_edit_name(info, display);
+        }
+
+        g_file_info_set_file_type(info, fileType(st.stx_mode));
+        g_file_info_set_size(info, goffset(st.stx_size));
+        g_file_info_set_attribute_uint64(info, G_FILE_ATTRIBUTE_STANDARD_ALLOCATED_SIZE, st.stx_blocks * 512);
+        g_file_info_set_is_hidden(info, '.' == name[0]);
+        g_file_info_set_attribute_boolean(info, G_FILE_ATTRIBUTE_STANDARD_IS_BACKUP, g_str_has_suffix(name, "~"));
+        g_file_info_set_is_symlink(info, S_ISLNK(st.stx_mode));
+
+        if (S_ISLNK(st.stx_mode)) {
+            char target[PATH_MAX];
+            ssize_t len = readlinkat(mFd, name, target, sizeof(target) - 1);
+            if (len >= 0) {
+                target[len] = '\0';
+                g_file_info_set_symlink_target(info, target);
+            }
+        }
+
+        QByteArray type = contentType(name, st.stx_mode, st.stx_size);
+        g_file_info_set_content_type(info, type.constData());
+        g_file_info_set_attribute_string(info, G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE, type.constData());
+        g_file_info_set_icon(info, icon(type, false));
+        g_file_info_set_symbolic_icon(info, icon(type, true));
+    }
+
+    if (mAttributes & File::AttributeTime) {
+        g_file_info_set_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED, quint64(st.stx_mtime.tv_sec));
+        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, st.stx_mtime.tv_nsec / 1000);
+        g_file_info_set_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_ACCESS, quint64(st.stx_atime.tv_sec));
+        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_ACCESS_USEC, st.stx_atime.tv_nsec / 1000);
+        g_file_info_set_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_CHANGED, quint64(st.stx_ctime.tv_sec));
+        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_CHANGED_USEC, st.stx_ctime.tv_nsec / 1000);
+        if (st.stx_mask & STATX_BTIME) {
+            g_file_info_set_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_CREATED, quint64(st.stx_btime.tv_sec));
+            g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_CREATED_USEC, st.stx_btime.tv_nsec / 1000);
+        }
+    }
+
+    if (mAttributes & File::AttributeOwner) {
+        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_DEVICE, quint32(makedev(st.stx_dev_major, st.stx_dev_minor)));
+        g_file_info_set_attribute_uint64(info, G_FILE_ATTRIBUTE_UNIX_INODE, st.stx_ino);
+        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_MODE, st.stx_mode);
+        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_NLINK, st.stx_nlink);
+        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_UID, st.stx_uid);
+        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_GID, st.stx_gid);
+        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_RDEV, quint32(makedev(st.stx_rdev_major, st.stx_rdev_minor)));
+        g_file_info_set_attribute_uint32(info, G_FILE_ATTRIBUTE_UNIX_BLOCK_SIZE, st.stx_blksize);
+        g_file_info_set_attribute_uint64(info, G_FILE_ATTRIBUTE_UNIX_BLOCKS, st.stx_blocks);
+
+        const QByteArray& user = userName(st.stx_uid);
+        if (!user.isEmpty()) {
+            g_file_info_set_attribute_string(info, G_FILE_ATTRIBUTE_OWNER_USER, user.constData());
+        }
+
+        const QByteArray& group = groupName(st.stx_gid);
+        if (!group.isEmpty()) {
+            g_file_info_set_attribute_string(info, G_FILE_ATTRIBUTE_OWNER_GROUP, group.constData());
+        }
+    }
+
+}
+
+QByteArray graceful::LocalDirReader::contentType(const char* name, quint32 mode, quint64 size)
+{
+    if (S_ISDIR(mode))              return "inode/directory";
+    if (S_ISLNK(mode))              return "inode/symlink";
+    if (S_ISCHR(mode))              return "inode/chardevice";
+    if (S_ISBLK(mode))              return "inode/blockdevice";
+    if (S_ISFIFO(mode))             return "inode/fifo";
+    if (S_ISSOCK(mode))             return "inode/socket";
+    if (0 == size)                  return "application/x-zerosize";
+
+    gboolean uncertain = FALSE;
+    char* type = g_content_type_guess(name, nullptr, 0, &uncertain);
+
+    // like GIO, only read the head of files the name says nothing about
+    if (uncertain) {
+        int fd = openat(mFd, name, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+        if (fd >= 0) {
+            guchar data[LOCAL_DIR_READER_SNIFF_SIZE];
+            ssize_t len = read(fd, data, sizeof(data));
+            close(fd);
+            if (len > 0) {
+                g_free(type);
+                type = g_content_type_guess(name, data, gsize(len), nullptr);
+            }
+        }
+    }
+
+    QByteArray ret(type);
+    g_free(type);
+
+    return ret;
+}
+
+GIcon* graceful::LocalDirReader::icon(const QByteArray& contentType, bool symbolic)
+{
+    QHash<QByteArray, GIcon*>& icons = symbolic ? mSymbolicIcons : mIcons;
+
+    GIcon* icon = icons.value(contentType, nullptr);
+    if (!icon) {
+        icon = symbolic ? g_content_type_get_symbolic_icon(contentType.constData()) : g_content_type_get_icon(contentType.constData());
+        icons.insert(contentType, icon);
+    }
+
+    return icon;
+}
+
+const QByteArray& graceful::LocalDirReader::userName(quint32 uid)
+{
+    auto it = mUsers.find(uid);
+    if (it == mUsers.end()) {
+        char buf[1024];
+        struct passwd pwd;
+        struct passwd* result = nullptr;
+        getpwuid_r(uid, &pwd, buf, sizeof(buf), &result);
+        it = mUsers.insert(uid, result ? QByteArray(result->pw_name) : QByteArray::number(uid));
+    }
+
+    return it.value();
+}
+
+const QByteArray& graceful::LocalDirReader::groupName(quint32 gid)
+{
+    auto it = mGroups.find(gid);
+    if (it == mGroups.end()) {
+        char buf[1024];
+        struct group grp;
+        struct group* result = nullptr;
+        getgrgid_r(gid, &grp, buf, sizeof(buf), &result);
+        it = mGroups.insert(gid, result ? QByteArray(result->gr_name) : QByteArray::number(gid));
+    }
+
+    return it.value();
+}
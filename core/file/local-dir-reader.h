@@ -0,0 +1,74 @@
+#ifndef LOCALDIRREADER_H
+#define LOCALDIRREADER_H
+
+#include "globals.h"
+#include "file.h"
+#include "statx-fetcher.h"
+
+#include <QHash>
+#include <QByteArray>
+#include <QStringList>
+
+#include <gio/gio.h>
+
+namespace graceful
+{
+/**
+ * @brief
+ * Lists a local directory with getdents64() and batched statx(), see
+ * StatxFetcher. Only the attributes of the requested groups are filled, into
+ * GFileInfos shaped like the ones a GFileEnumerator returns with
+ * G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS.
+ * Used by FileEnumerator for file:// uris, one batch at a time from one thread.
+ */
+class LocalDirReader
+{
+public:
+    explicit LocalDirReader(const QByteArray& path, File::Attributes attrs);
+    ~LocalDirReader();
+
+    /**
+     * @brief
+     * groups which can be filled without GIO, access and thumbnail need GIO
+     */
+    static bool isSupported(File::Attributes attrs);
+
+    bool isOpened() const;
+    BLOCKING bool open(GError** error);
+
+    /**
+     * @brief
+     * read up to 'num' children, 'infos[i]' is the reference owned by the caller
+     * for 'uris[i]'. Less than 'num' added and true returned means end of directory
+     */
+    BLOCKING bool nextFiles(int num, QStringList& uris, QList<GFileInfo*>& infos, GCancellable* cancellable, GError** error);
+
+private:
+    unsigned int statxMask() const;
+    void fill(GFileInfo* info, const char* name, const struct statx& st);
+    QByteArray contentType(const char* name, quint32 mode, quint64 size);
+    GIcon* icon(const QByteArray& contentType, bool symbolic);
+    const QByteArray& userName(quint32 uid);
+    const QByteArray& groupName(quint32 gid);
+
+private:
+    int                                 mFd = -1;
+    char*                               mBuffer = nullptr;
+    long                                mBufferLen = 0;
+    long                                mBufferPos = 0;
+
+    QByteArray                          mPath;
+    File::Attributes                    mAttributes;
+    StatxFetcher                        mFetcher;
+
+    // shared by all entries, content types repeat a lot in one directory
+    QHash<QByteArray, GIcon*>           mIcons;
+    QHash<QByteArray, GIcon*>           mSymbolicIcons;
+    QHash<quint32, QByteArray>          mUsers;
+    QHash<quint32, QByteArray>          mGroups;
+
+    Q_DISABLE_COPY(LocalDirReader)
+};
+}
+
+#endif // LOCALDIRREADER_H
@@ -0,0 +1,285 @@
+#include "mime-classifier.h"
+
+#include "log/log.h"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+// an extension longer than this is not in the table
+#define EXTENSION_MAX           8
+
+// bytes read for sniffing, enough for every signature below and to tell text from binary
+#define SNIFF_LEN               512
+
+namespace graceful
+{
+// FNV-1a over ASCII folded to lower case. The keys are hashed by the compiler
+// into case labels, a collision between two keys is a duplicate case label and
+// breaks the build, so each switch below is a perfect hash of its table.
+static constexpr quint32 fold(quint32 c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static constexpr quint32 keyHash(const char* key, quint32 h = 2166136261u)
+{
+    return *key ? keyHash(key + 1, (h ^ fold(static_cast<unsigned char>(*key))) * 16777619u) : h;
+}
+
+template <typename T>
+static inline quint32 hashOf(const T* str, int len)
+{
+    quint32 h = 2166136261u;
+    for (int i = 0; i < len; ++i) {
+        h = (h ^ fold(static_cast<quint32>(str[i]))) * 16777619u;
+    }
+
+    return h;
+}
+
+template <typename T>
+static inline bool equals(const T* str, int len, const char* key)
+{
+    int i = 0;
+    for (; i < len && key[i]; ++i) {
+        if (fold(static_cast<quint32>(str[i])) != static_cast<unsigned char>(key[i])) {
+            return false;
+        }
+    }
+
+    return i == len && !key[i];
+}
+
+#define MIME_ENTRY(key, type) \
+    case keyHash(key): return equals(str, len, key) ? type : FILE_TYPE_UNKNOW
+
+static MIMEType lookupExtension(const quint16* str, int len)
+{
+    switch (hashOf(str, len)) {
+    // decoded by QImageReader
+    MIME_ENTRY("jpg",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("jpeg",  FILE_TYPE_IMAGE);
+    MIME_ENTRY("jpe",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("jfif",  FILE_TYPE_IMAGE);
+    MIME_ENTRY("pjpeg", FILE_TYPE_IMAGE);
+    MIME_ENTRY("pjp",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("png",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("gif",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("bmp",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("pbm",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("pgm",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("ppm",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("xbm",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("xpm",   FILE_TYPE_IMAGE);
+
+    MIME_ENTRY("mp3",   FILE_TYPE_AUDIO);
+    MIME_ENTRY("ogg",   FILE_TYPE_AUDIO);
+    MIME_ENTRY("oga",   FILE_TYPE_AUDIO);
+    MIME_ENTRY("opus",  FILE_TYPE_AUDIO);
+    MIME_ENTRY("flac",  FILE_TYPE_AUDIO);
+    MIME_ENTRY("wav",   FILE_TYPE_AUDIO);
+    MIME_ENTRY("m4a",   FILE_TYPE_AUDIO);
+    MIME_ENTRY("aac",   FILE_TYPE_AUDIO);
+    MIME_ENTRY("wma",   FILE_TYPE_AUDIO);
+    MIME_ENTRY("ape",   FILE_TYPE_AUDIO);
+
+    MIME_ENTRY("css",   FILE_TYPE_TEXT_CSS);
+    MIME_ENTRY("csv",   FILE_TYPE_TEXT_CSV);
+    MIME_ENTRY("php",   FILE_TYPE_TEXT_PHP);
+    MIME_ENTRY("xml",   FILE_TYPE_TEXT_XML);
+    MIME_ENTRY("html",  FILE_TYPE_TEXT_HTML);
+    MIME_ENTRY("htm",   FILE_TYPE_TEXT_HTML);
+    MIME_ENTRY("xhtml", FILE_TYPE_TEXT_HTML);
+    MIME_ENTRY("txt",   FILE_TYPE_TEXT_PLAIN);
+    MIME_ENTRY("text",  FILE_TYPE_TEXT_PLAIN);
+    MIME_ENTRY("log",   FILE_TYPE_TEXT_PLAIN);
+    default: break;
+    }
+
+    return FILE_TYPE_UNKNOW;
+}
+
+static MIMEType lookupContentType(const char* str, int len)
+{
+    switch (hashOf(str, len)) {
+    MIME_ENTRY("inode/directory",       FILE_TYPE_DIRECTORY);
+    MIME_ENTRY("inode/symlink",         FILE_TYPE_SYMBOLIC_LINK);
+
+    MIME_ENTRY("image/jpeg",            FILE_TYPE_IMAGE);
+    MIME_ENTRY("image/pjpeg",           FILE_TYPE_IMAGE);
+    MIME_ENTRY("image/png",             FILE_TYPE_IMAGE);
+    MIME_ENTRY("image/gif",             FILE_TYPE_IMAGE);
+    MIME_ENTRY("image/bmp",             FILE_TYPE_IMAGE);
+    MIME_ENTRY("image/x-bmp",           FILE_TYPE_IMAGE);
+    MIME_ENTRY("image/x-portable-bitmap",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("image/x-portable-graymap",  FILE_TYPE_IMAGE);
+    MIME_ENTRY("image/x-portable-pixmap",   FILE_TYPE_IMAGE);
+    MIME_ENTRY("image/x-xbitmap",       FILE_TYPE_IMAGE);
+    MIME_ENTRY("image/x-xpixmap",       FILE_TYPE_IMAGE);
+
+    MIME_ENTRY("text/css",              FILE_TYPE_TEXT_CSS);
+    MIME_ENTRY("text/csv",              FILE_TYPE_TEXT_CSV);
+    MIME_ENTRY("application/x-php",     FILE_TYPE_TEXT_PHP);
+    MIME_ENTRY("text/x-php",            FILE_TYPE_TEXT_PHP);
+    MIME_ENTRY("application/xml",       FILE_TYPE_TEXT_XML);
+    MIME_ENTRY("text/xml",              FILE_TYPE_TEXT_XML);
+    MIME_ENTRY("text/html",             FILE_TYPE_TEXT_HTML);
+    MIME_ENTRY("application/xhtml+xml", FILE_TYPE_TEXT_HTML);
+    MIME_ENTRY("text/plain",            FILE_TYPE_TEXT_PLAIN);
+    default: break;
+    }
+
+    return FILE_TYPE_UNKNOW;
+}
+
+#undef MIME_ENTRY
+
+static inline bool startsWith(const unsigned char* data, int len, const char* magic, int magicLen)
+{
+    return len >= magicLen && 0 == memcmp(data, magic, magicLen);
+}
+
+static inline bool startsWithNoCase(const unsigned char* data, int len, const char* magic)
+{
+    int i = 0;
+    for (; magic[i]; ++i) {
+        if (i >= len || fold(data[i]) != static_cast<unsigned char>(magic[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool looksLikeText(const unsigned char* data, int len)
+{
+    for (int i = 0; i < len; ++i) {
+        // control characters other than \t \n \f \r and ESC mean binary, UTF-8 bytes pass
+        if (data[i] < 0x20 && data[i] != '\t' && data[i] != '\n' && data[i] != '\f' && data[i] != '\r' && data[i] != 0x1b) {
+            return false;
+        }
+    }
+
+    return len > 0;
+}
+}
+
+
+MIMEType graceful::MimeClassifier::fromFileName(const QString& name)
+{
+    int dot = name.lastIndexOf(QLatin1Char('.'));
+    int len = name.size() - dot - 1;
+    if (dot <= 0 || len <= 0 || len > EXTENSION_MAX) {
+        return FILE_TYPE_UNKNOW;
+    }
+
+    const QChar* ext = name.constData() + dot + 1;
+
+    quint16 buf[EXTENSION_MAX];
+    for (int i = 0; i < len; ++i) {
+        // no key has anything but ASCII
+        if (ext[i].unicode() > 0x7f) {
+            return FILE_TYPE_UNKNOW;
+        }
+        buf[i] = ext[i].unicode();
+    }
+
+    return lookupExtension(buf, len);
+}
+
+bool graceful::MimeClassifier::hasExtension(const QString& name)
+{
+    int dot = name.lastIndexOf(QLatin1Char('.'));
+
+    return dot > 0 && dot < name.size() - 1;
+}
+
+MIMEType graceful::MimeClassifier::fromContentType(const char* contentType)
+{
+    if (!contentType || !*contentType) {
+        return FILE_TYPE_UNKNOW;
+    }
+
+    MIMEType type = lookupContentType(contentType, int(strlen(contentType)));
+    if (FILE_TYPE_UNKNOW == type && 0 == strncmp(contentType, "audio/", 6)) {
+        type = FILE_TYPE_AUDIO;
+    }
+
+    return type;
+}
+
+MIMEType graceful::MimeClassifier::fromData(const unsigned char* data, int len)
+{
+    if (!data || len <= 0) {
+        return FILE_TYPE_UNKNOW;
+    }
+
+    if (startsWith(data, len, "\x89PNG\r\n\x1a\n", 8)
+            || startsWith(data, len, "\xff\xd8\xff", 3)
+            || startsWith(data, len, "GIF87a", 6)
+            || startsWith(data, len, "GIF89a", 6)) {
+        return FILE_TYPE_IMAGE;
+    }
+
+    // "BM" alone is too weak, the DIB header size must be a known one as well
+    if (startsWith(data, len, "BM", 2) && len >= 18) {
+        quint32 dib = data[14] | (data[15] << 8) | (data[16] << 16) | (quint32(data[17]) << 24);
+        if (12 == dib || 40 == dib || 52 == dib || 56 == dib || 108 == dib || 124 == dib) {
+            return FILE_TYPE_IMAGE;
+        }
+    }
+
+    if (startsWith(data, len, "ID3", 3)
+            || startsWith(data, len, "OggS", 4)
+            || startsWith(data, len, "fLaC", 4)
+            || (startsWith(data, len, "RIFF", 4) && len >= 12 && 0 == memcmp(data + 8, "WAVE", 4))) {
+        return FILE_TYPE_AUDIO;
+    }
+
+    if (!looksLikeText(data, len)) {
+        return FILE_TYPE_UNKNOW;
+    }
+
+    // markup may follow a UTF-8 BOM and blank lines
+    int skip = startsWith(data, len, "\xef\xbb\xbf", 3) ? 3 : 0;
+    while (skip < len && (' ' == data[skip] || '\t' == data[skip] || '\n' == data[skip] || '\r' == data[skip])) {
+        ++skip;
+    }
+
+    const unsigned char* text = data + skip;
+    int textLen = len - skip;
+
+    if (startsWithNoCase(text, textLen, "<?php")) {
+        return FILE_TYPE_TEXT_PHP;
+    }
+
+    if (startsWithNoCase(text, textLen, "<!doctype html") || startsWithNoCase(text, textLen, "<html")) {
+        return FILE_TYPE_TEXT_HTML;
+    }
+
+    if (startsWithNoCase(text, textLen, "<?xml")) {
+        return FILE_TYPE_TEXT_XML;
+    }
+
+    return FILE_TYPE_TEXT_PLAIN;
+}
+
+MIMEType graceful::MimeClassifier::fromFile(const char* path)
+{
+    gf_return_val_if_fail(path, FILE_TYPE_UNKNOW);
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NOCTTY | O_NONBLOCK);
+    gf_return_val_if_fail(fd >= 0, FILE_TYPE_UNKNOW);
+
+    unsigned char buf[SNIFF_LEN];
+    ssize_t len = 0;
+    do {
+        len = ::read(fd, buf, sizeof(buf));
+    } while (len < 0 && EINTR == errno);
+
+    ::close(fd);
+
+    return (len > 0) ? fromData(buf, int(len)) : FILE_TYPE_UNKNOW;
+}
@@ -0,0 +1,43 @@
+#ifndef MIMECLASSIFIER_H
+#define MIMECLASSIFIER_H
+
+#include "globals.h"
+#include "regular-file-type.h"
+
+#include <QString>
+
+namespace graceful
+{
+/**
+ * @brief
+ * Maps a regular file to MIMEType without regex or heap work. Extensions and
+ * content types are looked up in tables whose hashes are computed at compile
+ * time, files without an extension are recognised by their first bytes.
+ * Stateless and thread safe.
+ */
+class MimeClassifier
+{
+public:
+    /**
+     * @brief
+     * by the extension of 'name', case insensitive. ".bashrc" has no extension
+     */
+    NO_BLOCKING static MIMEType fromFileName(const QString& name);
+    NO_BLOCKING static bool hasExtension(const QString& name);
+
+    /**
+     * @brief
+     * by a GIO content type such as "image/png"
+     */
+    NO_BLOCKING static MIMEType fromContentType(const char* contentType);
+
+    /**
+     * @brief
+     * by the magic bytes at the start of a file
+     */
+    NO_BLOCKING static MIMEType fromData(const unsigned char* data, int len);
+    BLOCKING static MIMEType fromFile(const char* path);
+};
+}
+
+#endif // MIMECLASSIFIER_H
@@ -0,0 +1,570 @@
+#include "recursive-file-enumerator.h"
+
+#include "log/log.h"
+#include "file-info-cache.h"
+
+#include <QSet>
+#include <QList>
+#include <QPair>
+#include <QMutex>
+#include <QThread>
+#include <QAtomicInt>
+#include <QMutexLocker>
+#include <QWaitCondition>
+
+#define RECURSIVE_ENUMERATOR_BATCH_SIZE     256
+#define RECURSIVE_ENUMERATOR_IDLE_WAIT_MS   5
+
+// needed to decide where to descend, whatever the caller asked for
+#define RECURSIVE_ENUMERATOR_WALK_ATTRIBUTES \
+    G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE "," G_FILE_ATTRIBUTE_STANDARD_IS_SYMLINK "," \
+    G_FILE_ATTRIBUTE_ID_FILESYSTEM "," G_FILE_ATTRIBUTE_ID_FILE
+
+namespace graceful
+{
+class RecursiveFileEnumeratorPrivate;
+
+struct WalkTask
+{
+    GFile*                              dir = nullptr;
+    int                                 depth = 0;
+};
+
+class WalkWorker : public QThread
+{
+public:
+    WalkWorker(RecursiveFileEnumeratorPrivate* d, int id);
+
+    void push(const WalkTask& task);
+    bool pop(WalkTask& task);
+    bool steal(WalkTask& task);
+    void clear();
+
+protected:
+    void run() override;
+
+public:
+    int                                 mId = 0;
+    QMutex                              mLock;
+    QList<WalkTask>                     mTasks;                 // owner works on the newest, thieves take the oldest
+    RecursiveFileEnumeratorPrivate*     d = nullptr;
+};
+
+class RecursiveFileEnumeratorPrivate
+{
+    Q_DECLARE_PUBLIC(RecursiveFileEnumerator)
+public:
+    explicit RecursiveFileEnumeratorPrivate(RecursiveFileEnumerator* q);
+    ~RecursiveFileEnumeratorPrivate();
+
+    bool nextTask(WalkWorker* self, WalkTask& task);
+    void schedule(WalkWorker* self, const WalkTask& task);
+    void walkDirectory(WalkWorker* self, const WalkTask& task, QStringList& uris, QList<FileInfoPtr>& infos);
+    bool shouldDescend(GFileInfo* info);
+    bool markVisited(GFileInfo* info);
+
+    void flush(QStringList& uris, QList<FileInfoPtr>& infos);
+    void reportError(GFile* file, const GError* error);
+    void scheduleBatch();
+    void workerDone();
+
+    void joinWorkers();
+
+public:
+    bool                                mAutoDelete = false;
+    bool                                mRunning = false;
+    bool                                mRootFailed = false;
+    int                                 mMaxDepth = -1;
+    int                                 mThreadCount = 0;
+    int                                 mBatchSize = RECURSIVE_ENUMERATOR_BATCH_SIZE;
+    File::Attributes                    mAttributes = File::AttributeStandard;
+    RecursiveFileEnumerator::SymlinkPolicy  mSymlinkPolicy = RecursiveFileEnumerator::SymlinkNoFollow;
+    RecursiveFileEnumerator::MountPolicy    mMountPolicy = RecursiveFileEnumerator::MountCross;
+
+    QString                             mRootUri = nullptr;
+    QString                             mRootFilesystem = nullptr;
+    QByteArray                          mQueryAttributes;
+    GCancellable*                       mCancellable = nullptr;
+
+    QList<WalkWorker*>                  mWorkers;
+    QAtomicInt                          mOutstanding;           // directories queued or being walked
+    QAtomicInt                          mRunningWorkers;
+    QMutex                              mIdleLock;
+    QWaitCondition                      mIdleCond;
+
+    QMutex                              mVisitedLock;
+    QSet<QString>                       mVisited;               // id::file of walked directories, only when following links
+
+    QMutex                              mResultLock;
+    bool                                mBatchScheduled = false;
+    QStringList                         mPendingUris;
+    QList<FileInfoPtr>                  mPendingInfos;
+    QList<QPair<QString, QString>>      mPendingErrors;
+    QAtomicInteger<quint64>             mFileCount;
+    QAtomicInteger<quint64>             mDirCount;
+
+    RecursiveFileEnumerator*            q_ptr = nullptr;
+};
+
+WalkWorker::WalkWorker(RecursiveFileEnumeratorPrivate* d, int id) : QThread(), mId(id), d(d)
+{
+
+}
+
+void WalkWorker::push(const WalkTask& task)
+{
+    QMutexLocker locker(&mLock);
+
+    mTasks.append(task);
+}
+
+bool WalkWorker::pop(WalkTask& task)
+{
+    QMutexLocker locker(&mLock);
+
+    if (mTasks.isEmpty()) {
+        return false;
+    }
+
+    task = mTasks.takeLast();
+
+    return true;
+}
+
+bool WalkWorker::steal(WalkTask& task)
+{
+    QMutexLocker locker(&mLock);
+
+    if (mTasks.isEmpty()) {
+        return false;
+    }
+
+    task = mTasks.takeFirst();
+
+    return true;
+}
+
+void WalkWorker::clear()
+{
+    QMutexLocker locker(&mLock);
+
+    for (auto t : mTasks) {
+        g_object_unref(t.dir);
+    }
+    mTasks.clear();
+}
+
+void WalkWorker::run()
+{
+    WalkTask task;
+    QStringList uris;
+    QList<FileInfoPtr> infos;
+
+    while (d->nextTask(this, task)) {
+        d->walkDirectory(this, task, uris, infos);
+        g_object_unref(task.dir);
+
+        if (!d->mOutstanding.deref()) {
+            d->mIdleCond.wakeAll();
+        }
+    }
+
+    d->flush(uris, infos);
+    d->workerDone();
+}
+
+RecursiveFileEnumeratorPrivate::RecursiveFileEnumeratorPrivate(RecursiveFileEnumerator* q) : q_ptr(q)
+{
+    mThreadCount = qMax(1, QThread::idealThreadCount());
+    mCancellable = g_cancellable_new();
+}
+
+RecursiveFileEnumeratorPrivate::~RecursiveFileEnumeratorPrivate()
+{
+    g_cancellable_cancel(mCancellable);
+    joinWorkers();
+
+    if (mCancellable)                   g_object_unref(mCancellable);
+}
+
+bool RecursiveFileEnumeratorPrivate::nextTask(WalkWorker* self, WalkTask& task)
+{
+    while (!g_cancellable_is_cancelled(mCancellable)) {
+        if (self->pop(task)) {
+            return true;
+        }
+
+        for (int i = 1; i < mWorkers.size(); ++i) {
+            if (mWorkers.at((self->mId + i) % mWorkers.size())->steal(task)) {
+                return true;
+            }
+        }
+
+        if (0 == mOutstanding.load()) {
+            return false;
+        }
+
+        // a missed wake up only costs one timeout
+        QMutexLocker locker(&mIdleLock);
+        mIdleCond.wait(&mIdleLock, RECURSIVE_ENUMERATOR_IDLE_WAIT_MS);
+    }
+
+    return false;
+}
+
+void RecursiveFileEnumeratorPrivate::schedule(WalkWorker* self, const WalkTask& task)
+{
+    mOutstanding.ref();
+    self->push(task);
+    mIdleCond.wakeOne();
+}
+
+void RecursiveFileEnumeratorPrivate::walkDirectory(WalkWorker* self, const WalkTask& task, QStringList& uris, QList<FileInfoPtr>& infos)
+{
+    GError* error = nullptr;
+    GFileQueryInfoFlags flags = (RecursiveFileEnumerator::SymlinkFollow == mSymlinkPolicy) ? G_FILE_QUERY_INFO_NONE : G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS;
+
+    // in the worker, the root may be remote. Written before any child is
+    // scheduled, the other workers only get tasks through push() and steal()
+    // under the worker lock, after it
+    if (0 == task.depth) {
+        g_autoptr(GFileInfo) rootInfo = g_file_query_info(task.dir, G_FILE_ATTRIBUTE_ID_FILESYSTEM "," G_FILE_ATTRIBUTE_ID_FILE, G_FILE_QUERY_INFO_NONE, mCancellable, nullptr);
+        if (rootInfo) {
+            mRootFilesystem = g_file_info_get_attribute_string(rootInfo, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+            if (RecursiveFileEnumerator::SymlinkFollow == mSymlinkPolicy) {
+                markVisited(rootInfo);
+            }
+        }
+    }
+
+    g_autoptr(GFileEnumerator) enumerator = g_file_enumerate_children(task.dir, mQueryAttributes.constData(), flags, mCancellable, &error);
+    if (error) {
+        if (0 == task.depth) {
+            mRootFailed = true;
+        }
+        reportError(task.dir, error);
+        g_error_free(error);
+        return;
+    }
+
+    bool descend = (mMaxDepth < 0 || task.depth < mMaxDepth);
+    quint64 files = 0;
+    quint64 dirs = 0;
+
+    while (GFileInfo* info = g_file_enumerator_next_file(enumerator, mCancellable, &error)) {
+        GFile* child = g_file_enumerator_get_child(enumerator, info);
+        g_autofree char* uri = g_file_get_uri(child);
+
+        bool isDir = (G_FILE_TYPE_DIRECTORY == g_file_info_get_file_type(info));
+        isDir ? ++dirs : ++files;
+
+        if (isDir && descend && shouldDescend(info)) {
+            WalkTask t;
+            t.dir = child;
+            t.depth = task.depth + 1;
+            schedule(self, t);
+        } else {
+            g_object_unref(child);
+        }
+
+        // the snapshot adopts the reference returned by next_file
+        uris << uri;
+        infos << FileInfoPtr(new FileInfo(uri, info, mAttributes));
+        if (uris.size() >= mBatchSize) {
+            flush(uris, infos);
+        }
+    }
+
+    if (error) {
+        reportError(task.dir, error);
+        g_error_free(error);
+    }
+
+    mFileCount.fetchAndAddRelaxed(files);
+    mDirCount.fetchAndAddRelaxed(dirs);
+}
+
+bool RecursiveFileEnumeratorPrivate::shouldDescend(GFileInfo* info)
+{
+    if (g_file_info_get_is_symlink(info) && RecursiveFileEnumerator::SymlinkNoFollow == mSymlinkPolicy) {
+        return false;
+    }
+
+    // a filesystem that can't be compared is another one
+    if (RecursiveFileEnumerator::MountStay == mMountPolicy) {
+        const char* fs = g_file_info_get_attribute_string(info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+        if (mRootFilesystem.isEmpty() || !fs || mRootFilesystem != fs) {
+            return false;
+        }
+    }
+
+    // links may point back into the tree
+    if (RecursiveFileEnumerator::SymlinkFollow == mSymlinkPolicy) {
+        return markVisited(info);
+    }
+
+    return true;
+}
+
+bool RecursiveFileEnumeratorPrivate::markVisited(GFileInfo* info)
+{
+    const char* id = g_file_info_get_attribute_string(info, G_FILE_ATTRIBUTE_ID_FILE);
+    if (!id) {
+        return true;
+    }
+
+    QMutexLocker locker(&mVisitedLock);
+
+    if (mVisited.contains(id)) {
+        return false;
+    }
+    mVisited << id;
+
+    return true;
+}
+
+void RecursiveFileEnumeratorPrivate::flush(QStringList& uris, QList<FileInfoPtr>& infos)
+{
+    if (uris.isEmpty()) {
+        return;
+    }
+
+    {
+        QMutexLocker locker(&mResultLock);
+        mPendingUris << uris;
+        mPendingInfos << infos;
+    }
+
+    uris.clear();
+    infos.clear();
+
+    scheduleBatch();
+}
+
+void RecursiveFileEnumeratorPrivate::reportError(GFile* file, const GError* error)
+{
+    if (G_IO_ERROR_CANCELLED == error->code) {
+        return;
+    }
+
+    g_autofree char* uri = g_file_get_uri(file);
+    log_debug("recursive enumerate '%s' error: %s", uri, error->message);
+
+    {
+        QMutexLocker locker(&mResultLock);
+        mPendingErrors << qMakePair(QString(uri), QString(error->message));
+    }
+
+    scheduleBatch();
+}
+
+void RecursiveFileEnumeratorPrivate::scheduleBatch()
+{
+    // many workers, one queued delivery
+    {
+        QMutexLocker locker(&mResultLock);
+        if (mBatchScheduled) {
+            return;
+        }
+        mBatchScheduled = true;
+    }
+
+    QMetaObject::invokeMethod(q_ptr, "onBatchReady", Qt::QueuedConnection);
+}
+
+void RecursiveFileEnumeratorPrivate::workerDone()
+{
+    if (!mRunningWorkers.deref()) {
+        QMetaObject::invokeMethod(q_ptr, "onWalkFinished", Qt::QueuedConnection);
+    }
+}
+
+void RecursiveFileEnumeratorPrivate::joinWorkers()
+{
+    for (auto w : mWorkers) {
+        w->wait();
+    }
+
+    for (auto w : mWorkers) {
+        w->clear();
+        delete w;
+    }
+    mWorkers.clear();
+}
+}
+
+
+graceful::RecursiveFileEnumerator::RecursiveFileEnumerator(QObject *parent) : QObject(parent), d_ptr(new RecursiveFileEnumeratorPrivate(this))
+{
+
+}
+
+graceful::RecursiveFileEnumerator::~RecursiveFileEnumerator()
+{
+    delete d_ptr;
+}
+
+void graceful::RecursiveFileEnumerator::setAutoDelete(bool autoDelete)
+{
+    Q_D(RecursiveFileEnumerator);
+
+    d->mAutoDelete = autoDelete;
+}
+
+void graceful::RecursiveFileEnumerator::setEnumerateDirectory(QString uri)
+{
+    Q_D(RecursiveFileEnumerator);
+
+    gf_return_if_fail(!d->mRunning);
+
+    d->mRootUri = uri;
+}
+
+void graceful::RecursiveFileEnumerator::setQueryAttributes(File::Attributes attrs)
+{
+    Q_D(RecursiveFileEnumerator);
+
+    d->mAttributes = attrs;
+}
+
+void graceful::RecursiveFileEnumerator::setMaxDepth(int depth)
+{
+    Q_D(RecursiveFileEnumerator);
+
+    d->mMaxDepth = depth;
+}
+
+void graceful::RecursiveFileEnumerator::setSymlinkPolicy(SymlinkPolicy policy)
+{
+    Q_D(RecursiveFileEnumerator);
+
+    d->mSymlinkPolicy = policy;
+}
+
+void graceful::RecursiveFileEnumerator::setMountPolicy(MountPolicy policy)
+{
+    Q_D(RecursiveFileEnumerator);
+
+    d->mMountPolicy = policy;
+}
+
+void graceful::RecursiveFileEnumerator::setThreadCount(int count)
+{
+    Q_D(RecursiveFileEnumerator);
+
+    d->mThreadCount = count > 0 ? count : qMax(1, QThread::idealThreadCount());
+}
+
+void graceful::RecursiveFileEnumerator::setBatchSize(int size)
+{
+    Q_D(RecursiveFileEnumerator);
+
+    gf_return_if_fail(size > 0);
+
+    d->mBatchSize = size;
+}
+
+void graceful::RecursiveFileEnumerator::enumerateAsync()
+{
+    Q_D(RecursiveFileEnumerator);
+
+    gf_return_if_fail(!d->mRunning && !d->mRootUri.isEmpty());
+
+    File rootDir(d->mRootUri);
+    const GFile* rootFile = rootDir.getGFile();
+
+    gf_return_if_fail(rootFile && G_IS_FILE(rootFile));
+
+    log_debug("start recursive enumerate path: '%s'", d->mRootUri.toUtf8().constData());
+
+    if (g_cancellable_is_cancelled(d->mCancellable)) {
+        g_object_unref(d->mCancellable);
+        d->mCancellable = g_cancellable_new();
+    }
+
+    d->mQueryAttributes = (File::attributesToString(d->mAttributes) + "," RECURSIVE_ENUMERATOR_WALK_ATTRIBUTES).toUtf8();
+    d->mRootFilesystem.clear();
+    d->mVisited.clear();
+    d->mRootFailed = false;
+
+    d->mFileCount.store(0);
+    d->mDirCount.store(0);
+    d->mRunning = true;
+
+    for (int i = 0; i < d->mThreadCount; ++i) {
+        d->mWorkers << new WalkWorker(d, i);
+    }
+
+    WalkTask root;
+    root.dir = G_FILE(g_object_ref(const_cast<GFile*>(rootFile)));
+    root.depth = 0;
+    d->mOutstanding.store(1);
+    d->mWorkers.first()->push(root);
+
+    d->mRunningWorkers.store(d->mWorkers.size());
+    for (auto w : d->mWorkers) {
+        w->start();
+    }
+}
+
+void graceful::RecursiveFileEnumerator::cancel()
+{
+    Q_D(RecursiveFileEnumerator);
+
+    g_cancellable_cancel(d->mCancellable);
+    d->mIdleCond.wakeAll();
+}
+
+bool graceful::RecursiveFileEnumerator::isRunning() const
+{
+    Q_D(const RecursiveFileEnumerator);
+
+    return d->mRunning;
+}
+
+void graceful::RecursiveFileEnumerator::onBatchReady()
+{
+    Q_D(RecursiveFileEnumerator);
+
+    QStringList uris;
+    QList<FileInfoPtr> infos;
+    QList<QPair<QString, QString>> errors;
+    {
+        QMutexLocker locker(&d->mResultLock);
+        uris.swap(d->mPendingUris);
+        infos.swap(d->mPendingInfos);
+        errors.swap(d->mPendingErrors);
+        d->mBatchScheduled = false;
+    }
+
+    for (auto e : errors) {
+        Q_EMIT errored(e.first, e.second);
+    }
+
+    if (!uris.isEmpty()) {
+        Q_EMIT childrenUpdate(uris, infos);
+    }
+
+    Q_EMIT progress(d->mFileCount.load(), d->mDirCount.load());
+}
+
+void graceful::RecursiveFileEnumerator::onWalkFinished()
+{
+    Q_D(RecursiveFileEnumerator);
+
+    d->joinWorkers();
+
+    onBatchReady();
+
+    d->mRunning = false;
+
+    if (g_cancellable_is_cancelled(d->mCancellable)) {
+        Q_EMIT cancelled();
+    } else {
+        Q_EMIT enumerateFinished(!d->mRootFailed);
+    }
+
+    if (d->mAutoDelete) {
+        deleteLater();
+    }
+}
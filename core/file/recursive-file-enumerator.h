@@ -0,0 +1,95 @@
+#ifndef RECURSIVEFILEENUMERATOR_H
+#define RECURSIVEFILEENUMERATOR_H
+
+#include "globals.h"
+#include "file.h"
+
+#include <QObject>
+
+#include <gio/gio.h>
+
+namespace graceful
+{
+class RecursiveFileEnumeratorPrivate;
+
+/**
+ * @brief
+ * Walks a directory tree with a bounded pool of worker threads. Every worker
+ * owns a queue of directories, idle workers steal from the others.
+ * Results are collected in batches and delivered in the thread which owns
+ * this object, normally the GUI thread.
+ */
+class GRACEFUL_API RecursiveFileEnumerator : public QObject
+{
+    Q_OBJECT
+public:
+    enum SymlinkPolicy
+    {
+        SymlinkNoFollow,                // report links, never descend into them
+        SymlinkFollow                   // descend into linked directories, each directory is walked once
+    };
+    Q_ENUM(SymlinkPolicy)
+
+    enum MountPolicy
+    {
+        MountCross,                     // descend into other filesystems
+        MountStay                       // report mount points, don't descend into them, nor anywhere if the root's filesystem is unknown
+    };
+    Q_ENUM(MountPolicy)
+
+    explicit RecursiveFileEnumerator(QObject *parent = nullptr);
+    ~RecursiveFileEnumerator();
+
+    void setAutoDelete(bool autoDelete=true);
+    void setEnumerateDirectory(QString uri);
+
+    /**
+     * @brief
+     * attribute groups reported for every entry, default is File::AttributeStandard
+     */
+    void setQueryAttributes(File::Attributes attrs);
+
+    /**
+     * @brief
+     * -1 (default) walks the whole tree, 0 only lists the root directory
+     */
+    void setMaxDepth(int depth);
+    void setSymlinkPolicy(SymlinkPolicy policy);
+    void setMountPolicy(MountPolicy policy);
+
+    /**
+     * @brief
+     * number of worker threads, default is QThread::idealThreadCount()
+     */
+    void setThreadCount(int count);
+
+    /**
+     * @brief
+     * entries collected before they are handed to the owner thread, default 256
+     */
+    void setBatchSize(int size);
+
+    void enumerateAsync();
+    void cancel();
+
+    bool isRunning() const;
+
+Q_SIGNALS:
+    void errored(const QString& targetUri, const QString& message);
+    void childrenUpdate(const QStringList& uriList, const QList<FileInfoPtr>& infos);
+    void progress(quint64 files, quint64 directories);
+    void enumerateFinished(bool successed=false);
+    void cancelled();
+
+private Q_SLOTS:
+    void onBatchReady();
+    void onWalkFinished();
+
+private:
+    RecursiveFileEnumeratorPrivate*     d_ptr = nullptr;
+    Q_DISABLE_COPY(RecursiveFileEnumerator)
+    Q_DECLARE_PRIVATE(RecursiveFileEnumerator)
+};
+}
+
+#endif // RECURSIVEFILEENUMERATOR_H
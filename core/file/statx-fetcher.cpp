@@ -0,0 +1,395 @@
+#include "statx-fetcher.h"
+
+#include "log/log.h"
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <QThreadPool>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define STATX_FETCHER_HAVE_URING            1
+#endif
+
+#define STATX_FETCHER_QUEUE_DEPTH           256                 // statx requests in flight at once
+#define STATX_FETCHER_URING_MIN             8                   // smaller batches aren't worth a io_uring_enter()
+#define STATX_FETCHER_POOL_MIN              64                  // smaller batches are stated in the calling thread
+#define STATX_FETCHER_POOL_CHUNK            32
+
+#define STATX_FETCHER_FLAGS                 (AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT)
+#define STATX_FETCHER_NOT_DONE              (-1)
+
+namespace graceful
+{
+#ifdef STATX_FETCHER_HAVE_URING
+/**
+ * @brief
+ * A minimal io_uring driven by raw syscalls, only IORING_OP_STATX is used
+ */
+class StatxRing
+{
+public:
+    ~StatxRing();
+
+    static StatxRing* create(unsigned entries);
+    static bool probe();
+
+    /**
+     * @brief
+     * stat every entry whose result is STATX_FETCHER_NOT_DONE.
+     * false means the ring is broken, entries not completed stay NOT_DONE
+     */
+    bool run(int dirFd, const QList<QByteArray>& names, unsigned int mask, QVector<struct statx>& stats, QVector<int>& results);
+
+private:
+    StatxRing() = default;
+    bool init(unsigned entries);
+    int enter(unsigned toSubmit, unsigned minComplete);
+
+private:
+    int                                 mFd = -1;
+    unsigned                            mEntries = 0;
+
+    void*                               mSqRing = MAP_FAILED;
+    void*                               mCqRing = MAP_FAILED;
+    size_t                              mSqRingSize = 0;
+    size_t                              mCqRingSize = 0;
+    struct io_uring_sqe*                mSqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    size_t                              mSqesSize = 0;
+
+    unsigned*                           mSqHead = nullptr;
+    unsigned*                           mSqTail = nullptr;
+    unsigned*                           mSqMask = nullptr;
+    unsigned*                           mSqArray = nullptr;
+    unsigned*                           mCqHead = nullptr;
+    unsigned*                           mCqTail = nullptr;
+    unsigned*                           mCqMask = nullptr;
+    struct io_uring_cqe*                mCqes = nullptr;
+};
+
+StatxRing::~StatxRing()
+{
+    if (MAP_FAILED != mSqes)                munmap(mSqes, mSqesSize);
+    if (MAP_FAILED != mCqRing && mCqRing != mSqRing)    munmap(mCqRing, mCqRingSize);
+    if (MAP_FAILED != mSqRing)              munmap(mSqRing, mSqRingSize);
+    if (mFd >= 0)                           close(mFd);
+}
+
+StatxRing* StatxRing::create(unsigned entries)
+{
+    StatxRing* ring = new StatxRing;
+    if (!ring->init(entries)) {
+        delete ring;
+        return nullptr;
+    }
+
+    return ring;
+}
+
+bool StatxRing::probe()
+{
+    StatxRing* ring = create(1);
+    if (!ring) {
+        return false;
+    }
+
+    size_t len = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* p = static_cast<struct io_uring_probe*>(calloc(1, len));
+    bool supported = (0 == syscall(__NR_io_uring_register, ring->mFd, IORING_REGISTER_PROBE, p, IORING_OP_LAST))
+                  && p->last_op >= IORING_OP_STATX
+                  && (p->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+    free(p);
+    delete ring;
+
+    return supported;
+}
+
+bool StatxRing::init(unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    mFd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if (mFd < 0) {
+        log_debug("io_uring_setup error: %s", g_strerror(errno));
+        return false;
+    }
+
+    mEntries = params.sq_entries;
+    mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        mSqRingSize = mCqRingSize = qMax(mSqRingSize, mCqRingSize);
+    }
+
+    mSqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == mSqRing) {
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        mCqRing = mSqRing;
+    } else {
+        mCqRing = mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == mCqRing) {
+            return false;
+        }
+    }
+
+    mSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    mSqes = static_cast<struct io_uring_sqe*>(mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQES));
+    if (MAP_FAILED == mSqes) {
+        return false;
+    }
+
+    char* sq = static_cast<char*>(mSqRing);
+    mSqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    mSqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    mSqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    mSqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(mCqRing);
+    mCqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    mCqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    mCqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    mCqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+int StatxRing::enter(unsigned toSubmit, unsigned minComplete)
+{
+    return int(syscall(__NR_io_uring_enter, mFd, toSubmit, minComplete, IORING_ENTER_GETEVENTS, nullptr, 0));
+}
+
+bool StatxRing::run(int dirFd, const QList<QByteArray>& names, unsigned int mask, QVector<struct statx>& stats, QVector<int>& results)
+{
+    const int num = names.size();
+    int next = 0;
+    unsigned inflight = 0;
+
+    while (true) {
+        // keep the submission queue as full as the completion queue allows
+        unsigned tail = *mSqTail;
+        unsigned head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+        while (next < num && inflight < mEntries && tail - head < mEntries) {
+            if (STATX_FETCHER_NOT_DONE != results.at(next)) {
+                ++next;
+                continue;
+            }
+
+            unsigned idx = tail & *mSqMask;
+            struct io_uring_sqe* sqe = &mSqes[idx];
+            memset(sqe, 0, sizeof(struct io_uring_sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dirFd;
+            sqe->addr = reinterpret_cast<quint64>(names.at(next).constData());
+            sqe->len = mask;
+            sqe->off = reinterpret_cast<quint64>(&stats[next]);
+            sqe->statx_flags = STATX_FETCHER_FLAGS;
+            sqe->user_data = quint64(next);
+            mSqArray[idx] = idx;
+
+            ++tail;
+            ++next;
+            ++inflight;
+        }
+        __atomic_store_n(mSqTail, tail, __ATOMIC_RELEASE);
+
+        if (0 == inflight) {
+            break;
+        }
+
+        // entries the kernel didn't consume last time are submitted again
+        unsigned toSubmit = tail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+        if (enter(toSubmit, 1) < 0 && EINTR != errno && EAGAIN != errno && EBUSY != errno) {
+            log_error("io_uring_enter error: %s", g_strerror(errno));
+            // the kernel may still write into 'stats', wait for what it owns
+            while (inflight > 0 && enter(0, inflight) < 0 && EINTR == errno);
+            return false;
+        }
+
+        unsigned cqHead = *mCqHead;
+        unsigned cqTail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+        while (cqHead != cqTail) {
+            struct io_uring_cqe* cqe = &mCqes[cqHead & *mCqMask];
+            results[int(cqe->user_data)] = cqe->res < 0 ? -cqe->res : 0;
+            ++cqHead;
+            --inflight;
+        }
+        __atomic_store_n(mCqHead, cqHead, __ATOMIC_RELEASE);
+    }
+
+    return true;
+}
+#else
+class StatxRing
+{
+public:
+    static StatxRing* create(unsigned) { return nullptr; }
+    static bool probe() { return false; }
+    bool run(int, const QList<QByteArray>&, unsigned int, QVector<struct statx>&, QVector<int>&) { return false; }
+};
+#endif
+
+class StatxJob : public QRunnable
+{
+public:
+    StatxJob(int dirFd, const QList<QByteArray>& names, unsigned int mask, struct statx* stats, int* results, QList<int> indexes, QSemaphore& done)
+        : mDirFd(dirFd), mMask(mask), mNames(names), mStats(stats), mResults(results), mIndexes(indexes), mDone(done)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        // every job writes its own indexes only
+        for (auto i : mIndexes) {
+            mResults[i] = StatxFetcher::statOne(mDirFd, mNames.at(i).constData(), mMask, &mStats[i]);
+        }
+        mDone.release();
+    }
+
+private:
+    int                                 mDirFd;
+    unsigned int                        mMask;
+    const QList<QByteArray>&            mNames;
+    struct statx*                       mStats;
+    int*                                mResults;
+    QList<int>                          mIndexes;
+    QSemaphore&                         mDone;
+};
+}
+
+
+graceful::StatxFetcher::StatxFetcher()
+{
+
+}
+
+graceful::StatxFetcher::~StatxFetcher()
+{
+    delete mRing;
+}
+
+bool graceful::StatxFetcher::isUringSupported()
+{
+    static const bool gSupported = StatxRing::probe();
+
+    return gSupported;
+}
+
+void graceful::StatxFetcher::fetch(int dirFd, const QList<QByteArray>& names, unsigned int mask, QVector<struct statx>& stats, QVector<int>& results)
+{
+    stats.resize(names.size());
+    results.fill(STATX_FETCHER_NOT_DONE, names.size());
+
+    if (names.size() >= STATX_FETCHER_URING_MIN && !mRingFailed && isUringSupported()) {
+        if (!mRing) {
+            mRing = StatxRing::create(STATX_FETCHER_QUEUE_DEPTH);
+        }
+
+        if (!mRing || !mRing->run(dirFd, names, mask, stats, results)) {
+            log_debug("io_uring unusable, stat in the thread pool");
+            mRingFailed = true;
+            delete mRing;
+            mRing = nullptr;
+        }
+    }
+
+    // left over by a broken ring, or no io_uring at all
+    QList<int> pending;
+    for (int i = 0; i < results.size(); ++i) {
+        if (STATX_FETCHER_NOT_DONE == results.at(i)) {
+            pending << i;
+        }
+    }
+
+    if (pending.size() >= STATX_FETCHER_POOL_MIN) {
+        fetchByThreadPool(dirFd, names, mask, stats, results);
+        return;
+    }
+
+    for (auto i : pending) {
+        results[i] = statOne(dirFd, names.at(i).constData(), mask, &stats[i]);
+    }
+}
+
+int graceful::StatxFetcher::statOne(int dirFd, const char* name, unsigned int mask, struct statx* st)
+{
+    // workers of the pool race on it, any of them may find statx() missing
+    static QAtomicInt gHasStatx(1);
+
+    if (gHasStatx.loadAcquire()) {
+        if (0 == statx(dirFd, name, STATX_FETCHER_FLAGS, mask, st)) {
+            return 0;
+        }
+        if (ENOSYS != errno) {
+            return errno;
+        }
+        gHasStatx.storeRelease(0);
+    }
+
+    // kernels older than 4.11
+    struct stat s;
+    if (0 != fstatat(dirFd, name, &s, STATX_FETCHER_FLAGS)) {
+        return errno;
+    }
+
+    memset(st, 0, sizeof(struct statx));
+    st->stx_mask = STATX_BASIC_STATS;
+    st->stx_mode = s.st_mode;
+    st->stx_size = quint64(s.st_size);
+    st->stx_blocks = quint64(s.st_blocks);
+    st->stx_blksize = quint32(s.st_blksize);
+    st->stx_nlink = quint32(s.st_nlink);
+    st->stx_uid = s.st_uid;
+    st->stx_gid = s.st_gid;
+    st->stx_ino = s.st_ino;
+    st->stx_dev_major = major(s.st_dev);
+    st->stx_dev_minor = minor(s.st_dev);
+    st->stx_rdev_major = major(s.st_rdev);
+    st->stx_rdev_minor = minor(s.st_rdev);
+    st->stx_atime.tv_sec = s.st_atim.tv_sec;
+    st->stx_atime.tv_nsec = quint32(s.st_atim.tv_nsec);
+    st->stx_mtime.tv_sec = s.st_mtim.tv_sec;
+    st->stx_mtime.tv_nsec = quint32(s.st_mtim.tv_nsec);
+    st->stx_ctime.tv_sec = s.st_ctim.tv_sec;
+    st->stx_ctime.tv_nsec = quint32(s.st_ctim.tv_nsec);
+
+    return 0;
+}
+
+void graceful::StatxFetcher::fetchByThreadPool(int dirFd, const QList<QByteArray>& names, unsigned int mask, QVector<struct statx>& stats, QVector<int>& results)
+{
+    QList<QList<int>> chunks;
+    for (int i = 0; i < results.size(); ++i) {
+        if (STATX_FETCHER_NOT_DONE != results.at(i)) {
+            continue;
+        }
+        if (chunks.isEmpty() || chunks.last().size() >= STATX_FETCHER_POOL_CHUNK) {
+            chunks << QList<int>();
+        }
+        chunks.last() << i;
+    }
+
+    // detach here, jobs write through raw pointers
+    struct statx* st = stats.data();
+    int* res = results.data();
+
+    QSemaphore done;
+    for (auto chunk : chunks) {
+        QThreadPool::globalInstance()->start(new StatxJob(dirFd, names, mask, st, res, chunk, done));
+    }
+
+    done.acquire(chunks.size());
+}
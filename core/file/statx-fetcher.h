@@ -0,0 +1,55 @@
+#ifndef STATXFETCHER_H
+#define STATXFETCHER_H
+
+#include "globals.h"
+
+#include <QList>
+#include <QVector>
+#include <QByteArray>
+
+#include <sys/stat.h>
+
+namespace graceful
+{
+class StatxRing;
+
+/**
+ * @brief
+ * statx() for many entries of one directory at once. When the kernel
+ * supports IORING_OP_STATX the whole batch goes through an io_uring and is
+ * kept in flight together, otherwise it is spread over QThreadPool::globalInstance().
+ * Not thread safe, one batch at a time.
+ */
+class StatxFetcher
+{
+public:
+    StatxFetcher();
+    ~StatxFetcher();
+
+    static bool isUringSupported();
+
+    /**
+     * @brief
+     * stat 'names' relative to 'dirFd' without following symlinks,
+     * 'results[i]' is 0 or the errno of 'names[i]'
+     */
+    BLOCKING void fetch(int dirFd, const QList<QByteArray>& names, unsigned int mask, QVector<struct statx>& stats, QVector<int>& results);
+
+    /**
+     * @brief
+     * synchronous statx() of one entry, 0 or errno. Uses fstatat() on kernels without statx()
+     */
+    BLOCKING static int statOne(int dirFd, const char* name, unsigned int mask, struct statx* st);
+
+private:
+    void fetchByThreadPool(int dirFd, const QList<QByteArray>& names, unsigned int mask, QVector<struct statx>& stats, QVector<int>& results);
+
+private:
+    StatxRing*                          mRing = nullptr;
+    bool                                mRingFailed = false;
+
+    Q_DISABLE_COPY(StatxFetcher)
+};
+}
+
+#endif // STATXFETCHER_H
@@ -0,0 +1,114 @@
+#include "uri-atoms.h"
+
+#include <QHash>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QReadWriteLock>
+
+namespace graceful
+{
+class UriAtomTable
+{
+public:
+    struct Entry
+    {
+        QString                         uri;
+        int                             refs = 0;
+    };
+
+    QReadWriteLock                      mLock;
+    QHash<QString, UriId>               mIds;
+    QHash<UriId, Entry>                 mEntries;
+    UriId                               mNextId = 1;        // ids are not reused, a stale one never names another uri
+};
+
+static UriAtomTable* table()
+{
+    // never destroyed, ids may be resolved from static destructors
+    static UriAtomTable* gTable = new UriAtomTable;
+
+    return gTable;
+}
+}
+
+
+graceful::UriId graceful::UriAtoms::intern(const QString& uri)
+{
+    if (uri.isEmpty()) {
+        return 0;
+    }
+
+    UriAtomTable* t = table();
+
+    QWriteLocker locker(&t->mLock);
+
+    UriId id = t->mIds.value(uri, 0);
+    if (!id) {
+        id = t->mNextId++;
+        t->mIds.insert(uri, id);
+        t->mEntries[id].uri = uri;
+    }
+    ++t->mEntries[id].refs;
+
+    return id;
+}
+
+void graceful::UriAtoms::ref(UriId id)
+{
+    UriAtomTable* t = table();
+
+    QWriteLocker locker(&t->mLock);
+
+    auto it = t->mEntries.find(id);
+    if (t->mEntries.end() != it) {
+        ++it->refs;
+    }
+}
+
+void graceful::UriAtoms::release(UriId id)
+{
+    if (!id) {
+        return;
+    }
+
+    UriAtomTable* t = table();
+
+    QWriteLocker locker(&t->mLock);
+
+    auto it = t->mEntries.find(id);
+    if (t->mEntries.end() == it || --it->refs > 0) {
+        return;
+    }
+
+    t->mIds.remove(it->uri);
+    t->mEntries.erase(it);
+}
+
+graceful::UriId graceful::UriAtoms::lookup(const QString& uri)
+{
+    UriAtomTable* t = table();
+
+    QReadLocker locker(&t->mLock);
+
+    return t->mIds.value(uri, 0);
+}
+
+QString graceful::UriAtoms::uri(UriId id)
+{
+    UriAtomTable* t = table();
+
+    QReadLocker locker(&t->mLock);
+
+    auto it = t->mEntries.constFind(id);
+
+    return (t->mEntries.constEnd() != it) ? it->uri : QString();
+}
+
+int graceful::UriAtoms::count()
+{
+    UriAtomTable* t = table();
+
+    QReadLocker locker(&t->mLock);
+
+    return t->mEntries.size();
+}
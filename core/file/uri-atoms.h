@@ -0,0 +1,57 @@
+#ifndef URIATOMS_H
+#define URIATOMS_H
+
+#include "globals.h"
+
+#include <QString>
+
+namespace graceful
+{
+/**
+ * @brief
+ * interned uri, 0 is no uri
+ */
+typedef quint32 UriId;
+
+/**
+ * @brief
+ * Process wide table handing out a stable integer id per uri, so maps and
+ * lists of items can be keyed and compared by integers. Ids are reference
+ * counted: an id keeps its uri while it is held, the entry is freed by the
+ * last release(). Freed ids are never handed out again.
+ * All methods are thread safe.
+ */
+class GRACEFUL_API UriAtoms
+{
+public:
+    /**
+     * @brief
+     * id of 'uri', a new one if nobody holds it. The caller holds one
+     * reference, given back with release()
+     */
+    static UriId intern(const QString& uri);
+
+    /**
+     * @brief
+     * hold 'id' once more, no-op for ids not held by anyone
+     */
+    static void ref(UriId id);
+    static void release(UriId id);
+
+    /**
+     * @brief
+     * id of 'uri' if it is held, 0 otherwise. Never adds nor references
+     */
+    static UriId lookup(const QString& uri);
+
+    /**
+     * @brief
+     * the uri of 'id', shared with the table, a null string for unknown or released ids
+     */
+    static QString uri(UriId id);
+
+    static int count();
+};
+}
+
+#endif // URIATOMS_H
@@ -0,0 +1,144 @@
+#include "uri.h"
+
+#include "utils/utils.h"
+
+#include <QFile>
+#include <QHash>
+#include <QSharedData>
+
+namespace graceful
+{
+class UriData : public QSharedData
+{
+public:
+    UriData() = default;
+    explicit UriData(const QString& uri);
+
+public:
+    QByteArray                          mEncoded;
+    QString                             mUri;
+    QString                             mScheme;
+    QString                             mPath;
+    QString                             mBasename;
+    QString                             mDisplayName;
+    QString                             mDisplayUri;
+};
+
+UriData::UriData(const QString& uri)
+{
+    QString input = uri.startsWith('/') ? QStringLiteral("file://") + uri : uri;
+
+    int schemeEnd = input.indexOf(QLatin1String("://"));
+    if (schemeEnd <= 0) {
+        return;
+    }
+
+    // the input is kept when it was already encoded
+    QByteArray utf8 = input.toUtf8();
+    mEncoded = Utils::urlEncode(utf8);
+    mUri = (mEncoded.constData() == utf8.constData()) ? input : QString::fromUtf8(mEncoded);
+    mScheme = input.left(schemeEnd);
+
+    // the authority ends at the first '/', encoded uris have no query or fragment
+    int pathStart = mEncoded.indexOf('/', schemeEnd + 3);
+    QByteArray path = (pathStart < 0) ? QByteArray() : Utils::urlDecode(mEncoded.mid(pathStart));
+    mPath = QString::fromUtf8(path);
+
+    while (path.size() > 1 && path.endsWith('/')) {
+        path.chop(1);
+    }
+    QByteArray name = (path.isEmpty() || "/" == path) ? QByteArray("/") : path.mid(path.lastIndexOf('/') + 1);
+    mBasename = QFile::decodeName(name);
+    mDisplayName = QString::fromUtf8(name);
+
+    mDisplayUri = Utils::urlDecode(mUri);
+}
+}
+
+
+graceful::Uri::Uri() : d(new UriData)
+{
+
+}
+
+graceful::Uri::Uri(const QString& uri) : d(new UriData(uri))
+{
+
+}
+
+graceful::Uri::Uri(const Uri& other) : d(other.d)
+{
+
+}
+
+graceful::Uri& graceful::Uri::operator=(const Uri& other)
+{
+    d = other.d;
+
+    return *this;
+}
+
+graceful::Uri::~Uri()
+{
+
+}
+
+bool graceful::Uri::isValid() const
+{
+    return !d->mScheme.isEmpty();
+}
+
+bool graceful::Uri::isLocal() const
+{
+    return QLatin1String("file") == d->mScheme;
+}
+
+const QString& graceful::Uri::toString() const
+{
+    return d->mUri;
+}
+
+const QByteArray& graceful::Uri::toEncoded() const
+{
+    return d->mEncoded;
+}
+
+const QString& graceful::Uri::scheme() const
+{
+    return d->mScheme;
+}
+
+const QString& graceful::Uri::path() const
+{
+    return d->mPath;
+}
+
+const QString& graceful::Uri::basename() const
+{
+    return d->mBasename;
+}
+
+const QString& graceful::Uri::displayName() const
+{
+    return d->mDisplayName;
+}
+
+const QString& graceful::Uri::displayUri() const
+{
+    return d->mDisplayUri;
+}
+
+bool graceful::Uri::operator==(const Uri& other) const
+{
+    return d == other.d || d->mEncoded == other.d->mEncoded;
+}
+
+bool graceful::Uri::operator!=(const Uri& other) const
+{
+    return !(*this == other);
+}
+
+uint graceful::qHash(const Uri& uri, uint seed)
+{
+    return qHash(uri.toEncoded(), seed);
+}
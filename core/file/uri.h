@@ -0,0 +1,75 @@
+#ifndef URI_H
+#define URI_H
+
+#include "globals.h"
+
+#include <QString>
+#include <QByteArray>
+#include <QSharedDataPointer>
+
+namespace graceful
+{
+class UriData;
+
+/**
+ * @brief
+ * Immutable, implicitly shared uri. It is parsed once, copies share the
+ * parsed components and the getters hand them out without allocating.
+ * An absolute local path is accepted as a file:// uri.
+ */
+class GRACEFUL_API Uri
+{
+public:
+    Uri();
+    explicit Uri(const QString& uri);
+    Uri(const Uri& other);
+    Uri& operator=(const Uri& other);
+    ~Uri();
+
+    bool isValid() const;
+    bool isLocal() const;
+
+    /**
+     * @brief
+     * percent-encoded uri, see Utils::urlEncode()
+     */
+    const QString& toString() const;
+    const QByteArray& toEncoded() const;
+
+    const QString& scheme() const;
+
+    /**
+     * @brief
+     * decoded path part, "/a b/c" for "file:///a%20b/c"
+     */
+    const QString& path() const;
+
+    /**
+     * @brief
+     * last segment of path(), "/" for a root
+     */
+    const QString& basename() const;
+
+    /**
+     * @brief
+     * basename() for showing, bytes that are not UTF-8 become replacement characters
+     */
+    const QString& displayName() const;
+
+    /**
+     * @brief
+     * the whole uri decoded, for showing
+     */
+    const QString& displayUri() const;
+
+    bool operator==(const Uri& other) const;
+    bool operator!=(const Uri& other) const;
+
+private:
+    QSharedDataPointer<UriData>         d;
+};
+
+GRACEFUL_API uint qHash(const Uri& uri, uint seed = 0);
+}
+
+#endif // URI_H
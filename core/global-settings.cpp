@@ -7,6 +7,7 @@
 graceful::GlobalSettings::GlobalSettings(QObject *parent) : QObject(parent)
 {
     mGsettings = new QGSettings(GRACEFUL_SETTINGS_DAEMON, QByteArray(), this);
+    connect(mGsettings, &QGSettings::changed, this, &GlobalSettings::onValueChanged);
 }
 
 graceful::GlobalSettings *graceful::GlobalSettings::getInstance()
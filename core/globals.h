@@ -61,6 +61,11 @@
   } G_STMT_END
 
 
+// marks api which may do synchronous I/O
+#define BLOCKING
+#define NO_BLOCKING
+
+
 
 
 
@@ -1,3 +1,4 @@
+#include <QSet>
 #include <QDebug>
 #include <QScreen>
 
@@ -50,13 +51,13 @@ int GScreen::maxColumn() const
 
 bool GScreen::iconIsConflict(QPoint pos)
 {
-    auto its = mItems.values();
-
-    if (!its.contains(pos)) {
-        return false;
+    for (auto it = mItems.constBegin(); it != mItems.constEnd(); ++it) {
+        if (it.value() == pos) {
+            return true;
+        }
     }
 
-    return true;
+    return false;
 }
 
 bool GScreen::posIsOnScreen(const QPoint &pos)
@@ -119,8 +120,8 @@ IconView* GScreen::getView()
 
 void GScreen::swapScreen(GScreen &screen)
 {
-    QHash<QString, QPoint>  item = mItems;
-    QHash<QString, QPoint>  itemPoss = mItemsMetaPoses;
+    QHash<UriId, QPoint>  item = mItems;
+    QHash<UriId, QPoint>  itemPoss = mItemsMetaPoses;
 
     mItems = screen.mItems;
     mItemsMetaPoses = screen.mItemsMetaPoses;
@@ -139,7 +140,7 @@ void GScreen::clearItems()
     mItems.clear();
 }
 
-QPoint GScreen::getMetaPos(const QString& uri)
+QPoint GScreen::getMetaPos(UriId uri)
 {
     if (mItemsMetaPoses.contains(uri)) {
         return mItemsMetaPoses[uri];
@@ -153,14 +154,14 @@ QRect GScreen::getGeometry() const
     return mGeometry;
 }
 
-QStringList GScreen::getAllItemsOnScreen()
+QList<UriId> GScreen::getAllItemsOnScreen()
 {
     return mItems.keys();
 }
 
-QStringList GScreen::getItemsOutOfScreen()
+QList<UriId> GScreen::getItemsOutOfScreen()
 {
-    QStringList list;
+    QList<UriId> list;
 
     for (auto uri : mItems.keys()) {
         auto gridPos = mItems.value(uri);
@@ -172,15 +173,15 @@ QStringList GScreen::getItemsOutOfScreen()
     return list;
 }
 
-QStringList GScreen::getItemsVisibleOnScreen()
+QList<UriId> GScreen::getItemsVisibleOnScreen()
 {
     if (!isValidScreen()) {
-        return QStringList();
+        return QList<UriId>();
     }
 
-    QStringList list;
+    QList<UriId> list;
 
-    QStringList uris = mItems.keys();
+    QList<UriId> uris = mItems.keys();
 
     for (auto uri : uris) {
         auto gridPos = mItems.value(uri);
@@ -192,25 +193,25 @@ QStringList GScreen::getItemsVisibleOnScreen()
     return list;
 }
 
-QStringList GScreen::getItemsOverrideOnScreen()
+QList<UriId> GScreen::getItemsOverrideOnScreen()
 {
-    QStringList list;
-    QMap<QString, bool> filter;
+    QList<UriId> list;
+    QSet<quint64> filter;
 
     for (auto it = mItems.constBegin(); it != mItems.constEnd(); ++it) {
-        QString uri = it.key();
+        UriId uri = it.key();
         QPoint pos = it.value();
-        QString posStr = QString("%1x%2").arg(pos.x()).arg(pos.y());
-        if (filter.contains(posStr)) {
+        quint64 cell = (quint64(quint32(pos.x())) << 32) | quint32(pos.y());
+        if (filter.contains(cell)) {
             list << uri;
         }
-        filter[posStr] = true;
+        filter.insert(cell);
     }
 
     return list;
 }
 
-QPoint GScreen::getItemMetaInfoGridPos(const QString &uri)
+QPoint GScreen::getItemMetaInfoGridPos(UriId uri)
 {
     QPoint poss = INVALID_POS;
 
@@ -233,7 +234,7 @@ void GScreen::refresh()
     }
 
     QPoint p(0, 0);
-    QStringList worngIcon;
+    QList<UriId> worngIcon;
 
     worngIcon << getItemsOutOfScreen();
     worngIcon << getItemsOverrideOnScreen();
@@ -259,9 +260,9 @@ void GScreen::refresh()
 #endif
 }
 
-QStringList GScreen::getItemsMetaGridPosOutOfScreen()
+QList<UriId> GScreen::getItemsMetaGridPosOutOfScreen()
 {
-    QStringList list;
+    QList<UriId> list;
 
     if (!mScreen)
         return mItemsMetaPoses.keys();
@@ -276,9 +277,9 @@ QStringList GScreen::getItemsMetaGridPosOutOfScreen()
     return list;
 }
 
-QStringList GScreen::getItemMetaGridPosVisibleOnScreen()
+QList<UriId> GScreen::getItemMetaGridPosVisibleOnScreen()
 {
-    QStringList list;
+    QList<UriId> list;
 
     if (mScreen) {
         for (auto uri : mItemsMetaPoses.keys()) {
@@ -304,48 +305,48 @@ QPoint GScreen::getGridCenterPoint(QPoint &pos)
     return pos;
 }
 
-QList<QPair<QString, QPoint> > GScreen::getItemsAndPosOutOfScreen()
+QList<QPair<UriId, QPoint> > GScreen::getItemsAndPosOutOfScreen()
 {
-    QList<QPair<QString, QPoint>> uris;
+    QList<QPair<UriId, QPoint>> uris;
 
     for (auto it = mItems.constBegin(); it != mItems.constEnd(); ++it) {
         QPoint p = it.value();
-        QString uri = it.key();
+        UriId uri = it.key();
         if (!posAvailable(p)) {
-            uris << (QPair<QString, QPoint> (uri, p));
+            uris << (QPair<UriId, QPoint> (uri, p));
         }
     }
 
     return uris;
 }
 
-QList<QPair<QString, QPoint> > GScreen::getItemsAndPosAll()
+QList<QPair<UriId, QPoint> > GScreen::getItemsAndPosAll()
 {
-    QList<QPair<QString, QPoint>> uris;
+    QList<QPair<UriId, QPoint>> uris;
 
     for (auto it = mItems.constBegin(); it != mItems.constEnd(); ++it) {
         QPoint p = it.value();
-        QString uri = it.key();
-        uris << (QPair<QString, QPoint> (uri, coordinateLocal2Global(p)));
+        UriId uri = it.key();
+        uris << (QPair<UriId, QPoint> (uri, coordinateLocal2Global(p)));
     }
 
     return uris;
 }
 
-bool GScreen::uriIsOnScreen(const QString &uri) const
+bool GScreen::uriIsOnScreen(UriId uri) const
 {
     return mItems.contains(uri);
 }
 
-QPoint GScreen::putIconOnScreen(const QString uri, QPoint start, bool force)
+QPoint GScreen::putIconOnScreen(UriId uri, QPoint start, bool force)
 {
     return coordinateLocal2Global(placeItem(uri, coordinateGlobal2Local(start), force));
 }
 
-QStringList GScreen::putIconsOnScreen(const QStringList uris, bool force)
+QList<UriId> GScreen::putIconsOnScreen(const QList<UriId>& uris, bool force)
 {
     QPoint p(0, 0);
-    QStringList notPut;
+    QList<UriId> notPut;
 
     for (auto u : uris) {
         p = placeItem(u, p, force);
@@ -360,9 +361,9 @@ void GScreen::makeAllItemsGridPosInvalid()
     mItems.clear();
 }
 
-bool GScreen::saveMetaPos(const QString &uri, const QPoint &pos)
+bool GScreen::saveMetaPos(UriId uri, const QPoint &pos)
 {
-    if (!isValidScreen() || "" == uri) {
+    if (!isValidScreen() || 0 == uri) {
         return false;
     }
 
@@ -376,9 +377,9 @@ QScreen* GScreen::getScreen() const
     return mScreen;
 }
 
-QPoint GScreen::placeItem(const QString &uri, QPoint lastPos, bool force)
+QPoint GScreen::placeItem(UriId uri, QPoint lastPos, bool force)
 {
-    if (!isValidScreen() || "" == uri) {
+    if (!isValidScreen() || 0 == uri) {
         return INVALID_POS;
     }
 
@@ -392,7 +393,7 @@ QPoint GScreen::placeItem(const QString &uri, QPoint lastPos, bool force)
     while (x <= mMaxColumn && y <= mMaxRow) {
         // check if there is an index in this grid pos.
         auto tmp = QPoint(x, y);
-        if (mItems.key(tmp).isEmpty()) {
+        if (0 == mItems.key(tmp, 0)) {
             pos.setX(x);
             pos.setY(y);
             mItems.insert(uri, pos);
@@ -421,7 +422,7 @@ QPoint GScreen::placeItem(const QString &uri, QPoint lastPos, bool force)
     return pos;
 }
 
-QPoint GScreen::itemGridPos(const QString &uri)
+QPoint GScreen::itemGridPos(UriId uri)
 {
     if (mItems.contains(uri)) {
         QPoint rowColum = mItems[uri];
@@ -431,7 +432,7 @@ QPoint GScreen::itemGridPos(const QString &uri)
     return INVALID_POS;
 }
 
-void GScreen::makeItemGridPosInvalid(const QString &uri)
+void GScreen::makeItemGridPosInvalid(UriId uri)
 {
     mItems.remove(uri);
 
@@ -444,12 +445,12 @@ void GScreen::makeItemGridPosInvalid(const QString &uri)
 #endif
 }
 
-void GScreen::makeItemMetaPosInvalid(const QString &uri)
+void GScreen::makeItemMetaPosInvalid(UriId uri)
 {
     mItemsMetaPoses.remove(uri);
 }
 
-bool GScreen::isItemOutOfGrid(const QString &uri)
+bool GScreen::isItemOutOfGrid(UriId uri)
 {
     auto pos = mItems.value(uri);
 
@@ -462,9 +463,9 @@ bool GScreen::isItemOutOfGrid(const QString &uri)
     return true;
 }
 
-QPoint GScreen::getItemRelatedPosition(const QString &uri)
+QPoint GScreen::getItemRelatedPosition(UriId uri)
 {
-    if (!mScreen || "" == uri) {
+    if (!mScreen || 0 == uri) {
         return INVALID_POS;
     }
 
@@ -477,9 +478,9 @@ QPoint GScreen::getItemRelatedPosition(const QString &uri)
     return INVALID_POS;
 }
 
-QPoint GScreen::getItemGlobalPosition(const QString &uri)
+QPoint GScreen::getItemGlobalPosition(UriId uri)
 {
-    if (!mScreen || "" == uri) {
+    if (!mScreen || 0 == uri) {
         return INVALID_POS;
     }
 
@@ -491,16 +492,16 @@ QPoint GScreen::getItemGlobalPosition(const QString &uri)
     return coordinateLocal2Global(gridPos);
 }
 
-QString GScreen::getItemFromRelatedPosition(const QPoint &pos)
+UriId GScreen::getItemFromRelatedPosition(const QPoint &pos)
 {
     if (!mScreen) {
-        return nullptr;
+        return 0;
     }
 
     if (pos.x() <= mMaxColumn && pos.x() >= 0 && pos.y() <= mMaxRow && pos.y() >= 0) {
-        return mItems.key(pos);
+        return mItems.key(pos, 0);
     } else {
-        return nullptr;
+        return 0;
     }
 }
 
@@ -529,16 +530,16 @@ bool GScreen::posAvailable(QPoint &p) const
     return true;
 }
 
-QString GScreen::getItemFromGlobalPosition(const QPoint &pos)
+UriId GScreen::getItemFromGlobalPosition(const QPoint &pos)
 {
     if (!mScreen) {
-        return nullptr;
+        return 0;
     }
 
     return getItemFromRelatedPosition(coordinateGlobal2Local(pos));
 }
 
-bool GScreen::setItemGridPos(const QString &uri, const QPoint &pos)
+bool GScreen::setItemGridPos(UriId uri, const QPoint &pos)
 {
     auto currentGridPos = mItems.value(uri);
     if (currentGridPos == pos) {
@@ -549,8 +550,8 @@ bool GScreen::setItemGridPos(const QString &uri, const QPoint &pos)
         return false;
     }
 
-    auto itemOnTargetPos = mItems.key(pos);
-    if (itemOnTargetPos.isEmpty()) {
+    auto itemOnTargetPos = mItems.key(pos, 0);
+    if (0 == itemOnTargetPos) {
         mItems.insert(uri, pos);
         return true;
     } else {
@@ -558,7 +559,7 @@ bool GScreen::setItemGridPos(const QString &uri, const QPoint &pos)
     }
 }
 
-bool GScreen::setItemWithGlobalPos(const QString &uri, const QPoint &pos)
+bool GScreen::setItemWithGlobalPos(UriId uri, const QPoint &pos)
 {
     if (mScreen && mScreen->availableGeometry().contains(pos)) {
         return setItemGridPos(uri, coordinateGlobal2Local(pos));
@@ -567,7 +568,7 @@ bool GScreen::setItemWithGlobalPos(const QString &uri, const QPoint &pos)
     return false;
 }
 
-bool GScreen::saveItemWithGlobalPos(const QString &uri, const QPoint &pos)
+bool GScreen::saveItemWithGlobalPos(UriId uri, const QPoint &pos)
 {
     if (mScreen && mScreen->geometry().contains(pos)) {
         return saveMetaPos(uri, coordinateGlobal2Local(pos));
@@ -587,8 +588,8 @@ void GScreen::rebindScreen(QScreen *screen)
         mScreen->disconnect(mScreen, &QScreen::destroyed, this, 0);
     }
 
-    QHash<QString, QPoint>  item = mItems;
-    QHash<QString, QPoint>  itemPoss = mItemsMetaPoses;
+    QHash<UriId, QPoint>  item = mItems;
+    QHash<UriId, QPoint>  itemPoss = mItemsMetaPoses;
 
     // FIXME://
     mGeometry.adjust(mPanelMargins.left(), mPanelMargins.top(), -mPanelMargins.right(), -mPanelMargins.bottom());
@@ -9,6 +9,8 @@
 #include <QScreen>
 #include <QModelIndex>
 
+#include "uri-atoms.h"
+
 class QScreen;
 
 namespace graceful
@@ -27,36 +29,36 @@ public:
     QRect getGeometry() const;
     QScreen* getScreen() const;
 
-    QStringList getAllItemsOnScreen();
-    QStringList getItemsOutOfScreen();
-    QStringList getItemsVisibleOnScreen();
-    QStringList getItemsOverrideOnScreen();
-    QStringList getItemsMetaGridPosOutOfScreen();
-    QStringList getItemMetaGridPosVisibleOnScreen();
+    QList<UriId> getAllItemsOnScreen();
+    QList<UriId> getItemsOutOfScreen();
+    QList<UriId> getItemsVisibleOnScreen();
+    QList<UriId> getItemsOverrideOnScreen();
+    QList<UriId> getItemsMetaGridPosOutOfScreen();
+    QList<UriId> getItemMetaGridPosVisibleOnScreen();
 
     QPoint getGridCenterPoint(QPoint& pos);
 
-    QList<QPair<QString, QPoint>> getItemsAndPosAll();
-    QList<QPair<QString, QPoint>> getItemsAndPosOutOfScreen();
+    QList<QPair<UriId, QPoint>> getItemsAndPosAll();
+    QList<QPair<UriId, QPoint>> getItemsAndPosOutOfScreen();
 
     bool posIsOnScreen(const QPoint& pos);
-    QPoint itemGridPos(const QString &uri);
-    bool isItemOutOfGrid(const QString &uri);
-    bool uriIsOnScreen(const QString& uri) const;
+    QPoint itemGridPos(UriId uri);
+    bool isItemOutOfGrid(UriId uri);
+    bool uriIsOnScreen(UriId uri) const;
 
-    QPoint putIconOnScreen(const QString uri, QPoint start=QPoint(), bool force=false);
-    QStringList putIconsOnScreen (const QStringList uris, bool force=false);
+    QPoint putIconOnScreen(UriId uri, QPoint start=QPoint(), bool force=false);
+    QList<UriId> putIconsOnScreen (const QList<UriId>& uris, bool force=false);
 
     void makeAllItemsGridPosInvalid();
-    void makeItemGridPosInvalid(const QString& uri);
-    void makeItemMetaPosInvalid(const QString& uri);
+    void makeItemGridPosInvalid(UriId uri);
+    void makeItemMetaPosInvalid(UriId uri);
 
-    bool setItemWithGlobalPos(const QString & uri, const QPoint& pos);
-    bool saveItemWithGlobalPos(const QString& uri, const QPoint& pos);
+    bool setItemWithGlobalPos(UriId uri, const QPoint& pos);
+    bool saveItemWithGlobalPos(UriId uri, const QPoint& pos);
 
-    QPoint getItemGlobalPosition(const QString &uri);
-    QString getItemFromGlobalPosition(const QPoint &pos);
-    QPoint getItemMetaInfoGridPos(const QString &uri);
+    QPoint getItemGlobalPosition(UriId uri);
+    UriId getItemFromGlobalPosition(const QPoint &pos);
+    QPoint getItemMetaInfoGridPos(UriId uri);
 
     void refresh();
 
@@ -85,20 +87,20 @@ private:
 
     bool iconIsConflict(QPoint point);
 
-    QPoint getMetaPos (const QString& uri);
-    bool saveMetaPos (const QString& uri, const QPoint& pos);
+    QPoint getMetaPos (UriId uri);
+    bool saveMetaPos (UriId uri, const QPoint& pos);
 
-    bool setItemGridPos(const QString &uri, const QPoint &pos);
+    bool setItemGridPos(UriId uri, const QPoint &pos);
 
-    QPoint getItemRelatedPosition(const QString &uri);
-    QString getItemFromRelatedPosition(const QPoint &pos);
+    QPoint getItemRelatedPosition(UriId uri);
+    UriId getItemFromRelatedPosition(const QPoint &pos);
 
     QPoint coordinateGlobal2Local(const QPoint& pos) const;
     QPoint coordinateLocal2Global(const QPoint& pos) const;
 
     bool posAvailable(QPoint& p) const;
 
-    QPoint placeItem(const QString &uri, QPoint lastPos=QPoint(), bool force=false);
+    QPoint placeItem(UriId uri, QPoint lastPos=QPoint(), bool force=false);
 
 private:
     int                             mMaxRow = 0;
@@ -107,8 +109,8 @@ private:
     QSize                           mGridSize;
     QMargins                        mPanelMargins;
 
-    QHash<QString, QPoint>          mItems;
-    QHash<QString, QPoint>          mItemsMetaPoses;
+    QHash<UriId, QPoint>            mItems;
+    QHash<UriId, QPoint>            mItemsMetaPoses;
 
     QScreen*                        mScreen = nullptr;
 };
@@ -26,7 +26,7 @@
 
 #define INVALID_POS                 QPoint(-1, -1)
 
-static bool iconSizeLessThan (const QPair<QString, QPoint> &p1, const QPair<QString, QPoint> &p2);
+static bool iconSizeLessThan (const QPair<graceful::UriId, QPoint> &p1, const QPair<graceful::UriId, QPoint> &p2);
 
 namespace graceful
 {
@@ -83,8 +83,8 @@ IconView::IconView(QWidget *parent) : QAbstractItemView(parent)
 
     connect(qApp, &QGuiApplication::screenRemoved, this, [=] (QScreen* screen) {
         GScreen* s = nullptr;
-        QList<QPair<QString, QPoint>> uris;
-        QStringList ls;
+        QList<QPair<UriId, QPoint>> uris;
+        QList<UriId> ls;
         for (auto sc : mScreens) {
             if (sc->getScreen() == screen) {
                 uris << sc->getItemsAndPosAll();
@@ -139,13 +139,20 @@ IconView::IconView(QWidget *parent) : QAbstractItemView(parent)
             return ;
         }
 
-        QStringList uris = s->getAllItemsOnScreen();
+        QList<UriId> uris = s->getAllItemsOnScreen();
         for (auto uri : uris) {
             mItemsPosesCached.remove(uri);
         }
     });
 }
 
+IconView::~IconView()
+{
+    for (UriId uri : mInternedItems) {
+        UriAtoms::release(uri);
+    }
+}
+
 GScreen *IconView::getScreen(int screenId)
 {
     if (mScreens.count() > screenId) {
@@ -171,7 +178,7 @@ void IconView::swaGScreen(GScreen *screen1, GScreen *screen2)
         return;
     }
 
-    QStringList uris;
+    QList<UriId> uris;
     uris << screen1->getAllItemsOnScreen();
     uris << screen2->getAllItemsOnScreen();
 
@@ -253,10 +260,11 @@ QRect IconView::visualRect(const QModelIndex &index) const
     auto rect = QRect(QPoint(0, 0), getIconSize());
 
     if (index.isValid()) {
-        QString uri = index.data(FileModel::FileUriRole).toString();
+        UriId uri = getIndexUriId(index);
 
-        if (mItemsPosesCached.contains(uri)) {
-            rect.translate(mItemsPosesCached[uri]);
+        auto cached = mItemsPosesCached.constFind(uri);
+        if (cached != mItemsPosesCached.constEnd()) {
+            rect.translate(cached.value());
         } else {
             QPoint pos = getFileMetaInfoPos(uri);
             if (INVALID_POS != pos) {
@@ -294,17 +302,12 @@ QModelIndex IconView::indexAt(const QPoint &point) const
 
 QModelIndex IconView::findIndexByUri(const QString &uri) const
 {
-    if (model()) {
-        for (int row = 0; row < model()->rowCount(); row++) {
-            auto index = model()->index(row, 0);
-            auto indexUri = getIndexUri(index);
-            if (indexUri == uri) {
-                return index;
-            }
-        }
-    }
+    return findIndexByUriId(UriAtoms::lookup(uri));
+}
 
-    return QModelIndex();
+QModelIndex IconView::findIndexByUriId(UriId uri) const
+{
+    return mIndexes.value(uri);
 }
 
 QString IconView::getIndexUri(const QModelIndex &index) const
@@ -312,9 +315,21 @@ QString IconView::getIndexUri(const QModelIndex &index) const
     return index.data(FileModel::FileUriRole).toString();
 }
 
+UriId IconView::getIndexUriId(const QModelIndex &index) const
+{
+    UriId uri = index.data(FileModel::FileUriIdRole).toUInt();
+
+    // a model other than FileModel, interned by rowsInserted()
+    if (!uri && index.isValid()) {
+        uri = UriAtoms::lookup(getIndexUri(index));
+    }
+
+    return uri;
+}
+
 bool IconView::trySetIndexToPos(const QModelIndex &index, const QPoint &pos)
 {
-    QString uri = getIndexUri(index);
+    UriId uri = getIndexUriId(index);
     for (auto screen : mScreens) {
         if (!screen->isValidScreen()) {
             continue;
@@ -333,10 +348,15 @@ bool IconView::trySetIndexToPos(const QModelIndex &index, const QPoint &pos)
 
 bool IconView::isIndexOverlapped(const QModelIndex &index)
 {
-    return isItemOverlapped(getIndexUri(index));
+    return isItemOverlapped(getIndexUriId(index));
 }
 
 bool IconView::isItemOverlapped(const QString &uri)
+{
+    return isItemOverlapped(UriAtoms::lookup(uri));
+}
+
+bool IconView::isItemOverlapped(UriId uri)
 {
     auto itemPos = mItemsPosesCached.value(uri);
 
@@ -520,6 +540,14 @@ const QRect IconView::getBoundingRect()
 }
 
 QPoint IconView::getFileMetaInfoPos(const QString &uri) const
+{
+    // only the uris of items are known
+    UriId id = UriAtoms::lookup(uri);
+
+    return id ? getFileMetaInfoPos(id) : INVALID_POS;
+}
+
+QPoint IconView::getFileMetaInfoPos(UriId uri) const
 {
     QPoint poss = INVALID_POS;
     for (auto screen : mScreens) {
@@ -574,7 +602,7 @@ void IconView::paintEvent(QPaintEvent *event)
     QPainter p(viewport());
 
     for (auto item : mItems) {
-        auto index = findIndexByUri(item);
+        auto index = findIndexByUriId(item);
 
         QStyleOptionViewItem opt = viewOptions();
 
@@ -585,7 +613,7 @@ void IconView::paintEvent(QPaintEvent *event)
 
         opt.state |= QStyle::State_Enabled;
 
-        if (selectedIndexes().contains(index)) {
+        if (selectionModel()->isSelected(index)) {
             opt.state |= QStyle::State_Selected;
         } else {
             opt.state &= ~QStyle::State_Selected;
@@ -648,9 +676,9 @@ void IconView::dropEvent(QDropEvent* event)
         } else {
             QPoint offset = dropPoint - dragPoint;
             auto indexes = selectedIndexes();
-            QStringList itemsNeedBeRelayouted;
+            QList<UriId> itemsNeedBeRelayouted;
             for (auto index : indexes) {
-                QString uri = getIndexUri(index);
+                UriId uri = getIndexUriId(index);
                 mItemsPosesCached.remove(uri);
                 for (auto screen : mScreens) {
                     screen->makeItemGridPosInvalid(uri);
@@ -660,7 +688,7 @@ void IconView::dropEvent(QDropEvent* event)
 
             for (auto index : indexes) {
                 bool successed = false;
-                QString uri = getIndexUri(index);
+                UriId uri = getIndexUriId(index);
                 auto sourceRect = visualRect(index);
                 GScreen* srcScreen = getScreenByPos(sourceRect.topLeft());
                 sourceRect.translate(offset);
@@ -687,7 +715,11 @@ void IconView::dropEvent(QDropEvent* event)
 
     saveItemsPositions();
     viewport()->update();
-    model()->dropMimeData(event->mimeData(), action, -1, -1, index);
+
+    // QAbstractItemView::dropEvent() accepts what the model took, dropping it twice would copy twice
+    if (!event->isAccepted()) {
+        model()->dropMimeData(event->mimeData(), action, -1, -1, index);
+    }
     mDragFlag = false;
 }
 
@@ -938,14 +970,22 @@ void IconView::dataChanged(const QModelIndex &topLeft, const QModelIndex &bottom
 
 void IconView::rowsInserted(const QModelIndex &parent, int start, int end)
 {
-    QStringList needPut;
     for (int i = start; i <= end ; i++) {
         auto index = model()->index(i, 0);
 
         if (index.isValid()) {
             bool success = false;
-            QString uri = getIndexUri(index);
+            UriId uri = index.data(FileModel::FileUriIdRole).toUInt();
+            if (!uri) {
+                uri = UriAtoms::intern(getIndexUri(index));
+                if (!uri || mInternedItems.contains(uri)) {
+                    UriAtoms::release(uri);
+                } else {
+                    mInternedItems.insert(uri);
+                }
+            }
             mItems.append(uri);
+            mIndexes.insert(uri, QPersistentModelIndex(index));
 
             mItemsPosesCached.remove(uri);
             QPoint pos = getFileMetaInfoPos(uri);
@@ -973,14 +1013,19 @@ void IconView::rowsInserted(const QModelIndex &parent, int start, int end)
 
 void IconView::rowsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
 {
-    Q_UNUSED(end)
-    auto indexAboutToBeRemoved = model()->index(start, 0);
+    for (int i = start; i <= end; ++i) {
+        UriId uri = getIndexUriId(model()->index(i, 0));
+        if (mInternedItems.remove(uri)) {
+            UriAtoms::release(uri);
+        }
 
-    mItemsPosesCached.remove(getIndexUri(indexAboutToBeRemoved));
-    mItems.removeOne(getIndexUri(indexAboutToBeRemoved));
-    mFloatItems.removeOne(getIndexUri(indexAboutToBeRemoved));
-    for (auto screen : mScreens) {
-        screen->makeItemGridPosInvalid(getIndexUri(indexAboutToBeRemoved));
+        mItemsPosesCached.remove(uri);
+        mItems.removeOne(uri);
+        mFloatItems.removeOne(uri);
+        mIndexes.remove(uri);
+        for (auto screen : mScreens) {
+            screen->makeItemGridPosInvalid(uri);
+        }
     }
 
     relayoutItems(mFloatItems);
@@ -990,7 +1035,7 @@ void IconView::rowsAboutToBeRemoved(const QModelIndex &parent, int start, int en
 
 void IconView::saveItemsPositions()
 {
-    QStringList itemOnAllScreen;
+    QList<UriId> itemOnAllScreen;
     for (auto screen : mScreens) {
         itemOnAllScreen << screen->getItemsVisibleOnScreen();
     }
@@ -1019,7 +1064,7 @@ void IconView::saveItemsPositions()
 
 void IconView::handleScreenChanged(GScreen *screen)
 {
-    QList<QPair<QString, QPoint>> items = screen->getItemsAndPosAll();
+    QList<QPair<UriId, QPoint>> items = screen->getItemsAndPosAll();
 
     std::sort(items.begin(), items.end(), iconSizeLessThan);
 
@@ -1028,7 +1073,7 @@ void IconView::handleScreenChanged(GScreen *screen)
     bool allFull = false;
     for (auto it : items) {
         bool success = false;
-        QString uri = it.first;
+        UriId uri = it.first;
         QPoint pos = it.second;
         mItemsPosesCached.remove(uri);
         if (screen->posIsOnScreen(pos)) {
@@ -1083,7 +1128,7 @@ void IconView::handleGridSizeChanged()
     viewport()->update();
 }
 
-void IconView::relayoutItems(const QStringList &uris)
+void IconView::relayoutItems(const QList<UriId> &uris)
 {
     for (auto uri : uris) {
         mItemsPosesCached.remove(uri);
@@ -1112,7 +1157,7 @@ void IconView::relayoutItems(const QStringList &uris)
     }
 }
 
-GScreen *IconView::getItemScreen(const QString &uri)
+GScreen *IconView::getItemScreen(UriId uri)
 {
     for (auto screen : mScreens) {
         if (screen->isValidScreen()) {
@@ -1126,7 +1171,7 @@ GScreen *IconView::getItemScreen(const QString &uri)
 }
 }
 
-static bool iconSizeLessThan (const QPair<QString, QPoint> &p1, const QPair<QString, QPoint> &p2)
+static bool iconSizeLessThan (const QPair<graceful::UriId, QPoint> &p1, const QPair<graceful::UriId, QPoint> &p2)
 {
     if (p1.second.x() > p2.second.x())
         return false;
@@ -2,9 +2,14 @@
 #define ICONVIEW_H
 
 #include <QMap>
+#include <QSet>
+#include <QHash>
 #include <QTimer>
 #include <QQueue>
 #include <QAbstractItemView>
+#include <QPersistentModelIndex>
+
+#include "uri-atoms.h"
 
 class QRubberBand;
 
@@ -31,6 +36,7 @@ public:
     Q_ENUM(ZoomLevel)
 
     explicit IconView(QWidget *parent = nullptr);
+    ~IconView() override;
 
     void setGridSize(QSize size);
     GScreen* getScreen(int screenId);
@@ -41,12 +47,15 @@ public:
 
     QStringList getSelections();
     QString getIndexUri(const QModelIndex &index) const;
+    UriId getIndexUriId(const QModelIndex &index) const;
     QModelIndex findIndexByUri(const QString &uri) const;
+    QModelIndex findIndexByUriId(UriId uri) const;
     QModelIndex indexAt(const QPoint &point) const override;
     QRect visualRect(const QModelIndex &index) const override;
 
     bool isRenaming() const;
     bool isItemOverlapped(const QString &uri);
+    bool isItemOverlapped(UriId uri);
     bool isIndexOverlapped(const QModelIndex &index);
     bool trySetIndexToPos(const QModelIndex &index, const QPoint &pos);
 
@@ -69,6 +78,7 @@ public:
 
     void updateItemPosByUri(const QString &uri, const QPoint &pos);
     QPoint getFileMetaInfoPos(const QString &uri) const;
+    QPoint getFileMetaInfoPos(UriId uri) const;
 
     void refresh();
 
@@ -117,9 +127,9 @@ protected Q_SLOTS:
     void handleGridSizeChanged();
     void handleScreenChanged(GScreen *screen);
 
-    void relayoutItems(const QStringList &uris);
+    void relayoutItems(const QList<UriId> &uris);
 
-    GScreen* getItemScreen(const QString &uri);
+    GScreen* getItemScreen(UriId uri);
 
 private:
     bool                                mIsEdit = false;
@@ -145,11 +155,14 @@ private:
     QList <GScreen*>                    mScreens;
     GScreen*                            mPrimaryScreen;
 
-    QStringList                         mItems;
-    QStringList                         mFloatItems;
-    QMap<QString, QPoint>               mItemsPosesCached;
+    // layout works on interned uris only
+    QList<UriId>                        mItems;
+    QList<UriId>                        mFloatItems;
+    QHash<UriId, QPoint>                mItemsPosesCached;
+    QHash<UriId, QPersistentModelIndex> mIndexes;
+    QSet<UriId>                         mInternedItems;         // held by the view, the model has no FileUriIdRole
 
-    QQueue<QString>                     mTobeRendered;
+    QQueue<UriId>                       mTobeRendered;
 
     QPoint                              mPressPos;
     QPoint                              mDragStartPos;
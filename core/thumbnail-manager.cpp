@@ -1,84 +1,395 @@
 #include "thumbnail-manager.h"
 #include "regular-file-type.h"
 #include "file/file.h"
+#include "file/mime-classifier.h"
 #include "log/log.h"
 #include <gio/gio.h>
 
 #include "global-settings.h"
 
-#include <QMap>
+#include <QSet>
+#include <QFile>
+#include <QHash>
+#include <QCache>
 #include <QIcon>
 #include <QImage>
 #include <QDebug>
 #include <QMutex>
+#include <QThread>
+#include <QSaveFile>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QThreadPool>
+#include <QTransform>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QSharedPointer>
+#include <QGuiApplication>
+#include <QCryptographicHash>
+
+#include <string.h>
+#include <sys/stat.h>
+
+#define THUMBNAIL_SIZE                          128             // longest side of a thumbnail
+#define THUMBNAIL_THREAD_MAX                    4               // decodes at once, beyond that they wait on the disk
+#define THUMBNAIL_CACHE_BYTES                   (64 << 20)      // about 1000 thumbnails of 128x128
+#define THUMBNAIL_FAILED_MAX                    4096            // uris remembered as failed, fail/ keeps the rest
+#define THUMBNAIL_EXIF_READ_MAX                 (64 << 10)      // the exif segment is at the start of a jpeg, at most 64 KiB
+#define THUMBNAIL_EXIF_ASPECT_DIFF              0.02            // exif thumbnails cropped or letterboxed beyond this are not used
+#define THUMBNAIL_KEY_URI                       "Thumb::URI"    // png text chunks of the freedesktop thumbnail spec
+#define THUMBNAIL_KEY_MTIME                     "Thumb::MTime"
 
 static QIcon imageToIcon (const QImage& image, const QSize& size);
+static bool parseExif (const uchar* data, int len, int& thumbOffset, int& thumbLength, int& orientation);
+static QImage readExifThumbnail (const QString& path, const QSize& imageSize);
+static QImage applyOrientation (const QImage& image, int orientation);
 
 graceful::ThumbnailManager* graceful::ThumbnailManager::gThumbnailManager = new ThumbnailManager;
 
 namespace graceful
 {
+struct ThumbnailRequest
+{
+    QString                                 uri;
+    int                                     users = 1;                              // callers waiting, GUI thread only
+    QAtomicInt                              cancelled;
+};
+typedef QSharedPointer<ThumbnailRequest> ThumbnailRequestPtr;
+
+struct ThumbnailResult
+{
+    ThumbnailRequestPtr                     request;
+    QImage                                  image;                                  // null if the decode failed
+};
+
 class ThumbnailManagerPrivate
 {
 public:
-    ThumbnailManagerPrivate();
+    explicit ThumbnailManagerPrivate(ThumbnailManager* q);
     ~ThumbnailManagerPrivate();
 
-    QImage getPictureThumbnail(File& file);
-    QImage getStandardThumbnail(File& file) const;
+    static QImage decodeThumbnail(const QString& path);
+
+    /**
+     * @brief
+     * the thumbnail spec store shared with other desktop components, under
+     * ~/.cache/thumbnails. A file is the md5 of the uri, valid while its
+     * Thumb::URI and Thumb::MTime match the source. 'failed' is set by an
+     * entry of fail/ telling the source could not be thumbnailed
+     */
+    static QImage readCachedThumbnail(const QString& uri, qint64 mtime, bool& failed);
+    static QImage readCacheFile(const QString& file, const QString& uri, qint64 mtime);
+
+    /**
+     * @brief
+     * store 'image' in normal/, or a fail/ entry if null
+     */
+    static void writeCachedThumbnail(const QString& uri, qint64 mtime, const QImage& image);
+    static QString cacheDir();
+    static QString cacheName(const QString& uri);
+
+    /**
+     * @brief
+     * the theme icon 'gicon' at 'size', shared by every file with the same
+     * GIcon until the icon theme changes
+     */
+    QIcon getStandardThumbnail(GIcon* gicon, const QSize& size);
+
+    void queueThumbnail(const QString& uri);
+
+    /**
+     * @brief
+     * the thumbnail of 'uri' in memory, counted as a hit or a miss
+     */
+    QIcon cachedThumbnail(const QString& uri);
+    void cacheThumbnail(const QString& uri, const QImage& image);
+    void finishJob(const ThumbnailResult& result);
 
 public:
-    int                                     mMaxSize = 1000;
+    int                                     mNextPriority = 0;                      // the latest requests first, they are on screen
     QIcon                                   mInvalidIcon;
-    QMutex                                  mLock;
-    QMap<QString, QImage>*                  mUriImage = nullptr;                    // The icon corresponding to the file // maybe use shared ptr
+    QMutex                                  mLock;                                  // mDone
+    QList<ThumbnailResult>                  mDone;
+    QThreadPool*                            mPool = nullptr;
+    QHash<QString, ThumbnailRequestPtr>     mPending;
+    QSet<QString>                           mFailed;
+    bool                                    mWatchingTheme = false;
+    QHash<QString, QIcon>                   mStandardIcons;                         // "<GIcon>@<size>@<dpr>" -> icon, null if the theme has none
+    QCache<QString, QIcon>                  mCache;                                 // least recently used go first, cost in bytes
+    ThumbnailManager::CacheStatistics       mStatistics;
+    ThumbnailManager*                       q_ptr = nullptr;
+};
+
+class ThumbnailJob : public QRunnable
+{
+public:
+    ThumbnailJob(ThumbnailManagerPrivate* d, const ThumbnailRequestPtr& request) : mD(d), mRequest(request)
+    {
+        setAutoDelete(true);
+    }
+
+    void run() override
+    {
+        // cancelled while queued, most of them when the view scrolled away
+        if (mRequest->cancelled.loadAcquire()) {
+            return;
+        }
+
+        ThumbnailResult result;
+        result.request = mRequest;
+
+        const QString& uri = mRequest->uri;
+        g_autoptr(GFile) file = g_file_new_for_uri(uri.toUtf8().constData());
+        g_autofree char* path = g_file_get_path(file);
+
+        struct stat st;
+        if (!path || 0 != ::stat(path, &st)) {
+            mD->finishJob(result);
+            return;
+        }
+
+        // a png read instead of a decode, also for images thumbnailed by other programs
+        bool failed = false;
+        result.image = ThumbnailManagerPrivate::readCachedThumbnail(uri, qint64(st.st_mtime), failed);
+        if (!result.image.isNull() || failed) {
+            mD->finishJob(result);
+            return;
+        }
+
+        QString localPath = QFile::decodeName(path);
+        result.image = ThumbnailManagerPrivate::decodeThumbnail(localPath);
+        mD->finishJob(result);
+
+        // the view already has it, the store is filled after
+        if (!localPath.startsWith(ThumbnailManagerPrivate::cacheDir())) {
+            ThumbnailManagerPrivate::writeCachedThumbnail(uri, qint64(st.st_mtime), result.image);
+        }
+    }
+
+private:
+    ThumbnailManagerPrivate*                mD = nullptr;
+    ThumbnailRequestPtr                     mRequest;
 };
 
-ThumbnailManagerPrivate::ThumbnailManagerPrivate()
+ThumbnailManagerPrivate::ThumbnailManagerPrivate(ThumbnailManager* q) : mCache(THUMBNAIL_CACHE_BYTES), q_ptr(q)
 {
-    mUriImage = new QMap<QString, QImage>();
 }
 
 ThumbnailManagerPrivate::~ThumbnailManagerPrivate()
 {
-    if (mUriImage)                          delete mUriImage;
+    if (mPool) {
+        mPool->clear();
+        mPool->waitForDone();
+        delete mPool;
+    }
 }
 
-QImage ThumbnailManagerPrivate::getPictureThumbnail(File &file)
+QImage ThumbnailManagerPrivate::decodeThumbnail(const QString& path)
 {
-    QString uri = file.uri();
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+
+    QSize size = reader.size();
+    bool large = size.isValid() && (size.width() > THUMBNAIL_SIZE || size.height() > THUMBNAIL_SIZE);
 
-    if (mUriImage->contains(uri)) {
-        return mUriImage->value(uri);
+    // the preview a camera stored is enough, the photo itself is not read
+    if (large && "jpeg" == reader.format()) {
+        QImage img = readExifThumbnail(path, size);
+        if (!img.isNull()) {
+            return img;
+        }
     }
 
-    QImage img(file.path());
-    if (img.size().width() > 128) {
-        img = img.scaledToWidth(128, Qt::SmoothTransformation);
+    // decoded at the thumbnail size, jpeg scales by 1/2, 1/4 or 1/8 in the DCT first
+    if (large) {
+        reader.setScaledSize(size.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio).expandedTo(QSize(1, 1)));
     }
 
-    if (img.size().height() > 128) {
-        img = img.scaledToHeight(128, Qt::SmoothTransformation);
+    QImage img = reader.read();
+
+    // formats which can't scale while decoding
+    if (img.width() > THUMBNAIL_SIZE || img.height() > THUMBNAIL_SIZE) {
+        img = img.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
     }
 
-    if (mUriImage->size() >= mMaxSize) {
-        mUriImage->clear();
+    return img;
+}
+
+QImage ThumbnailManagerPrivate::readCachedThumbnail(const QString& uri, qint64 mtime, bool& failed)
+{
+    QString name = cacheName(uri);
+
+    // normal/ is the size shown, larger ones made by others are scaled down
+    static const char* gDirs[] = {"normal/", "large/", "x-large/", "xx-large/"};
+    for (const char* dir : gDirs) {
+        QImage img = readCacheFile(cacheDir() + QLatin1String(dir) + name, uri, mtime);
+        if (!img.isNull()) {
+            if (img.width() > THUMBNAIL_SIZE || img.height() > THUMBNAIL_SIZE) {
+                img = img.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            }
+            return img;
+        }
     }
 
-    mUriImage->insert(uri, img);
+    failed = !readCacheFile(cacheDir() + QStringLiteral("fail/graceful-" VERSION "/") + name, uri, mtime).isNull();
 
-    return img;
+    return QImage();
 }
 
-QImage ThumbnailManagerPrivate::getStandardThumbnail(File &file) const
+QImage ThumbnailManagerPrivate::readCacheFile(const QString& file, const QString& uri, qint64 mtime)
 {
-    QString uri = file.uri();
+    if (!QFile::exists(file)) {
+        return QImage();
+    }
 
-    GFileInfo* fileInfo = const_cast<GFileInfo*>(file.getGFileStandardInfo());
-    gf_return_val_if_fail(fileInfo, QImage());
+    // the text chunks come before the pixels, a stale thumbnail is not decoded
+    QImageReader reader(file, "png");
+    if (reader.text(THUMBNAIL_KEY_URI) != uri || reader.text(THUMBNAIL_KEY_MTIME).toLongLong() != mtime) {
+        return QImage();
+    }
 
-    GIcon* icons = g_file_info_get_symbolic_icon(fileInfo);
-    g_autofree gchar* iconNames = g_icon_to_string(icons);
+    return reader.read();
+}
+
+void ThumbnailManagerPrivate::writeCachedThumbnail(const QString& uri, qint64 mtime, const QImage& image)
+{
+    QString dir = cacheDir() + (image.isNull() ? QStringLiteral("fail/graceful-" VERSION "/") : QStringLiteral("normal/"));
+    if (0 != g_mkdir_with_parents(QFile::encodeName(dir).constData(), 0700)) {
+        log_debug("create thumbnail dir '%s' error", dir.toUtf8().constData());
+        return;
+    }
+
+    // a fail entry is an empty image with the keys
+    QImage img = image.isNull() ? QImage(1, 1, QImage::Format_ARGB32) : image;
+    if (image.isNull()) {
+        img.fill(Qt::transparent);
+    }
+    img.setText(THUMBNAIL_KEY_URI, uri);
+    img.setText(THUMBNAIL_KEY_MTIME, QString::number(mtime));
+    img.setText(QStringLiteral("Software"), QStringLiteral("graceful " VERSION));
+
+    // other programs never read a partial thumbnail
+    QString path = dir + cacheName(uri);
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        log_debug("open thumbnail '%s' error", path.toUtf8().constData());
+        return;
+    }
+
+    // private before the first byte, the rename keeps the mode
+    file.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+
+    QImageWriter writer(&file, "png");
+    if (!writer.write(img) || !file.commit()) {
+        log_debug("write thumbnail '%s' error", path.toUtf8().constData());
+        return;
+    }
+}
+
+QString ThumbnailManagerPrivate::cacheDir()
+{
+    static const QString gDir = QFile::decodeName(g_get_user_cache_dir()) + QStringLiteral("/thumbnails/");
+
+    return gDir;
+}
+
+QString ThumbnailManagerPrivate::cacheName(const QString& uri)
+{
+    QByteArray key = QCryptographicHash::hash(uri.toUtf8(), QCryptographicHash::Md5).toHex();
+
+    return QString::fromLatin1(key) + QStringLiteral(".png");
+}
+
+void ThumbnailManagerPrivate::queueThumbnail(const QString& uri)
+{
+    if (mFailed.contains(uri)) {
+        return;
+    }
+
+    auto it = mPending.find(uri);
+    if (mPending.end() != it) {
+        ++it.value()->users;
+        return;
+    }
+
+    // created on first use, not while the statics are set up
+    if (!mPool) {
+        mPool = new QThreadPool;
+        mPool->setMaxThreadCount(qBound(1, QThread::idealThreadCount(), THUMBNAIL_THREAD_MAX));
+    }
+
+    ThumbnailRequestPtr request(new ThumbnailRequest);
+    request->uri = uri;
+    mPending.insert(uri, request);
+
+    mPool->start(new ThumbnailJob(this, request), ++mNextPriority);
+}
+
+QIcon ThumbnailManagerPrivate::cachedThumbnail(const QString& uri)
+{
+    // also makes it the most recently used
+    const QIcon* icon = mCache.object(uri);
+    if (!icon) {
+        ++mStatistics.misses;
+        return QIcon();
+    }
+
+    ++mStatistics.hits;
+
+    return *icon;
+}
+
+void ThumbnailManagerPrivate::cacheThumbnail(const QString& uri, const QImage& image)
+{
+    int cost = image.bytesPerLine() * image.height();
+    int before = mCache.count() - (mCache.contains(uri) ? 1 : 0);
+
+    // pixmaps only in the GUI thread
+    if (!mCache.insert(uri, new QIcon(QPixmap::fromImage(image)), cost)) {
+        log_debug("thumbnail of '%s' is over the cache limit", uri.toUtf8().constData());
+        return;
+    }
+
+    // the least recently used make room, a few at a time
+    mStatistics.evictions += quint64(qMax(0, before + 1 - mCache.count()));
+}
+
+void ThumbnailManagerPrivate::finishJob(const ThumbnailResult& result)
+{
+    bool first = false;
+    {
+        QMutexLocker locker(&mLock);
+        first = mDone.isEmpty();
+        mDone << result;
+    }
+
+    // one call takes every thumbnail decoded meanwhile
+    if (first) {
+        QMetaObject::invokeMethod(q_ptr, "onThumbnailsDecoded", Qt::QueuedConnection);
+    }
+}
+
+QIcon ThumbnailManagerPrivate::getStandardThumbnail(GIcon* gicon, const QSize& size)
+{
+    gf_return_val_if_fail(G_IS_ICON(gicon), QIcon());
+
+    g_autofree gchar* iconNames = g_icon_to_string(gicon);
+
+    // connected on first use, the settings need the application
+    if (!mWatchingTheme) {
+        mWatchingTheme = true;
+        QObject::connect(GlobalSettings::getInstance(), &GlobalSettings::iconThemeChanged, q_ptr, [=] () {
+            log_debug("icon theme changed, %d standard icons dropped", mStandardIcons.size());
+            mStandardIcons.clear();
+        });
+    }
+
+    // the theme is searched once per type, size and scale, not once per file
+    QString key = QString::fromUtf8(iconNames) + QStringLiteral("@%1x%2@%3").arg(size.width()).arg(size.height()).arg(qGuiApp->devicePixelRatio());
+    auto it = mStandardIcons.constFind(key);
+    if (mStandardIcons.constEnd() != it) {
+        return it.value();
+    }
 
     log_debug("get icon name:%s", iconNames);
 
@@ -88,12 +399,15 @@ QImage ThumbnailManagerPrivate::getStandardThumbnail(File &file) const
     for (auto n = qiconNames.constBegin(); n != qiconNames.constEnd(); ++n) {
         QIcon icon = QIcon::fromTheme(*n);
         if (!icon.isNull()) {
-            log_debug("file '%s' get icon '%s'", file.uriDisplay().toUtf8().constData(), (*n).toUtf8().constData());
+            log_debug("icon '%s' found in the theme", (*n).toUtf8().constData());
             bicon = icon;
         }
     }
 
-    return bicon.isNull() ? QImage() : bicon.pixmap(QSize(128, 128)).toImage();
+    QIcon icon = bicon.isNull() ? QIcon() : imageToIcon(bicon.pixmap(QSize(128, 128)).toImage(), size);
+    mStandardIcons.insert(key, icon);
+
+    return icon;
 }
 }
 
@@ -108,15 +422,269 @@ QIcon graceful::ThumbnailManager::getIcon(File& file, const QSize& size)
 {
     Q_D(ThumbnailManager);
 
-    gf_return_val_if_fail(file.isValid(), d->mInvalidIcon);
+    // painting never waits on the disk, only the info already loaded is used.
+    // Until the listing brings the standard group the type is guessed from the name
+    GIcon* gicon = nullptr;
+    bool image = false;
+    g_autoptr(GIcon) guessedIcon = nullptr;
+    if (file.loadedAttributes() & File::AttributeStandard) {
+        GFileInfo* fileInfo = const_cast<GFileInfo*>(file.getGFileStandardInfo());
+        gf_return_val_if_fail(fileInfo && g_file_info_has_attribute(fileInfo, G_FILE_ATTRIBUTE_STANDARD_TYPE), d->mInvalidIcon);
+        gicon = g_file_info_get_symbolic_icon(fileInfo);
+
+        // not File::isImage(), it reads files without an extension
+        if (G_FILE_TYPE_REGULAR == g_file_info_get_file_type(fileInfo)) {
+            MIMEType type = MimeClassifier::fromFileName(file.fileName());
+            if (FILE_TYPE_UNKNOW == type && g_file_info_has_attribute(fileInfo, G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE)) {
+                type = MimeClassifier::fromContentType(g_file_info_get_content_type(fileInfo));
+            }
+            image = (FILE_TYPE_IMAGE == type);
+        }
+    }
+    if (!gicon) {
+        g_autofree char* guessed = g_content_type_guess(file.fileName().toUtf8().constData(), nullptr, 0, nullptr);
+        guessedIcon = g_content_type_get_symbolic_icon(guessed);
+        gicon = guessedIcon;
+        image = image || g_str_has_prefix(guessed, "image/");
+    }
 
-    if (file.isImage()) {
-        log_debug("file is image!");
-        return imageToIcon(d->getPictureThumbnail(file), size);
+    if (image) {
+        QString uri = file.uri();
+        QIcon icon = d->cachedThumbnail(uri);
+        if (!icon.isNull()) {
+            return size.isValid() ? imageToIcon(icon.pixmap(THUMBNAIL_SIZE, THUMBNAIL_SIZE).toImage(), size) : icon;
+        }
+        log_debug("file is image, thumbnail queued");
+        d->queueThumbnail(uri);
     }
 
     log_debug("get standard file info's icon!");
-    return imageToIcon(d->getStandardThumbnail(file), size);
+    return d->getStandardThumbnail(gicon, size);
+}
+
+QIcon graceful::ThumbnailManager::thumbnail(const QString& uri)
+{
+    Q_D(ThumbnailManager);
+
+    QIcon icon = d->cachedThumbnail(uri);
+    if (icon.isNull()) {
+        d->queueThumbnail(uri);
+    }
+
+    return icon;
+}
+
+void graceful::ThumbnailManager::cancelThumbnail(const QString& uri)
+{
+    Q_D(ThumbnailManager);
+
+    auto it = d->mPending.find(uri);
+    if (d->mPending.end() == it || --it.value()->users > 0) {
+        return;
+    }
+
+    // a decode already running is let finish, its result is dropped
+    it.value()->cancelled.storeRelease(1);
+    d->mPending.erase(it);
+}
+
+void graceful::ThumbnailManager::setCacheLimit(int bytes)
+{
+    Q_D(ThumbnailManager);
+
+    gf_return_if_fail(bytes >= 0);
+
+    int before = d->mCache.count();
+    d->mCache.setMaxCost(bytes);
+    d->mStatistics.evictions += quint64(before - d->mCache.count());
+}
+
+int graceful::ThumbnailManager::cacheLimit() const
+{
+    Q_D(const ThumbnailManager);
+
+    return d->mCache.maxCost();
+}
+
+graceful::ThumbnailManager::CacheStatistics graceful::ThumbnailManager::cacheStatistics() const
+{
+    Q_D(const ThumbnailManager);
+
+    CacheStatistics statistics = d->mStatistics;
+    statistics.count = d->mCache.count();
+    statistics.bytes = d->mCache.totalCost();
+
+    return statistics;
+}
+
+void graceful::ThumbnailManager::onThumbnailsDecoded()
+{
+    Q_D(ThumbnailManager);
+
+    QList<ThumbnailResult> done;
+    {
+        QMutexLocker locker(&d->mLock);
+        done.swap(d->mDone);
+    }
+
+    for (const auto& result : done) {
+        if (result.request->cancelled.loadAcquire()) {
+            continue;
+        }
+
+        const QString& uri = result.request->uri;
+        d->mPending.remove(uri);
+
+        if (result.image.isNull()) {
+            log_debug("no thumbnail for '%s'", uri.toUtf8().constData());
+            if (d->mFailed.size() >= THUMBNAIL_FAILED_MAX) {
+                d->mFailed.clear();
+            }
+            d->mFailed.insert(uri);
+            Q_EMIT thumbnailFinished(uri, false);
+            continue;
+        }
+
+        d->cacheThumbnail(uri, result.image);
+        Q_EMIT thumbnailFinished(uri, true);
+    }
+}
+
+static inline quint32 exifRead (const uchar* p, int bytes, bool bigEndian)
+{
+    quint32 v = 0;
+    for (int i = 0; i < bytes; ++i) {
+        v |= quint32(p[bigEndian ? i : bytes - 1 - i]) << (8 * (bytes - 1 - i));
+    }
+
+    return v;
+}
+
+static bool parseExif (const uchar* data, int len, int& thumbOffset, int& thumbLength, int& orientation)
+{
+    orientation = 1;
+    thumbOffset = thumbLength = 0;
+
+    if (len < 4 || 0xFF != data[0] || 0xD8 != data[1]) {
+        return false;
+    }
+
+    // the segments before the image data, until the APP1 one holding "Exif\0\0"
+    const uchar* tiff = nullptr;
+    int tiffLen = 0;
+    for (int pos = 2; pos + 4 <= len && 0xFF == data[pos];) {
+        int marker = data[pos + 1];
+        int segLen = int(exifRead(data + pos + 2, 2, true));
+        if (0xDA == marker || 0xD9 == marker || segLen < 2) {
+            break;
+        }
+        if (0xE1 == marker && segLen >= 8 && pos + 4 + 6 <= len && 0 == memcmp(data + pos + 4, "Exif\0\0", 6)) {
+            tiff = data + pos + 10;
+            tiffLen = qMin(segLen - 8, len - pos - 10);
+            break;
+        }
+        pos += 2 + segLen;
+    }
+
+    if (!tiff || tiffLen < 8) {
+        return false;
+    }
+
+    bool bigEndian = ('M' == tiff[0]);
+    if ((bigEndian ? 'M' : 'I') != tiff[0] || tiff[0] != tiff[1] || 42 != exifRead(tiff + 2, 2, bigEndian)) {
+        return false;
+    }
+
+    // IFD0 holds the orientation, IFD1 the thumbnail. The offsets come from
+    // the file, summed in 64 bits so none of them wraps around
+    quint64 ifd = exifRead(tiff + 4, 4, bigEndian);
+    for (int n = 0; n < 2 && ifd > 0 && ifd + 2 <= quint64(tiffLen); ++n) {
+        int count = int(exifRead(tiff + ifd, 2, bigEndian));
+        if (ifd + 2 + quint64(count) * 12 + 4 > quint64(tiffLen)) {
+            return false;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            const uchar* entry = tiff + ifd + 2 + i * 12;
+            quint32 tag = exifRead(entry, 2, bigEndian);
+            if (0 == n && 0x0112 == tag) {
+                orientation = int(exifRead(entry + 8, 2, bigEndian));
+            } else if (1 == n && 0x0201 == tag) {
+                thumbOffset = int(exifRead(entry + 8, 4, bigEndian));
+            } else if (1 == n && 0x0202 == tag) {
+                thumbLength = int(exifRead(entry + 8, 4, bigEndian));
+            }
+        }
+
+        ifd = exifRead(tiff + ifd + 2 + count * 12, 4, bigEndian);
+    }
+
+    if (thumbOffset <= 0 || thumbLength <= 0 || thumbOffset > tiffLen - thumbLength) {
+        return false;
+    }
+
+    // from the start of the file
+    thumbOffset += int(tiff - data);
+
+    return true;
+}
+
+static QImage readExifThumbnail (const QString& path, const QSize& imageSize)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QImage();
+    }
+
+    QByteArray head = file.read(THUMBNAIL_EXIF_READ_MAX);
+
+    int offset = 0;
+    int length = 0;
+    int orientation = 1;
+    if (!parseExif(reinterpret_cast<const uchar*>(head.constData()), head.size(), offset, length, orientation)) {
+        return QImage();
+    }
+
+    QImage img = QImage::fromData(reinterpret_cast<const uchar*>(head.constData()) + offset, length, "JPEG");
+    if (img.isNull() || qMax(img.width(), img.height()) < THUMBNAIL_SIZE) {
+        return QImage();
+    }
+
+    // both are stored unrotated, black bars of a 4:3 preview of a 3:2 photo don't belong in a thumbnail
+    double ratio = double(img.width()) / img.height();
+    double imageRatio = double(imageSize.width()) / imageSize.height();
+    if (qAbs(ratio - imageRatio) > imageRatio * THUMBNAIL_EXIF_ASPECT_DIFF) {
+        return QImage();
+    }
+
+    if (img.width() > THUMBNAIL_SIZE || img.height() > THUMBNAIL_SIZE) {
+        img = img.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    return applyOrientation(img, orientation);
+}
+
+static QImage applyOrientation (const QImage& image, int orientation)
+{
+    // exif orientation: 2-4 mirror, 5-8 rotate by 90 degrees and maybe mirror
+    switch (orientation) {
+    case 2:
+        return image.mirrored(true, false);
+    case 3:
+        return image.mirrored(true, true);
+    case 4:
+        return image.mirrored(false, true);
+    case 5:
+        return image.transformed(QTransform().rotate(90)).mirrored(true, false);
+    case 6:
+        return image.transformed(QTransform().rotate(90));
+    case 7:
+        return image.transformed(QTransform().rotate(90)).mirrored(false, true);
+    case 8:
+        return image.transformed(QTransform().rotate(270));
+    }
+
+    return image;
 }
 
 static QIcon imageToIcon (const QImage& image, const QSize& size)
@@ -133,7 +701,7 @@ static QIcon imageToIcon (const QImage& image, const QSize& size)
     return icon;
 }
 
-graceful::ThumbnailManager::ThumbnailManager(QObject *parent) : QObject(parent), d_ptr(new ThumbnailManagerPrivate)
+graceful::ThumbnailManager::ThumbnailManager(QObject *parent) : QObject(parent), d_ptr(new ThumbnailManagerPrivate(this))
 {
 
 }
@@ -9,14 +9,67 @@ namespace graceful
 {
 class File;
 class ThumbnailManagerPrivate;
+
+/**
+ * @brief
+ * Icons and thumbnails of files. Images are decoded by a small pool of
+ * worker threads, never by the caller: until a thumbnail is made, its file
+ * gets the icon of its type and thumbnailFinished() tells when to ask again.
+ * Thumbnails are first read from the freedesktop store in ~/.cache/thumbnails,
+ * which other desktop components share, the ones decoded here are written
+ * back to it. In memory they are kept within a budget of bytes, the least
+ * recently shown go first. Must be used from the GUI thread.
+ */
 class GRACEFUL_API ThumbnailManager : public QObject
 {
     Q_OBJECT
 public:
+    struct CacheStatistics
+    {
+        quint64                             hits = 0;
+        quint64                             misses = 0;
+        quint64                             evictions = 0;
+        int                                 count = 0;              // thumbnails held
+        int                                 bytes = 0;
+    };
+
     static ThumbnailManager* getInstance();
+
+    /**
+     * @brief
+     * the thumbnail of an image already made, the icon of its type otherwise.
+     * No I/O, a 'file' without its standard group gets the type of its name
+     */
     QIcon getIcon(File& file, const QSize &size = QSize());
 
+    /**
+     * @brief
+     * the thumbnail of the image 'uri' if made, else a null icon and one
+     * request is added to the queued decode of 'uri'. Images which failed
+     * to decode are not queued again
+     */
+    QIcon thumbnail(const QString& uri);
+
+    /**
+     * @brief
+     * drop one request of 'uri', it is dequeued when no caller wants it anymore
+     */
+    void cancelThumbnail(const QString& uri);
+
+    /**
+     * @brief
+     * memory the thumbnails may take, 64 MiB by default. Lowering it evicts
+     * the least recently used at once
+     */
+    void setCacheLimit(int bytes);
+    int cacheLimit() const;
+    CacheStatistics cacheStatistics() const;
+
 Q_SIGNALS:
+    void thumbnailFinished(const QString& uri, bool successed);
+
+private Q_SLOTS:
+    void onThumbnailsDecoded();
 
 private:
     explicit ThumbnailManager(QObject *parent = nullptr);
@@ -1,25 +1,218 @@
 #include "utils.h"
 
-QString graceful::Utils::urlEncode(const QString &url)
+#include <string.h>
+
+#include <QVarLengthArray>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define UTILS_URL_STACK_SIZE            1024                // most uris are encoded without touching the heap
+
+namespace graceful
 {
-    QString decodeUrl = urlDecode(url);
+// RFC 3986 path characters: unreserved, sub-delims, ':', '@' and '/', plus every
+// byte of a non ASCII UTF-8 sequence. GIO's own uris use a subset of these
+static inline bool isUrlSafe(uchar c)
+{
+    return c >= 0x80
+        || (c >= '&' && c <= ';')                           // & ' ( ) * + , - . / 0-9 : ;
+        || (c >= '@' && c <= 'Z')                           // @ A-Z
+        || (c >= 'a' && c <= 'z')
+        || '!' == c || '$' == c || '=' == c || '_' == c || '~' == c;
+}
 
-    if (!decodeUrl.isEmpty()) {
-        g_autofree gchar* encodeUrl = g_uri_escape_string (decodeUrl.toUtf8().constData(), ":/", true);
-        return encodeUrl;
+static inline bool isValidEscape(const char* url, int len, int i)
+{
+    return '%' == url[i] && i + 2 < len && g_ascii_isxdigit(url[i + 1]) && g_ascii_isxdigit(url[i + 2]);
+}
+
+/**
+ * @brief
+ * index of the first byte from 'i' on which isn't url safe, 'len' if there is none
+ */
+static int skipUrlSafe(const char* url, int len, int i)
+{
+#ifdef __SSE2__
+    // 16 bytes per step, the same classes as isUrlSafe(), bytes >= 0x80 are negative
+    const __m128i ampLo = _mm_set1_epi8('&' - 1);
+    const __m128i semicolonHi = _mm_set1_epi8(';' + 1);
+    const __m128i upperLo = _mm_set1_epi8('@' - 1);
+    const __m128i upperHi = _mm_set1_epi8('Z' + 1);
+    const __m128i lowerLo = _mm_set1_epi8('a' - 1);
+    const __m128i lowerHi = _mm_set1_epi8('z' + 1);
+    const __m128i exclamation = _mm_set1_epi8('!');
+    const __m128i dollar = _mm_set1_epi8('$');
+    const __m128i equal = _mm_set1_epi8('=');
+    const __m128i underscore = _mm_set1_epi8('_');
+    const __m128i tilde = _mm_set1_epi8('~');
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(url + i));
+        __m128i safe = _mm_cmplt_epi8(v, zero);
+        safe = _mm_or_si128(safe, _mm_and_si128(_mm_cmpgt_epi8(v, ampLo), _mm_cmplt_epi8(v, semicolonHi)));
+        safe = _mm_or_si128(safe, _mm_and_si128(_mm_cmpgt_epi8(v, upperLo), _mm_cmplt_epi8(v, upperHi)));
+        safe = _mm_or_si128(safe, _mm_and_si128(_mm_cmpgt_epi8(v, lowerLo), _mm_cmplt_epi8(v, lowerHi)));
+        safe = _mm_or_si128(safe, _mm_cmpeq_epi8(v, exclamation));
+        safe = _mm_or_si128(safe, _mm_cmpeq_epi8(v, dollar));
+        safe = _mm_or_si128(safe, _mm_cmpeq_epi8(v, equal));
+        safe = _mm_or_si128(safe, _mm_cmpeq_epi8(v, underscore));
+        safe = _mm_or_si128(safe, _mm_cmpeq_epi8(v, tilde));
+
+        int mask = _mm_movemask_epi8(safe);
+        if (0xFFFF != mask) {
+            return i + __builtin_ctz(uint(~mask));
+        }
     }
+#endif
 
-    g_autofree gchar* encodeUrl = g_uri_escape_string (url.toUtf8().constData(), ":/", true);
+    while (i < len && isUrlSafe(uchar(url[i]))) {
+        ++i;
+    }
 
-    return encodeUrl;
+    return i;
+}
+}
+
+QString graceful::Utils::urlEncode(const QString &url)
+{
+    QByteArray utf8 = url.toUtf8();
+    if (isUrlEncoded(utf8.constData(), utf8.size())) {
+        return url;
+    }
+
+    return QString::fromUtf8(urlEncode(utf8));
 }
 
 QString graceful::Utils::urlDecode(const QString &url)
 {
-    g_autofree gchar* decodeUrl = g_uri_unescape_string(url.toUtf8(), ":/");
-    if (!decodeUrl) {
+    QByteArray utf8 = url.toUtf8();
+    if (!utf8.contains('%')) {
+        return url;
+    }
+
+    QVarLengthArray<char, UTILS_URL_STACK_SIZE> buf(utf8.size());
+    int len = urlDecode(utf8.constData(), utf8.size(), buf.data());
+    if (len < 0) {
+        return url;
+    }
+
+    return QString::fromUtf8(buf.constData(), len);
+}
+
+QByteArray graceful::Utils::urlEncode(const QByteArray& url)
+{
+    if (isUrlEncoded(url.constData(), url.size())) {
         return url;
     }
 
-    return decodeUrl;
+    QVarLengthArray<char, UTILS_URL_STACK_SIZE> buf(3 * url.size());
+    int len = urlEncode(url.constData(), url.size(), buf.data());
+
+    return QByteArray(buf.constData(), len);
+}
+
+QByteArray graceful::Utils::urlDecode(const QByteArray& url)
+{
+    if (!url.contains('%')) {
+        return url;
+    }
+
+    QVarLengthArray<char, UTILS_URL_STACK_SIZE> buf(url.size());
+    int len = urlDecode(url.constData(), url.size(), buf.data());
+    if (len < 0) {
+        return url;
+    }
+
+    return QByteArray(buf.constData(), len);
+}
+
+bool graceful::Utils::isUrlEncoded(const char* url, int len)
+{
+    int i = 0;
+    while ((i = skipUrlSafe(url, len, i)) < len) {
+        if (!isValidEscape(url, len, i)) {
+            return false;
+        }
+        i += 3;
+    }
+
+    return true;
+}
+
+int graceful::Utils::urlEncode(const char* url, int len, char* dest)
+{
+    static const char gHex[] = "0123456789ABCDEF";
+
+    int out = 0;
+    int i = 0;
+    while (i < len) {
+        int safe = skipUrlSafe(url, len, i);
+        memcpy(dest + out, url + i, size_t(safe - i));
+        out += safe - i;
+        i = safe;
+        if (i >= len) {
+            break;
+        }
+
+        if (isValidEscape(url, len, i)) {
+            dest[out++] = '%';
+            dest[out++] = g_ascii_toupper(url[i + 1]);
+            dest[out++] = g_ascii_toupper(url[i + 2]);
+            i += 3;
+        } else {
+            uchar c = uchar(url[i]);
+            dest[out++] = '%';
+            dest[out++] = gHex[c >> 4];
+            dest[out++] = gHex[c & 0x0F];
+            ++i;
+        }
+    }
+
+    return out;
+}
+
+int graceful::Utils::urlDecode(const char* url, int len, char* dest)
+{
+    int out = 0;
+    int i = 0;
+    while (i < len) {
+        const char* pct = static_cast<const char*>(memchr(url + i, '%', size_t(len - i)));
+        int next = pct ? int(pct - url) : len;
+        memcpy(dest + out, url + i, size_t(next - i));
+        out += next - i;
+        i = next;
+        if (i >= len) {
+            break;
+        }
+
+        if (!isValidEscape(url, len, i)) {
+            return -1;
+        }
+
+        char c = char((g_ascii_xdigit_value(url[i + 1]) << 4) | g_ascii_xdigit_value(url[i + 2]));
+        if ('\0' == c || '/' == c || ':' == c) {
+            return -1;
+        }
+        dest[out++] = c;
+        i += 3;
+    }
+
+    return out;
+}
+
+void graceful::Utils::mergeFileInfo(GFileInfo* dest, GFileInfo* src)
+{
+    g_return_if_fail(G_IS_FILE_INFO(dest) && G_IS_FILE_INFO(src));
+
+    g_auto(GStrv) attrs = g_file_info_list_attributes(src, nullptr);
+    for (int i = 0; attrs && attrs[i]; ++i) {
+        gpointer value = nullptr;
+        GFileAttributeType type = G_FILE_ATTRIBUTE_TYPE_INVALID;
+        if (g_file_info_get_attribute_data(src, attrs[i], &type, &value, nullptr)) {
+            g_file_info_set_attribute(dest, attrs[i], type, value);
+        }
+    }
 }
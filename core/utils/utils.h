@@ -4,20 +4,54 @@
 #include "globals.h"
 
 #include <QString>
+#include <QByteArray>
 
 #include <gio/gio.h>
 
 namespace graceful
 {
-
-#define BLOCKING
-#define NO_BLOCKING
-
 class GRACEFUL_API Utils
 {
 public:
     NO_BLOCKING static QString urlEncode(const QString& url);
     NO_BLOCKING static QString urlDecode(const QString& url);
+
+    /**
+     * @brief
+     * 'url' itself, without a copy, when it is already encoded
+     */
+    NO_BLOCKING static QByteArray urlEncode(const QByteArray& url);
+    NO_BLOCKING static QByteArray urlDecode(const QByteArray& url);
+
+    /**
+     * @brief
+     * true if no byte of the UTF-8 'url' must be escaped and every '%' starts a valid escape.
+     * RFC 3986 path characters and non ASCII UTF-8 are kept as is, so uris
+     * printed by GIO are never changed
+     */
+    NO_BLOCKING static bool isUrlEncoded(const char* url, int len);
+
+    /**
+     * @brief
+     * percent-encode 'len' bytes of UTF-8 at 'url' into 'dest', which must hold
+     * 3 * len bytes. Valid escapes are kept, so encoding twice changes nothing.
+     * Return the number of bytes written
+     */
+    NO_BLOCKING static int urlEncode(const char* url, int len, char* dest);
+
+    /**
+     * @brief
+     * decode 'len' bytes at 'url' into 'dest', which must hold 'len' bytes.
+     * Return the number of bytes written, -1 if 'url' has an invalid escape
+     * or an escaped '/', ':' or NUL
+     */
+    NO_BLOCKING static int urlDecode(const char* url, int len, char* dest);
+
+    /**
+     * @brief
+     * copy every attribute set in 'src' into 'dest', attributes only in 'dest' are kept
+     */
+    NO_BLOCKING static void mergeFileInfo(GFileInfo* dest, GFileInfo* src);
 };
 }
 